@@ -1,14 +1,11 @@
 #include <inttypes.h>
+#include <setjmp.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
-/*
- * These are defined for each TIP program in the compiled code.
- */
-int64_t _tip_main();
-extern int64_t _tip_num_inputs;
-extern int64_t _tip_input_array[];
+#include "tip_rtlib.h"
 
 /*
  * runtime library functions for TIP IO expressions and statements
@@ -25,11 +22,371 @@ int64_t _tip_input() {
 
 void _tip_output(int64_t x) { printf("Program output: %" PRId64 "\n", x); }
 
-void _tip_error(int64_t x) {
+__attribute__((noreturn, cold)) void _tip_error(int64_t x) {
   printf("[error] Error: Execution error, code: %" PRId64 "\n", x);
   exit(-1);
 }
 
+/*
+ * Conservative mark-sweep garbage collector
+ *
+ * Programs compiled with "tipc --gc" allocate cells, records and arrays with
+ * _tip_gc_alloc instead of calloc.  TIP values are untyped 64-bit integers,
+ * so the collector is conservative: any word on the native stack, or in a
+ * reachable object, that points into an allocated object keeps that object
+ * alive.  Interior pointers are recognized, and every object is padded by at
+ * least one byte so that a pointer just past its end still identifies it.
+ *
+ * Small objects are carved out of aligned segments that each hold objects of
+ * a single size class.  Large objects are allocated individually and kept in
+ * a table sorted by address.  A collection is triggered once the bytes
+ * allocated since the last collection exceed the bytes that survived it, so
+ * the heap stays within a constant factor of the live data.
+ */
+#define GC_SEGMENT_SIZE ((size_t)64 * 1024)
+#define GC_NUM_CLASSES 12
+#define GC_MIN_THRESHOLD ((size_t)8 * 1024 * 1024)
+
+static const size_t gcClassSize[GC_NUM_CLASSES] = {
+    16, 24, 32, 48, 64, 96, 128, 192, 256, 512, 1024, 2048};
+
+typedef struct gc_segment {
+  char *base;
+  size_t objSize;
+  size_t numObjs;
+  size_t numLive;
+  int sizeClass;
+  struct gc_segment *next; // next segment of the same size class
+  uint8_t *allocated;
+  uint8_t *marked;
+} gc_segment;
+
+typedef struct gc_large {
+  char *start;
+  size_t size;
+  uint8_t marked;
+} gc_large;
+
+typedef struct gc_range {
+  char *start;
+  size_t size;
+} gc_range;
+
+// All segments sorted by base address
+static gc_segment **gcSegments = NULL;
+static size_t gcNumSegments = 0, gcCapSegments = 0;
+
+// Per size class segment lists and allocation cursors
+static gc_segment *gcClassSegments[GC_NUM_CLASSES];
+static gc_segment *gcCursorSegment[GC_NUM_CLASSES];
+static size_t gcCursorIndex[GC_NUM_CLASSES];
+
+// All large objects sorted by start address
+static gc_large *gcLarge = NULL;
+static size_t gcNumLarge = 0, gcCapLarge = 0;
+
+static gc_range *gcMarkStack = NULL;
+static size_t gcMarkDepth = 0, gcMarkCap = 0;
+
+// Bounds of the address range covered by the heap
+static uintptr_t gcHeapMin = UINTPTR_MAX, gcHeapMax = 0;
+
+static size_t gcAllocated = 0;
+static size_t gcThreshold = GC_MIN_THRESHOLD;
+
+// Highest address of the native stack scanned for roots, set by main
+static char *gcStackBase = NULL;
+
+static void *gcCheck(void *p) {
+  if (p == NULL) {
+    printf("Error: out of memory\n");
+    exit(-1);
+  }
+  return p;
+}
+
+static void *gcGrow(void *array, size_t *cap, size_t elemSize) {
+  *cap = *cap == 0 ? 64 : 2 * *cap;
+  return gcCheck(realloc(array, *cap * elemSize));
+}
+
+static void gcCover(uintptr_t lo, uintptr_t hi) {
+  if (lo < gcHeapMin) {
+    gcHeapMin = lo;
+  }
+  if (hi > gcHeapMax) {
+    gcHeapMax = hi;
+  }
+}
+
+static gc_segment *gcFindSegment(uintptr_t addr) {
+  char *base = (char *)(addr & ~(uintptr_t)(GC_SEGMENT_SIZE - 1));
+  size_t lo = 0, hi = gcNumSegments;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (gcSegments[mid]->base < base) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo < gcNumSegments && gcSegments[lo]->base == base) {
+    return gcSegments[lo];
+  }
+  return NULL;
+}
+
+// Index of the large object whose extent contains addr, or gcNumLarge
+static size_t gcFindLarge(uintptr_t addr) {
+  size_t lo = 0, hi = gcNumLarge;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if ((uintptr_t)gcLarge[mid].start <= addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  if (lo > 0 && addr < (uintptr_t)gcLarge[lo - 1].start + gcLarge[lo - 1].size) {
+    return lo - 1;
+  }
+  return gcNumLarge;
+}
+
+static gc_segment *gcNewSegment(int sizeClass) {
+  void *base;
+  if (posix_memalign(&base, GC_SEGMENT_SIZE, GC_SEGMENT_SIZE) != 0) {
+    gcCheck(NULL);
+  }
+  size_t objSize = gcClassSize[sizeClass];
+  size_t numObjs = GC_SEGMENT_SIZE / objSize;
+  gc_segment *seg = gcCheck(malloc(sizeof(gc_segment) + 2 * numObjs));
+  seg->base = base;
+  seg->objSize = objSize;
+  seg->numObjs = numObjs;
+  seg->numLive = 0;
+  seg->sizeClass = sizeClass;
+  seg->allocated = (uint8_t *)(seg + 1);
+  seg->marked = seg->allocated + numObjs;
+  memset(seg->allocated, 0, 2 * numObjs);
+
+  seg->next = gcClassSegments[sizeClass];
+  gcClassSegments[sizeClass] = seg;
+
+  // keep the segment table sorted by address
+  if (gcNumSegments == gcCapSegments) {
+    gcSegments = gcGrow(gcSegments, &gcCapSegments, sizeof(gc_segment *));
+  }
+  size_t pos = gcNumSegments;
+  while (pos > 0 && gcSegments[pos - 1]->base > seg->base) {
+    gcSegments[pos] = gcSegments[pos - 1];
+    pos--;
+  }
+  gcSegments[pos] = seg;
+  gcNumSegments++;
+
+  gcCover((uintptr_t)base, (uintptr_t)base + GC_SEGMENT_SIZE);
+  return seg;
+}
+
+static void gcPush(char *start, size_t size) {
+  if (gcMarkDepth == gcMarkCap) {
+    gcMarkStack = gcGrow(gcMarkStack, &gcMarkCap, sizeof(gc_range));
+  }
+  gcMarkStack[gcMarkDepth].start = start;
+  gcMarkStack[gcMarkDepth].size = size;
+  gcMarkDepth++;
+}
+
+static void gcMarkWord(uintptr_t w) {
+  if (w < gcHeapMin || w >= gcHeapMax) {
+    return;
+  }
+  gc_segment *seg = gcFindSegment(w);
+  if (seg != NULL) {
+    size_t idx = (w - (uintptr_t)seg->base) / seg->objSize;
+    if (idx < seg->numObjs && seg->allocated[idx] && !seg->marked[idx]) {
+      seg->marked[idx] = 1;
+      gcPush(seg->base + idx * seg->objSize, seg->objSize);
+    }
+    return;
+  }
+  size_t l = gcFindLarge(w);
+  if (l < gcNumLarge && !gcLarge[l].marked) {
+    gcLarge[l].marked = 1;
+    gcPush(gcLarge[l].start, gcLarge[l].size);
+  }
+}
+
+static void gcScan(char *lo, char *hi) {
+  uintptr_t *p = (uintptr_t *)(((uintptr_t)lo + sizeof(uintptr_t) - 1) &
+                               ~(uintptr_t)(sizeof(uintptr_t) - 1));
+  for (; (char *)(p + 1) <= hi; p++) {
+    gcMarkWord(*p);
+  }
+}
+
+/*
+ * The native stack grows downward, so the roots lie between the frame of
+ * this function and the base recorded by main.  The caller has spilled the
+ * callee-saved registers into a jmp_buf that lies in this range.
+ */
+static __attribute__((noinline)) void gcMarkRoots(void) {
+  char *top = __builtin_frame_address(0);
+  gcScan(top, gcStackBase);
+  while (gcMarkDepth > 0) {
+    gc_range r = gcMarkStack[--gcMarkDepth];
+    gcScan(r.start, r.start + r.size);
+  }
+}
+
+static void gcSweep(void) {
+  size_t live = 0;
+
+  for (int c = 0; c < GC_NUM_CLASSES; c++) {
+    gcClassSegments[c] = NULL;
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < gcNumSegments; i++) {
+    gc_segment *seg = gcSegments[i];
+    seg->numLive = 0;
+    for (size_t j = 0; j < seg->numObjs; j++) {
+      seg->allocated[j] &= seg->marked[j];
+      seg->numLive += seg->allocated[j];
+    }
+    memset(seg->marked, 0, seg->numObjs);
+    if (seg->numLive == 0) {
+      free(seg->base);
+      free(seg);
+      continue;
+    }
+    live += seg->numLive * seg->objSize;
+    seg->next = gcClassSegments[seg->sizeClass];
+    gcClassSegments[seg->sizeClass] = seg;
+    gcSegments[kept++] = seg;
+  }
+  gcNumSegments = kept;
+
+  kept = 0;
+  for (size_t i = 0; i < gcNumLarge; i++) {
+    if (!gcLarge[i].marked) {
+      free(gcLarge[i].start);
+      continue;
+    }
+    gcLarge[i].marked = 0;
+    live += gcLarge[i].size;
+    gcLarge[kept++] = gcLarge[i];
+  }
+  gcNumLarge = kept;
+
+  for (int c = 0; c < GC_NUM_CLASSES; c++) {
+    gcCursorSegment[c] = gcClassSegments[c];
+    gcCursorIndex[c] = 0;
+  }
+
+  gcAllocated = 0;
+  gcThreshold = live > GC_MIN_THRESHOLD ? live : GC_MIN_THRESHOLD;
+}
+
+void _tip_gc_collect() {
+  if (gcStackBase == NULL) {
+    return;
+  }
+  jmp_buf regs;
+  setjmp(regs);
+  gcMarkRoots();
+  gcSweep();
+}
+
+static void *gcAllocSmall(int c) {
+  for (;;) {
+    gc_segment *seg = gcCursorSegment[c];
+    if (seg == NULL) {
+      seg = gcNewSegment(c);
+      gcCursorSegment[c] = seg;
+      gcCursorIndex[c] = 0;
+    }
+    for (size_t i = gcCursorIndex[c]; i < seg->numObjs; i++) {
+      if (!seg->allocated[i]) {
+        seg->allocated[i] = 1;
+        gcCursorIndex[c] = i + 1;
+        char *obj = seg->base + i * seg->objSize;
+        memset(obj, 0, seg->objSize);
+        return obj;
+      }
+    }
+    gcCursorSegment[c] = seg->next;
+    gcCursorIndex[c] = 0;
+  }
+}
+
+static void *gcAllocLarge(size_t size) {
+  char *obj = gcCheck(calloc(1, size));
+  if (gcNumLarge == gcCapLarge) {
+    gcLarge = gcGrow(gcLarge, &gcCapLarge, sizeof(gc_large));
+  }
+  size_t pos = gcNumLarge;
+  while (pos > 0 && gcLarge[pos - 1].start > obj) {
+    gcLarge[pos] = gcLarge[pos - 1];
+    pos--;
+  }
+  gcLarge[pos].start = obj;
+  gcLarge[pos].size = size;
+  gcLarge[pos].marked = 0;
+  gcNumLarge++;
+  gcCover((uintptr_t)obj, (uintptr_t)obj + size);
+  return obj;
+}
+
+/*
+ * Allocate zeroed memory for n items of the given size.  This has the same
+ * signature as calloc so that generated code can use either allocator.
+ */
+void *_tip_gc_alloc(int64_t n, int64_t size) {
+  size_t bytes = (size_t)n * (size_t)size + 1;
+  if (gcAllocated >= gcThreshold) {
+    _tip_gc_collect();
+  }
+  gcAllocated += bytes;
+  for (int c = 0; c < GC_NUM_CLASSES; c++) {
+    if (bytes <= gcClassSize[c]) {
+      return gcAllocSmall(c);
+    }
+  }
+  return gcAllocLarge(bytes);
+}
+
+/*
+ * Arrays are referenced by the address of their first element, which is
+ * aligned to a cache line.  The generated code stores the length in the word
+ * before the first element, so at least one word precedes it.  Both
+ * allocators return zeroed elements.
+ */
+#define TIP_ARRAY_ALIGNMENT ((size_t)64)
+
+void *_tip_alloc_array(int64_t n) {
+  size_t bytes = ((size_t)n * sizeof(int64_t) + TIP_ARRAY_ALIGNMENT - 1) &
+                 ~(TIP_ARRAY_ALIGNMENT - 1);
+  char *block = gcCheck(
+      aligned_alloc(TIP_ARRAY_ALIGNMENT, TIP_ARRAY_ALIGNMENT + bytes));
+  memset(block, 0, TIP_ARRAY_ALIGNMENT + bytes);
+  return block + TIP_ARRAY_ALIGNMENT;
+}
+
+/*
+ * Collected objects are not aligned beyond a word, so the elements start at
+ * the first cache line boundary past the length word.  The resulting
+ * interior pointer keeps the object alive.
+ */
+void *_tip_gc_alloc_array(int64_t n) {
+  size_t bytes = ((size_t)n + 1) * sizeof(int64_t) + TIP_ARRAY_ALIGNMENT - 1;
+  char *obj = _tip_gc_alloc(1, (int64_t)bytes);
+  uintptr_t elements =
+      ((uintptr_t)obj + sizeof(int64_t) + TIP_ARRAY_ALIGNMENT - 1) &
+      ~(uintptr_t)(TIP_ARRAY_ALIGNMENT - 1);
+  return (void *)elements;
+}
+
 /*
  * If the compiled program has no "main" function then one is created
  * that calls this function.
@@ -47,22 +404,50 @@ void _tip_main_undefined() {
  * Finally, the TIP "main" is renamed during compilation to "_tip_main",
  * its arguments are removed, and code to read them from "_tip_input_array"
  * is generated.
+ *
+ * Programs run by "tipc --run" are started here by the compiler, which
+ * passes the addresses it found for the compiled program.
  */
-int main(int argc, char *argv[]) {
+__attribute__((noinline)) int _tip_start(int64_t (*tipMain)(),
+                                         int64_t numInputs,
+                                         int64_t *inputArray, int argc,
+                                         char *argv[]) {
+  // Stack roots for the garbage collector lie below this frame
+  gcStackBase = __builtin_frame_address(0);
+
   // Throw an error if the wrong number of arguments are passed
-  if (argc != _tip_num_inputs + 1) {
-    printf("expected %" PRId64 " integer arguments\n", _tip_num_inputs);
+  if (argc != numInputs + 1) {
+    printf("expected %" PRId64 " integer arguments\n", numInputs);
     exit(-1);
   }
 
   // required by strtoll, but discarded
   char *eptr;
 
-  for (size_t i = 0; i < _tip_num_inputs; i++) {
-    _tip_input_array[i] = strtoll(argv[i + 1], &eptr, 10);
+  for (size_t i = 0; i < numInputs; i++) {
+    inputArray[i] = strtoll(argv[i + 1], &eptr, 10);
   }
 
-  printf("Program output: %" PRId64 "\n", _tip_main());
+  printf("Program output: %" PRId64 "\n", tipMain());
 
   return 0;
 }
+
+/*
+ * The runtime is also built into tipc itself, where there is no compiled
+ * program to start.
+ */
+#ifndef TIP_RTLIB_EMBEDDED
+
+/*
+ * These are defined for each TIP program in the compiled code.
+ */
+int64_t _tip_main();
+extern int64_t _tip_num_inputs;
+extern int64_t _tip_input_array[];
+
+int main(int argc, char *argv[]) {
+  return _tip_start(_tip_main, _tip_num_inputs, _tip_input_array, argc, argv);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef TIP_RTLIB_H
+#define TIP_RTLIB_H
+
+#include <stdint.h>
+
+/*
+ * The entry points of the runtime library that compiled TIP programs call.
+ * The library is also built into tipc, where "tipc --run" and
+ * "tipc --interp" call these functions directly, so this is their only
+ * declaration.
+ */
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int64_t _tip_input();
+void _tip_output(int64_t x);
+__attribute__((noreturn, cold)) void _tip_error(int64_t x);
+void _tip_gc_collect();
+void *_tip_gc_alloc(int64_t n, int64_t size);
+void *_tip_alloc_array(int64_t n);
+void *_tip_gc_alloc_array(int64_t n);
+void _tip_main_undefined();
+int _tip_start(int64_t (*tipMain)(), int64_t numInputs, int64_t *inputArray,
+               int argc, char *argv[]);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,265 @@
+#include "Backend.h"
+
+#include "llvm/CodeGen/ParallelCG.h"
+#include "llvm/IR/LegacyPassManager.h"
+#include "llvm/MC/TargetRegistry.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/FileUtilities.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/Program.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/ToolOutputFile.h"
+#include "llvm/TargetParser/Host.h"
+#include "llvm/TargetParser/SubtargetFeature.h"
+
+#include "OutputError.h"
+#include "loguru.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+namespace {
+
+// Temporary files, which are removed when the output has been produced
+using TemporaryFiles = std::vector<std::unique_ptr<llvm::FileRemover>>;
+
+std::string createTemporaryObject(TemporaryFiles &temporaries) {
+  llvm::SmallString<128> object;
+  if (llvm::sys::fs::createTemporaryFile("tipc", "o", object)) {
+    throw OutputError("failed to create a temporary object file");
+  }
+  temporaries.push_back(std::make_unique<llvm::FileRemover>(object));
+  return object.str().str();
+}
+
+// The number of partitions for the jobs, so that each holds a function
+unsigned numPartitions(llvm::Module *m, unsigned jobs) {
+  unsigned definitions = 0;
+  for (auto &fun : *m) {
+    if (!fun.isDeclaration()) {
+      definitions++;
+    }
+  }
+  return std::max(1u, std::min(jobs, definitions));
+}
+
+/*
+ * Compile the partitions of a module to temporary object files.  Each
+ * partition is moved to a context of its own through bitcode, so that the
+ * threads share no LLVM state, and is compiled by its own target machine.
+ */
+void emitPartitions(llvm::Module *m, unsigned partitions,
+                    const BackendOptions &options,
+                    std::vector<std::string> &objects,
+                    TemporaryFiles &temporaries) {
+  auto targetMachine =
+      Backend::createTargetMachine(m, options.cpu, options.features);
+  if (targetMachine == nullptr) {
+    throw OutputError("native code emission is not supported");
+  }
+
+  std::vector<std::unique_ptr<llvm::raw_fd_ostream>> streams;
+  std::vector<llvm::raw_pwrite_stream *> outputs;
+  for (unsigned i = 0; i < partitions; i++) {
+    std::string object = createTemporaryObject(temporaries);
+    std::error_code ec;
+    streams.push_back(std::make_unique<llvm::raw_fd_ostream>(
+        object, ec, llvm::sys::fs::OF_None));
+    if (ec) {
+      throw OutputError("failed to open '" + object + "' for writing");
+    }
+    outputs.push_back(streams.back().get());
+    objects.push_back(object);
+  }
+
+  LOG_S(1) << "Compiling " << m->getModuleIdentifier() << " in " << partitions
+           << " partitions";
+  llvm::splitCodeGen(*m, outputs, {}, [&]() {
+    return Backend::cloneTargetMachine(*targetMachine);
+  });
+
+  for (auto &stream : streams) {
+    stream->close();
+    if (stream->has_error()) {
+      stream->clear_error();
+      throw OutputError("failed to write a temporary object file");
+    }
+  }
+}
+
+// Run the compiler driver on the objects, with the flags before them
+void link(const std::string &linker, llvm::ArrayRef<llvm::StringRef> flags,
+          const std::vector<std::string> &objects,
+          const std::string &filename) {
+  std::vector<llvm::StringRef> args = {linker};
+  args.insert(args.end(), flags.begin(), flags.end());
+  args.insert(args.end(), objects.begin(), objects.end());
+  args.push_back("-o");
+  args.push_back(filename);
+  LOG_S(1) << "Linking " << filename << " with " << linker;
+
+  std::string error;
+  int status =
+      llvm::sys::ExecuteAndWait(linker, args, std::nullopt, {}, 0, 0, &error);
+  if (status != 0) {
+    throw OutputError("linking '" + filename + "' failed" +
+                      (error.empty() ? "" : ": " + error));
+  }
+}
+
+std::string findLinker(const BackendOptions &options) {
+  auto linker = llvm::sys::findProgramByName(options.linker);
+  if (!linker) {
+    throw OutputError("linker '" + options.linker + "' was not found");
+  }
+  return *linker;
+}
+
+// The host CPU and features are looked up once and shared by every module
+const std::string &hostCPU() {
+  static const std::string name = llvm::sys::getHostCPUName().str();
+  return name;
+}
+
+const std::string &hostFeatures() {
+  static const std::string features = [] {
+    llvm::SubtargetFeatures hostFeatures;
+    llvm::StringMap<bool> featureMap;
+    if (llvm::sys::getHostCPUFeatures(featureMap)) {
+      for (auto &feature : featureMap) {
+        hostFeatures.AddFeature(feature.first(), feature.second);
+      }
+    }
+    return hostFeatures.getString();
+  }();
+  return features;
+}
+
+} // namespace
+
+std::unique_ptr<llvm::TargetMachine>
+Backend::createTargetMachine(llvm::Module *m, const std::string &cpu,
+                             const std::string &features) {
+  // The target is registered once, whichever thread first needs it
+  static std::once_flag initialized;
+  std::call_once(initialized, [] {
+    llvm::InitializeNativeTarget();
+    llvm::InitializeNativeTargetAsmPrinter();
+  });
+
+  std::string error;
+  auto triple = m->getTargetTriple();
+  auto *target = llvm::TargetRegistry::lookupTarget(triple, error);
+  if (target == nullptr) {
+    LOG_S(WARNING) << "tipc: no target for " << triple << ": " << error;
+    return nullptr;
+  }
+
+  const std::string &targetCPU = cpu == "native" ? hostCPU() : cpu;
+  const std::string &targetFeatures =
+      features == "native" ? hostFeatures() : features;
+
+  LOG_S(1) << "Targeting " << triple << " cpu " << targetCPU << " features "
+           << targetFeatures;
+
+  std::unique_ptr<llvm::TargetMachine> targetMachine(
+      target->createTargetMachine(triple, targetCPU, targetFeatures,
+                                  llvm::TargetOptions(), llvm::Reloc::PIC_));
+  m->setDataLayout(targetMachine->createDataLayout());
+
+  for (auto &fun : *m) {
+    if (fun.isDeclaration()) {
+      continue;
+    }
+    if (targetCPU != "generic") {
+      fun.addFnAttr("target-cpu", targetCPU);
+    }
+    if (!targetFeatures.empty()) {
+      fun.addFnAttr("target-features", targetFeatures);
+    }
+  }
+
+  return targetMachine;
+}
+
+std::unique_ptr<llvm::TargetMachine>
+Backend::cloneTargetMachine(const llvm::TargetMachine &targetMachine) {
+  return std::unique_ptr<llvm::TargetMachine>(
+      targetMachine.getTarget().createTargetMachine(
+          targetMachine.getTargetTriple().str(), targetMachine.getTargetCPU(),
+          targetMachine.getTargetFeatureString(), targetMachine.Options,
+          targetMachine.getRelocationModel(), targetMachine.getCodeModel(),
+          targetMachine.getOptLevel()));
+}
+
+void Backend::emitObject(llvm::Module *m, std::string filename,
+                         const BackendOptions &options) {
+  if (filename.empty()) {
+    filename = m->getModuleIdentifier() + OBJ_EXT;
+  }
+
+  // the objects of the partitions are combined into one
+  unsigned partitions = numPartitions(m, options.jobs);
+  if (partitions > 1) {
+    std::string linker = findLinker(options);
+    TemporaryFiles temporaries;
+    std::vector<std::string> objects;
+    emitPartitions(m, partitions, options, objects, temporaries);
+    link(linker, {"-r", "-nostdlib"}, objects, filename);
+    return;
+  }
+
+  auto targetMachine = createTargetMachine(m, options.cpu, options.features);
+  if (targetMachine == nullptr) {
+    throw OutputError("native code emission is not supported");
+  }
+
+  std::error_code ec;
+  llvm::ToolOutputFile result(filename, ec, llvm::sys::fs::OF_None);
+  if (ec) {
+    throw OutputError("failed to open '" + filename + "' for writing");
+  }
+
+  llvm::legacy::PassManager passManager;
+  if (targetMachine->addPassesToEmitFile(passManager, result.os(), nullptr,
+                                         llvm::CGFT_ObjectFile)) {
+    throw OutputError("the target cannot emit object files");
+  }
+  passManager.run(*m);
+
+  result.os().close();
+  if (result.os().has_error()) {
+    result.os().clear_error();
+    throw OutputError("failed to write '" + filename + "'");
+  }
+  result.keep();
+}
+
+void Backend::emitExecutable(llvm::Module *m, std::string filename,
+                             const std::string &runtime,
+                             const BackendOptions &options) {
+  // the executable is written next to its source, as the other outputs are
+  if (filename.empty()) {
+    llvm::SmallString<128> executable(m->getModuleIdentifier());
+    llvm::sys::path::replace_extension(executable, "");
+    filename = executable.str().str();
+  }
+
+  std::string linker = findLinker(options);
+
+  TemporaryFiles temporaries;
+  std::vector<std::string> objects;
+  unsigned partitions = numPartitions(m, options.jobs);
+  if (partitions > 1) {
+    emitPartitions(m, partitions, options, objects, temporaries);
+  } else {
+    std::string object = createTemporaryObject(temporaries);
+    emitObject(m, object, options);
+    objects.push_back(object);
+  }
+
+  objects.push_back(runtime);
+  link(linker, {}, objects, filename);
+}
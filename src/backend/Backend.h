@@ -0,0 +1,96 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include "llvm/Target/TargetMachine.h"
+#include <memory>
+#include <string>
+
+static const char *const OBJ_EXT = ".o";
+
+/*! \struct BackendOptions
+ *  \brief Settings for native code emission.
+ */
+struct BackendOptions {
+  //! Target CPU, "native" selects the host CPU
+  std::string cpu = "native";
+
+  //! Target features, e.g., "+avx2,-fma"; "native" selects the host features
+  std::string features = "native";
+
+  //! Compiler driver used to link executables
+  std::string linker = "cc";
+
+  //! Number of partitions of the module compiled concurrently
+  unsigned jobs = 1;
+};
+
+/*! \class Backend
+ *  \brief Routines to produce native code for the host.
+ *
+ * The backend runs instruction selection and register allocation in-process
+ * through an LLVM TargetMachine, so that object files and executables are
+ * produced without reading the module back from bitcode.
+ *
+ * With more than one job, the module is split into partitions that are
+ * compiled on separate threads.  Internal symbols such as the function table
+ * are given hidden external names, so that the partitions refer to a single
+ * definition once their objects are linked together.
+ */
+class Backend {
+public:
+  /*! \fn createTargetMachine
+   *  \brief Create a target machine for the triple of a module.
+   *
+   * The data layout of the module is set from the target machine, and the
+   * CPU and its features are recorded on every function, since the target
+   * analyses and the backend read them from the function attributes.
+   * \param m the LLVM module holding the generated program
+   * \param cpu the target CPU, or "native"
+   * \param features the target features, or "native"
+   * \return the target machine, or nullptr if the target is not available
+   */
+  static std::unique_ptr<llvm::TargetMachine>
+  createTargetMachine(llvm::Module *m, const std::string &cpu,
+                      const std::string &features);
+
+  /*! \fn cloneTargetMachine
+   *  \brief Create a target machine with the settings of another.
+   *
+   * A target machine caches state for the functions it compiles, so each
+   * thread that optimizes or compiles code uses a target machine of its own.
+   * \param targetMachine the target machine whose settings are used
+   * \return the new target machine
+   */
+  static std::unique_ptr<llvm::TargetMachine>
+  cloneTargetMachine(const llvm::TargetMachine &targetMachine);
+
+  /*! \fn emitObject
+   *  \brief Compile a module to a native object file.
+   *
+   * The objects of the partitions of a module compiled by several jobs are
+   * combined with a relocatable link.
+   * \param m the LLVM module holding the generated program
+   * \param filename the object file, by default the module name suffixed
+   * with ".o"
+   * \param options settings for code emission
+   * \throws OutputError when the object file cannot be written
+   */
+  static void emitObject(llvm::Module *m, std::string filename = "",
+                         const BackendOptions &options = BackendOptions());
+
+  /*! \fn emitExecutable
+   *  \brief Compile a module and link it with the runtime library.
+   *
+   * The linker is invoked once, on the temporary object files holding the
+   * program and the prebuilt runtime library object.
+   * \param m the LLVM module holding the generated program
+   * \param filename the executable, by default the module name without the
+   * ".tip" extension, so that it is written next to the source file
+   * \param runtime the runtime library object
+   * \param options settings for code emission
+   * \throws OutputError when the executable cannot be compiled or linked
+   */
+  static void emitExecutable(llvm::Module *m, std::string filename,
+                             const std::string &runtime,
+                             const BackendOptions &options = BackendOptions());
+};
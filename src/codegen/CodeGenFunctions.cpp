@@ -3,8 +3,15 @@
 #include <llvm/Support/JSON.h>
 
 #include "AST.h"
+#include "CodeGenOptions.h"
 #include "InternalError.h"
 #include "SemanticAnalysis.h"
+#include "TipArray.h"
+#include "TipCons.h"
+#include "TipMu.h"
+#include "TipRecord.h"
+#include "TipRef.h"
+#include "TipVar.h"
 #include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/IR/BasicBlock.h"
 #include "llvm/IR/Constants.h"
@@ -15,6 +22,7 @@
 #include "llvm/IR/Intrinsics.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/LegacyPassManager.h"
+#include "llvm/IR/MDBuilder.h"
 #include "llvm/IR/Module.h"
 #include "llvm/IR/Type.h"
 #include "llvm/IR/Verifier.h"
@@ -24,72 +32,130 @@
 
 #include "loguru.hpp"
 
-namespace {
+#include <algorithm>
+#include <functional>
+#include <sstream>
 
-llvm::LLVMContext llvmContext;
-llvm::IRBuilder<> irBuilder(llvmContext);
+namespace {
 
 /*
- * Functions are represented with indices into a table.
- * This permits function values to be passed, i.e, as Int64 indices.
+ * The state of one compilation.  Code is generated by the codegen routines
+ * of the AST nodes, which reach the state of the compilation running on
+ * their thread through cg.  Every compilation has a state of its own, so
+ * programs can be compiled one after another, or concurrently on separate
+ * threads, without sharing anything.
  */
-std::map<std::string, int> functionIndex;
-std::map<std::string, std::vector<std::string>> functionFormalNames;
+struct CodeGenContext {
+  explicit CodeGenContext(llvm::LLVMContext &context)
+      : llvmContext(context), irBuilder(context),
+        zeroV(llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 0)),
+        oneV(llvm::ConstantInt::get(llvm::Type::getInt64Ty(context), 1)) {}
 
-std::map<std::string, llvm::AllocaInst *> namedValues;
+  llvm::LLVMContext &llvmContext;
+  llvm::IRBuilder<> irBuilder;
 
-llvm::StructType *globalRecordType;
+  /*
+   * Functions are represented with indices into a table.
+   * This permits function values to be passed, i.e, as Int64 indices.
+   */
+  std::map<std::string, int> functionIndex;
+  std::map<std::string, std::vector<std::string>> functionFormalNames;
 
-llvm::PointerType *pointerToGlobalRecordType;
+  std::map<std::string, llvm::AllocaInst *> namedValues;
+  std::map<std::string, ASTDeclNode *> namedDecls;
 
-// Maps field names to their index in the globalRecord
-std::map<std::basic_string<char>, int> fieldIndex;
+  // Number of loops enclosing the code being generated
+  int loopDepth = 0;
 
-// Vector of fields in a global record
-std::vector<std::basic_string<char>> fieldVector;
+  llvm::StructType *globalRecordType = nullptr;
 
-// Permits getFunction to access the current module being compiled
-std::shared_ptr<llvm::Module> CurrentModule;
+  llvm::PointerType *pointerToGlobalRecordType = nullptr;
 
-/*
- * We use calls to llvm intrinsics for several purposes.  To construct a "nop",
- * using an LLVM internal intrinsic, to perform TIP specific IO, and
- * to allocate heap memory.
- */
-llvm::Function *nop = nullptr;
-llvm::Function *inputIntrinsic = nullptr;
-llvm::Function *outputIntrinsic = nullptr;
-llvm::Function *errorIntrinsic = nullptr;
-llvm::Function *callocFun = nullptr;
+  // Maps field names to their index in the globalRecord
+  std::map<std::basic_string<char>, int> fieldIndex;
 
-// A counter to create shared labels
-int labelNum = 0;
+  // Permits getFunction to access the current module being compiled
+  std::shared_ptr<llvm::Module> CurrentModule;
 
-// Indicate whether the expression code gen is for an L-value
-bool lValueGen = false;
+  /*
+   * We use calls to llvm intrinsics for several purposes.  To construct a
+   * "nop", using an LLVM internal intrinsic, to perform TIP specific IO, and
+   * to allocate heap memory.
+   */
+  llvm::Function *nop = nullptr;
+  llvm::Function *inputIntrinsic = nullptr;
+  llvm::Function *outputIntrinsic = nullptr;
+  llvm::Function *callocFun = nullptr;
+  llvm::Function *arrayAllocFun = nullptr;
 
-// Indicate whether the expression code gen is for an alloc'd value
-bool allocFlag = false;
+  // The options of the program being compiled
+  CodeGenOptions codeGenOptions;
 
-llvm::GlobalVariable *tipFunctionTable = nullptr;
+  // A counter to create shared labels
+  int labelNum = 0;
 
-int64_t numTIPArgs = 0;
+  // Indicate whether the expression code gen is for an L-value
+  bool lValueGen = false;
 
-/*
- * The global argument count and array are used to communicate command
- * line inputs to the TIP main function.
- */
-llvm::GlobalVariable *tipNumInputs = nullptr;
-llvm::GlobalVariable *tipInputArray = nullptr;
+  // Indicate whether the expression code gen is for an alloc'd value
+  bool allocFlag = false;
+
+  // Inferred types that select the representation of each value
+  TypeInference *typeResults = nullptr;
+  std::map<ASTExpr *, llvm::Type *> valueTypes;
+
+  // Allocation sites that can be placed in the stack frame of their function
+  EscapeAnalysis *escapeResults = nullptr;
+
+  // Array accesses whose bounds checks are proven or hoisted out of their loop
+  BoundsAnalysis *boundsResults = nullptr;
+
+  // Accesses of the loop copy being emitted whose overflow check was hoisted
+  std::set<ASTArrayRefExpr *> hoistedChecks;
+
+  llvm::GlobalVariable *tipFunctionTable = nullptr;
+
+  int64_t numTIPArgs = 0;
+
+  /*
+   * The global argument count and array are used to communicate command
+   * line inputs to the TIP main function.
+   */
+  llvm::GlobalVariable *tipNumInputs = nullptr;
+  llvm::GlobalVariable *tipInputArray = nullptr;
+
+  /*
+   * Some constants are used repeatedly in code generation.  We define them
+   * hear to eliminate redundancy.
+   */
+  llvm::Constant *zeroV;
+  llvm::Constant *oneV;
+};
 
 /*
- * Some constants are used repeatedly in code generation.  We define them
- * hear to eliminate redundancy.
+ * Nodes whose code is generated outside of a compilation, e.g., a single
+ * node in a unit test, use a state of their own thread.
  */
-llvm::Constant *zeroV =
-    llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0);
-llvm::Constant *oneV =
-    llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 1);
+CodeGenContext *detachedContext() {
+  thread_local llvm::LLVMContext llvmContext;
+  thread_local CodeGenContext context(llvmContext);
+  return &context;
+}
+
+// The state of the compilation running on this thread
+thread_local CodeGenContext *cg = detachedContext();
+
+// Makes a state current on its thread for the duration of a compilation
+class CurrentContext {
+public:
+  explicit CurrentContext(CodeGenContext &context) : previous(cg) {
+    cg = &context;
+  }
+  ~CurrentContext() { cg = previous; }
+
+private:
+  CodeGenContext *previous;
+};
 
 /*
  * Create LLVM Function in Module associated with current program.
@@ -99,7 +165,7 @@ llvm::Constant *oneV =
  */
 
 llvm::Function *getFunction(const std::string& functionName) {
-  auto formalNames = functionFormalNames[functionName];
+  auto formalNames = cg->functionFormalNames[functionName];
 
   /*
    * Main is handled specially.  It is declared as "_tip_main" with
@@ -108,36 +174,36 @@ llvm::Function *getFunction(const std::string& functionName) {
    */
 
   if (functionName == "main") {
-    if (auto *M = CurrentModule->getFunction("_tip_main")) {
+    if (auto *M = cg->CurrentModule->getFunction("_tip_main")) {
       return M;
     }
 
-    numTIPArgs = formalNames.size();
+    cg->numTIPArgs = formalNames.size();
 
     // Declare "_tip_main"
     auto *scratchModule = llvm::Function::Create(
-        llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext), false),
+        llvm::FunctionType::get(llvm::Type::getInt64Ty(cg->llvmContext), false),
         llvm::Function::ExternalLinkage, "_tip_" + functionName,
-        CurrentModule.get());
+        cg->CurrentModule.get());
     return scratchModule;
   } else {
-    if (auto *F = CurrentModule->getFunction(functionName)) {
+    if (auto *F = cg->CurrentModule->getFunction(functionName)) {
       return F;
     }
 
     // Function Not Found, Create it.
 
-    std::vector<llvm::Type *> FormalTypes(formalNames.size(),
-                                          llvm::Type::getInt64Ty(llvmContext));
+    std::vector<llvm::Type *> FormalTypes(
+        formalNames.size(), llvm::Type::getInt64Ty(cg->llvmContext));
 
     // Use type factory to create function from formal type to int
 
     auto *scratchFunctionType = llvm::FunctionType::get(
-        llvm::Type::getInt64Ty(llvmContext), FormalTypes, false);
+        llvm::Type::getInt64Ty(cg->llvmContext), FormalTypes, false);
 
     auto *scratchFunction = llvm::Function::Create(
         scratchFunctionType, llvm::Function::InternalLinkage, functionName,
-        CurrentModule.get());
+        cg->CurrentModule.get());
 
     // assign names to function arguments
     unsigned i = 0;
@@ -150,14 +216,908 @@ llvm::Function *getFunction(const std::string& functionName) {
 
 /*
  * Create an alloca instruction in the entry block of the function.
- * This is used for mutable variables, including arguments to functions.
+ * This is used for mutable variables, including arguments to functions,
+ * and for allocations that do not escape the function.
  */
 llvm::AllocaInst *CreateEntryBlockAlloca(llvm::Function *TheFunction,
-                                         const std::string &VarName) {
+                                         const std::string &VarName,
+                                         llvm::Type *allocType = nullptr) {
+  if (allocType == nullptr) {
+    allocType = llvm::Type::getInt64Ty(cg->llvmContext);
+  }
   llvm::IRBuilder<> tmpAlloca(&TheFunction->getEntryBlock(),
                               TheFunction->getEntryBlock().begin());
-  return tmpAlloca.CreateAlloca(llvm::Type::getInt64Ty(llvmContext), nullptr,
-                                VarName);
+  return tmpAlloca.CreateAlloca(allocType, nullptr, VarName);
+}
+
+/*
+ * Create a stack slot for a temporary that is live from the current insertion
+ * point until the matching call to endTemporary.  The lifetime markers let
+ * the slots of temporaries with disjoint live ranges share storage.
+ */
+llvm::AllocaInst *createTemporary(const std::string &VarName,
+                                  llvm::Type *allocType = nullptr) {
+  auto *slot = CreateEntryBlockAlloca(
+      cg->irBuilder.GetInsertBlock()->getParent(), VarName, allocType);
+  cg->irBuilder.CreateLifetimeStart(
+      slot, cg->irBuilder.getInt64(
+                cg->CurrentModule->getDataLayout().getTypeAllocSize(
+                    slot->getAllocatedType())));
+  return slot;
+}
+
+void endTemporary(llvm::AllocaInst *slot) {
+  cg->irBuilder.CreateLifetimeEnd(
+      slot, cg->irBuilder.getInt64(
+                cg->CurrentModule->getDataLayout().getTypeAllocSize(
+                    slot->getAllocatedType())));
+}
+
+/*
+ * Values whose inferred type is a reference, array or record are addresses,
+ * and they are kept as pointers so that their provenance remains visible to
+ * alias analysis.  All other values, including those whose type is a type
+ * variable of a polymorphic function, are represented as Int64.
+ */
+llvm::Type *llvmTypeOf(std::shared_ptr<TipType> type) {
+  if (auto mu = std::dynamic_pointer_cast<TipMu>(type)) {
+    type = mu->getT();
+  }
+  if (std::dynamic_pointer_cast<TipRef>(type) != nullptr ||
+      std::dynamic_pointer_cast<TipArray>(type) != nullptr ||
+      std::dynamic_pointer_cast<TipRecord>(type) != nullptr) {
+    return llvm::PointerType::get(cg->llvmContext, 0);
+  }
+  return llvm::Type::getInt64Ty(cg->llvmContext);
+}
+
+// Returns the representation of the values of a declared name.
+llvm::Type *declType(ASTDeclNode *decl) {
+  if (cg->typeResults == nullptr) {
+    return llvm::Type::getInt64Ty(cg->llvmContext);
+  }
+  return llvmTypeOf(cg->typeResults->getInferredType(decl));
+}
+
+// Returns the representation of the value of an expression.
+llvm::Type *valueType(ASTExpr *expr) {
+  if (auto var = dynamic_cast<ASTVariableExpr *>(expr)) {
+    auto nv = cg->namedValues.find(var->getName());
+    if (nv != cg->namedValues.end()) {
+      return nv->second->getAllocatedType();
+    }
+    // function values are indices into the function table
+    return llvm::Type::getInt64Ty(cg->llvmContext);
+  }
+  if (cg->typeResults == nullptr) {
+    return llvm::Type::getInt64Ty(cg->llvmContext);
+  }
+
+  auto cached = cg->valueTypes.find(expr);
+  if (cached != cg->valueTypes.end()) {
+    return cached->second;
+  }
+  auto *type = llvmTypeOf(cg->typeResults->getInferredType(expr));
+  cg->valueTypes[expr] = type;
+  return type;
+}
+
+/*
+ * Convert a value between the Int64 and pointer representations.  This is
+ * only needed at the polymorphic boundaries, i.e., function parameters and
+ * results, and values whose type is a type variable.
+ */
+llvm::Value *coerce(llvm::Value *val, llvm::Type *type) {
+  if (val->getType() == type) {
+    return val;
+  }
+  if (type->isPointerTy()) {
+    return cg->irBuilder.CreateIntToPtr(val, type);
+  }
+  return cg->irBuilder.CreatePtrToInt(val, type);
+}
+
+/*
+ * Type-based alias analysis metadata.  A heap location is tagged by the type
+ * of the value it holds, with a node for each type below a common root, and
+ * the length headers of all arrays have a node of their own.  The tag does
+ * not depend on the container, since the address of an element or field can
+ * be taken, e.g., "&a[i]" and "&r.f", and the cell it references is then
+ * the same location as the element or field.  Sibling nodes never alias, so
+ * a store of an int does not invalidate a loaded pointer.
+ *
+ * Type inference is monomorphic outside of polymorphic functions, so all of
+ * the accesses to a location have the same value type.  A type that contains
+ * type variables or recursive types does not have a unique name, and
+ * accesses of such values are left untagged, which makes them alias
+ * everything.
+ */
+std::shared_ptr<TipType> inferredType(ASTExpr *expr) {
+  if (cg->typeResults == nullptr) {
+    return nullptr;
+  }
+  if (auto var = dynamic_cast<ASTVariableExpr *>(expr)) {
+    auto decl = cg->namedDecls.find(var->getName());
+    if (decl == cg->namedDecls.end()) {
+      return nullptr;
+    }
+    return cg->typeResults->getInferredType(decl->second);
+  }
+  return cg->typeResults->getInferredType(expr);
+}
+
+bool isGroundType(const std::shared_ptr<TipType> &type) {
+  if (std::dynamic_pointer_cast<TipVar>(type) != nullptr ||
+      std::dynamic_pointer_cast<TipMu>(type) != nullptr) {
+    return false;
+  }
+  if (auto cons = std::dynamic_pointer_cast<TipCons>(type)) {
+    for (auto &arg : cons->getArguments()) {
+      if (!isGroundType(arg)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+llvm::MDNode *tbaaNode(const std::string &name, llvm::MDNode *parent) {
+  llvm::MDBuilder mdBuilder(cg->llvmContext);
+  if (parent == nullptr) {
+    parent = mdBuilder.createTBAARoot("TIP TBAA");
+  }
+  return mdBuilder.createTBAAScalarTypeNode(name, parent);
+}
+
+llvm::MDNode *tbaaTag(llvm::MDNode *node) {
+  return llvm::MDBuilder(cg->llvmContext)
+      .createTBAAStructTagNode(node, node, 0);
+}
+
+// The locations holding values of a type, or nullptr if it has no name.
+llvm::MDNode *valueTag(const std::shared_ptr<TipType> &type) {
+  if (type == nullptr || !isGroundType(type)) {
+    return nullptr;
+  }
+  std::stringstream name;
+  name << *type;
+  return tbaaTag(tbaaNode(name.str(), nullptr));
+}
+
+// The cell referenced by the pointer expression.
+llvm::MDNode *cellTag(ASTExpr *ptr) {
+  auto ref = std::dynamic_pointer_cast<TipRef>(inferredType(ptr));
+  return ref == nullptr ? nullptr : valueTag(ref->getReferencedType());
+}
+
+// An element of the array expression.
+llvm::MDNode *elementTag(ASTExpr *array) {
+  auto type = std::dynamic_pointer_cast<TipArray>(inferredType(array));
+  return type == nullptr ? nullptr : valueTag(type->getFieldType());
+}
+
+// The field of the record expression.
+llvm::MDNode *fieldTag(ASTExpr *record, const std::string &field) {
+  auto type = std::dynamic_pointer_cast<TipRecord>(inferredType(record));
+  if (type == nullptr) {
+    return nullptr;
+  }
+  auto &names = type->getNames();
+  auto position = std::find(names.begin(), names.end(), field);
+  if (position == names.end()) {
+    return nullptr;
+  }
+  return valueTag(type->getInits()[position - names.begin()]);
+}
+
+// The length header of an array.
+llvm::MDNode *lengthTag() {
+  return cg->typeResults == nullptr
+             ? nullptr
+             : tbaaTag(tbaaNode("array length", nullptr));
+}
+
+// The location denoted by an l-value, or nullptr for a variable.
+llvm::MDNode *locationTag(ASTExpr *lValue) {
+  if (auto deref = dynamic_cast<ASTDeRefExpr *>(lValue)) {
+    return cellTag(deref->getPtr());
+  } else if (auto access = dynamic_cast<ASTAccessExpr *>(lValue)) {
+    return fieldTag(access->getRecord(), access->getField());
+  } else if (auto ref = dynamic_cast<ASTArrayRefExpr *>(lValue)) {
+    return elementTag(ref->getArray());
+  }
+  return nullptr;
+}
+
+// Attach the access tag, if any, to a load or store.
+template <typename I> I *tagAccess(I *inst, llvm::MDNode *tag) {
+  if (tag != nullptr) {
+    inst->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+  }
+  return inst;
+}
+
+/*
+ * Arrays are referenced by the address of their first element, which lies on
+ * a cache line boundary so that vectorized loops over the elements need no
+ * peeling and never split a cache line.  The length is stored in the word
+ * before the first element, at the end of a header that fills the preceding
+ * cache line.
+ */
+const unsigned ARRAY_ALIGNMENT = 64;
+const uint64_t ARRAY_HEADER_WORDS = ARRAY_ALIGNMENT / 8;
+
+// Returns the address of the length of an array.
+llvm::Value *arrayLengthPtr(llvm::Value *arrayPtr) {
+  return cg->irBuilder.CreateInBoundsGEP(
+      llvm::Type::getInt64Ty(cg->llvmContext), arrayPtr,
+      cg->irBuilder.getInt64(-1), "lenPtr");
+}
+
+// Returns the address of an element of an array.
+llvm::Value *arrayElementPtr(llvm::Value *arrayPtr, llvm::Value *indexVal) {
+  return cg->irBuilder.CreateInBoundsGEP(
+      llvm::Type::getInt64Ty(cg->llvmContext), arrayPtr, indexVal,
+      "elementPtr");
+}
+
+/*
+ * Allocate an array and store its length.  A non-escaping array has a
+ * constant length and is placed in the stack frame, where its elements are
+ * not zeroed; other arrays come from the runtime's array allocator.
+ */
+llvm::Value *allocateArray(llvm::Value *numElements, bool onStack) {
+  llvm::Value *arrayPtr;
+  if (onStack) {
+    auto length = llvm::cast<llvm::ConstantInt>(numElements)->getZExtValue();
+    auto *frame = CreateEntryBlockAlloca(
+        cg->irBuilder.GetInsertBlock()->getParent(), "stackArray",
+        llvm::ArrayType::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                             ARRAY_HEADER_WORDS + length));
+    frame->setAlignment(llvm::Align(ARRAY_ALIGNMENT));
+    arrayPtr = cg->irBuilder.CreateConstInBoundsGEP1_64(
+        llvm::Type::getInt64Ty(cg->llvmContext), frame, ARRAY_HEADER_WORDS,
+        "arrayPtr");
+  } else {
+    arrayPtr = cg->irBuilder.CreateCall(cg->arrayAllocFun, {numElements},
+                                        "arrayPtr");
+  }
+
+  tagAccess(cg->irBuilder.CreateStore(numElements, arrayLengthPtr(arrayPtr)),
+            lengthTag());
+  return arrayPtr;
+}
+
+/*
+ * A contiguous array of arrays is a single allocation holding the array of
+ * rows followed by the rows themselves.  Each row keeps its own header and is
+ * padded to whole cache lines, so rows are ordinary arrays that start a fixed
+ * number of words apart.
+ */
+llvm::Value *roundToLine(llvm::Value *words) {
+  return cg->irBuilder.CreateAnd(
+      cg->irBuilder.CreateAdd(words,
+                              cg->irBuilder.getInt64(ARRAY_HEADER_WORDS - 1)),
+      cg->irBuilder.getInt64(-(int64_t)ARRAY_HEADER_WORDS), "lineWords");
+}
+
+// Returns the number of words from the start of one row to the next.
+llvm::Value *rowStride(llvm::Value *rowLength) {
+  return cg->irBuilder.CreateAdd(roundToLine(rowLength),
+                                 cg->irBuilder.getInt64(ARRAY_HEADER_WORDS),
+                                 "stride");
+}
+
+// Returns the address of the first row of a contiguous array of arrays.
+llvm::Value *firstRowPtr(llvm::Value *arrayPtr, llvm::Value *numRows) {
+  return cg->irBuilder.CreateInBoundsGEP(
+      llvm::Type::getInt64Ty(cg->llvmContext), arrayPtr,
+      cg->irBuilder.CreateAdd(roundToLine(numRows),
+                              cg->irBuilder.getInt64(ARRAY_HEADER_WORDS)),
+      "firstRow");
+}
+
+// Mark a load that produces an array as producing an aligned pointer.
+llvm::LoadInst *markArrayLoad(llvm::LoadInst *load, ASTExpr *expr) {
+  if (load->getType()->isPointerTy() &&
+      std::dynamic_pointer_cast<TipArray>(inferredType(expr)) != nullptr) {
+    load->setMetadata(
+        llvm::LLVMContext::MD_align,
+        llvm::MDNode::get(cg->llvmContext,
+                          llvm::ConstantAsMetadata::get(
+                              cg->irBuilder.getInt64(ARRAY_ALIGNMENT))));
+  }
+  return load;
+}
+
+// Tell the optimizer that an array passed to a function is aligned.
+llvm::Value *assumeArrayAlignment(llvm::Value *val,
+                                  std::shared_ptr<TipType> type) {
+  if (val->getType()->isPointerTy() &&
+      std::dynamic_pointer_cast<TipArray>(type) != nullptr) {
+    cg->irBuilder.CreateAlignmentAssumption(cg->CurrentModule->getDataLayout(),
+                                            val, ARRAY_ALIGNMENT);
+  }
+  return val;
+}
+
+/*
+ * Check whether escape analysis determined that the allocation performed
+ * by the node can be replaced with a slot in the current stack frame.
+ */
+bool isStackAllocatable(ASTNode *site) {
+  return cg->escapeResults != nullptr &&
+         cg->escapeResults->isStackAllocatable(site);
+}
+
+/*
+ * Declare the runtime error function.  It reports the error code and exits,
+ * so it is marked noreturn and cold, which lets block placement move the
+ * paths that lead to it out of the code that passes its checks.
+ */
+llvm::Function *getErrorIntrinsic() {
+  if (auto *fun = cg->CurrentModule->getFunction("_tip_error")) {
+    return fun;
+  }
+  std::vector<llvm::Type *> oneInt(1, llvm::Type::getInt64Ty(cg->llvmContext));
+  auto *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                     oneInt, false);
+  auto *fun = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
+                                     "_tip_error", cg->CurrentModule.get());
+  fun->addFnAttr(llvm::Attribute::NoReturn);
+  fun->addFnAttr(llvm::Attribute::Cold);
+  fun->addFnAttr(llvm::Attribute::NoUnwind);
+  return fun;
+}
+
+// Branch weights for a runtime check whose true successor is the failure path
+llvm::MDNode *failureWeights() {
+  return llvm::MDBuilder(cg->llvmContext)
+      .createBranchWeights(1, (1U << 20) - 1);
+}
+
+/*
+ * Create the block executed when a runtime check fails.  It reports the value
+ * with _tip_error, or executes a trap instruction when checks are compiled as
+ * traps, and never returns to the code that follows the check.
+ */
+llvm::BasicBlock *createFailureBlock(llvm::Function *TheFunction,
+                                     llvm::Value *errorVal,
+                                     const std::string &name) {
+  llvm::BasicBlock *CheckBB = cg->irBuilder.GetInsertBlock();
+  llvm::BasicBlock *ErrorBB =
+      llvm::BasicBlock::Create(cg->llvmContext, name, TheFunction);
+  cg->irBuilder.SetInsertPoint(ErrorBB);
+
+  if (cg->codeGenOptions.trap) {
+    cg->irBuilder.CreateCall(llvm::Intrinsic::getDeclaration(
+        cg->CurrentModule.get(), llvm::Intrinsic::trap));
+  } else {
+    std::vector<llvm::Value *> ArgsV(1, errorVal);
+    cg->irBuilder.CreateCall(getErrorIntrinsic(), ArgsV);
+  }
+  cg->irBuilder.CreateUnreachable();
+
+  cg->irBuilder.SetInsertPoint(CheckBB);
+  return ErrorBB;
+}
+
+/*
+ * Emit a call to the allocator and record what is known about the memory it
+ * returns.  At least knownBytes are dereferenceable unless calloc returns
+ * null; the garbage collected allocator exits instead of returning null.
+ */
+llvm::CallInst *createAllocCall(llvm::Value *count, llvm::Value *size,
+                                uint64_t knownBytes, const std::string &name) {
+  std::vector<llvm::Value *> callocArgs = {count, size};
+  llvm::CallInst *call =
+      cg->irBuilder.CreateCall(cg->callocFun, callocArgs, name);
+  if (cg->codeGenOptions.gc) {
+    call->addRetAttr(llvm::Attribute::NonNull);
+    call->addRetAttr(llvm::Attribute::getWithDereferenceableBytes(
+        cg->llvmContext, knownBytes));
+  } else {
+    call->addRetAttr(llvm::Attribute::getWithDereferenceableOrNullBytes(
+        cg->llvmContext, knownBytes));
+  }
+  return call;
+}
+
+/*
+ * Emit the header and body of a range loop starting at the given header block.
+ * The element is compared against the upper bound before each iteration and
+ * advanced by the step after it.
+ */
+void emitRangeLoop(llvm::BasicBlock *HeaderBB, llvm::BasicBlock *BodyBB,
+                   llvm::BasicBlock *ExitBB, llvm::Value *elementPtr,
+                   llvm::Value *upperVal, llvm::Value *stepVal, ASTStmt *body) {
+  llvm::Function *TheFunction = HeaderBB->getParent();
+
+  // Emit loop header
+  {
+    cg->irBuilder.SetInsertPoint(HeaderBB);
+
+    llvm::Value *elementVal = cg->irBuilder.CreateLoad(
+        llvm::IntegerType::getInt64Ty(cg->llvmContext), elementPtr);
+    llvm::Value *condV = cg->irBuilder.CreateICmpSLT(elementVal, upperVal);
+
+    cg->irBuilder.CreateCondBr(condV, BodyBB, ExitBB);
+  }
+
+  // Emit loop body
+  {
+    TheFunction->insert(TheFunction->end(), BodyBB);
+    cg->irBuilder.SetInsertPoint(BodyBB);
+
+    cg->loopDepth++;
+    body->codegen();
+    cg->loopDepth--;
+
+    llvm::Value *elementVal = cg->irBuilder.CreateLoad(
+        llvm::IntegerType::getInt64Ty(cg->llvmContext), elementPtr);
+    llvm::Value *incElementVal = cg->irBuilder.CreateAdd(elementVal, stepVal);
+    cg->irBuilder.CreateStore(incElementVal, elementPtr);
+
+    cg->irBuilder.CreateBr(HeaderBB);
+  }
+}
+
+/*
+ * Emit the checks that the index lies within the array, failing with the
+ * index when it does not.  Code generation continues in the block reached
+ * when the checks pass.
+ */
+void emitBoundsCheck(llvm::Value *arrayPtr, llvm::Value *indexVal,
+                     bool checkLower, bool checkUpper) {
+  llvm::Value *len = nullptr;
+  if (checkUpper) {
+    len = tagAccess(
+        cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 arrayLengthPtr(arrayPtr)),
+        lengthTag());
+  }
+
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+
+  cg->labelNum++;
+  llvm::BasicBlock *ErrorBB = createFailureBlock(
+      TheFunction, indexVal, "error" + std::to_string(cg->labelNum));
+  llvm::BasicBlock *ContinueBB = llvm::BasicBlock::Create(
+      cg->llvmContext, "continue" + std::to_string(cg->labelNum));
+
+  if (checkLower) {
+    llvm::BasicBlock *OverflowBB = ContinueBB;
+    if (checkUpper) {
+      OverflowBB = llvm::BasicBlock::Create(
+          cg->llvmContext, "overflow" + std::to_string(cg->labelNum));
+    }
+
+    llvm::Value *underflowCond =
+        cg->irBuilder.CreateICmpSLT(indexVal, cg->zeroV);
+    cg->irBuilder.CreateCondBr(underflowCond, ErrorBB, OverflowBB,
+                               failureWeights());
+
+    if (checkUpper) {
+      TheFunction->insert(TheFunction->end(), OverflowBB);
+      cg->irBuilder.SetInsertPoint(OverflowBB);
+    }
+  }
+
+  if (checkUpper) {
+    llvm::Value *overflowCond = cg->irBuilder.CreateICmpSGE(indexVal, len);
+    cg->irBuilder.CreateCondBr(overflowCond, ErrorBB, ContinueBB,
+                               failureWeights());
+  }
+
+  // Emit continue block.
+  TheFunction->insert(TheFunction->end(), ContinueBB);
+  cg->irBuilder.SetInsertPoint(ContinueBB);
+}
+
+// Emit the bounds checks of an array access that were not proven or hoisted.
+void emitBoundsChecks(ASTArrayRefExpr *ref, llvm::Value *arrayPtr,
+                      llvm::Value *indexVal) {
+  bool checkLower =
+      cg->boundsResults == nullptr || cg->boundsResults->needsLowerCheck(ref);
+  bool checkUpper =
+      (cg->boundsResults == nullptr ||
+       cg->boundsResults->needsUpperCheck(ref)) &&
+      cg->hoistedChecks.count(ref) == 0;
+
+  if (checkLower || checkUpper) {
+    emitBoundsCheck(arrayPtr, indexVal, checkLower, checkUpper);
+  }
+}
+
+/*
+ * Emit a loop that runs the body with each index from zero up to, but not
+ * including, the count.  Code generation continues after the loop.
+ */
+void emitCountedLoop(llvm::Value *count,
+                     const std::function<void(llvm::Value *)> &body) {
+  llvm::BasicBlock *EntryBB = cg->irBuilder.GetInsertBlock();
+  llvm::Function *TheFunction = EntryBB->getParent();
+
+  cg->labelNum++;
+  llvm::BasicBlock *HeaderBB = llvm::BasicBlock::Create(
+      cg->llvmContext, "header" + std::to_string(cg->labelNum), TheFunction);
+  llvm::BasicBlock *BodyBB =
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "body" + std::to_string(cg->labelNum));
+  llvm::BasicBlock *ExitBB =
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "exit" + std::to_string(cg->labelNum));
+
+  cg->irBuilder.CreateBr(HeaderBB);
+  cg->irBuilder.SetInsertPoint(HeaderBB);
+  llvm::PHINode *index =
+      cg->irBuilder.CreatePHI(llvm::Type::getInt64Ty(cg->llvmContext), 2,
+                              "index");
+  index->addIncoming(cg->zeroV, EntryBB);
+  cg->irBuilder.CreateCondBr(cg->irBuilder.CreateICmpSLT(index, count), BodyBB,
+                             ExitBB);
+
+  TheFunction->insert(TheFunction->end(), BodyBB);
+  cg->irBuilder.SetInsertPoint(BodyBB);
+  body(index);
+  index->addIncoming(cg->irBuilder.CreateAdd(index, cg->oneV, "nextIndex"),
+                     cg->irBuilder.GetInsertBlock());
+  cg->irBuilder.CreateBr(HeaderBB);
+
+  TheFunction->insert(TheFunction->end(), ExitBB);
+  cg->irBuilder.SetInsertPoint(ExitBB);
+}
+
+// Check whether the operator compares its operands.
+bool isComparison(const std::string &op) {
+  return op == ">" || op == "==" || op == "!=" || op == ">=" || op == "<" ||
+         op == "<=";
+}
+
+// Returns the i1 result of a comparison operator, or nullptr for other ops.
+llvm::Value *emitComparison(const std::string &op, llvm::Value *L,
+                            llvm::Value *R) {
+  if (op == ">") {
+    return cg->irBuilder.CreateICmpSGT(L, R, "_gttmp");
+  } else if (op == "==") {
+    return cg->irBuilder.CreateICmpEQ(L, R, "_eqtmp");
+  } else if (op == "!=") {
+    return cg->irBuilder.CreateICmpNE(L, R, "_neqtmp");
+  } else if (op == ">=") {
+    return cg->irBuilder.CreateICmpSGE(L, R, "_getmp");
+  } else if (op == "<") {
+    return cg->irBuilder.CreateICmpSLT(L, R, "_lttmp");
+  } else if (op == "<=") {
+    return cg->irBuilder.CreateICmpSLE(L, R, "_letmp");
+  }
+  return nullptr;
+}
+
+// Check whether the expression is a logical "and" or "or".
+bool isShortCircuit(ASTExpr *cond) {
+  auto binary = dynamic_cast<ASTBinaryExpr *>(cond);
+  return binary != nullptr &&
+         (binary->getOp() == "and" || binary->getOp() == "or");
+}
+
+void emitCondBr(ASTExpr *cond, llvm::BasicBlock *TrueBB,
+                llvm::BasicBlock *FalseBB);
+
+/*
+ * Generate a condition as an i1 value.  Comparisons produce their result
+ * directly rather than widening it to an Int64 that is compared against 0,
+ * and "and" and "or" only evaluate their right operand when it determines
+ * the result.
+ */
+llvm::Value *emitCondition(ASTExpr *cond) {
+  if (auto notExpr = dynamic_cast<ASTNotExpr *>(cond)) {
+    return cg->irBuilder.CreateNot(emitCondition(notExpr->getBase()), "nottmp");
+  }
+
+  if (isShortCircuit(cond)) {
+    cg->labelNum++;
+    llvm::BasicBlock *TrueBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "condtrue" + std::to_string(cg->labelNum));
+    llvm::BasicBlock *FalseBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "condfalse" + std::to_string(cg->labelNum));
+    llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "condmerge" + std::to_string(cg->labelNum));
+
+    emitCondBr(cond, TrueBB, FalseBB);
+
+    llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+    TheFunction->insert(TheFunction->end(), TrueBB);
+    cg->irBuilder.SetInsertPoint(TrueBB);
+    cg->irBuilder.CreateBr(MergeBB);
+    TheFunction->insert(TheFunction->end(), FalseBB);
+    cg->irBuilder.SetInsertPoint(FalseBB);
+    cg->irBuilder.CreateBr(MergeBB);
+
+    TheFunction->insert(TheFunction->end(), MergeBB);
+    cg->irBuilder.SetInsertPoint(MergeBB);
+    auto *phi =
+        cg->irBuilder.CreatePHI(cg->irBuilder.getInt1Ty(), 2, "condtmp");
+    phi->addIncoming(cg->irBuilder.getTrue(), TrueBB);
+    phi->addIncoming(cg->irBuilder.getFalse(), FalseBB);
+    return phi;
+  }
+
+  auto binary = dynamic_cast<ASTBinaryExpr *>(cond);
+  if (binary != nullptr && isComparison(binary->getOp())) {
+    llvm::Value *L = binary->getLeft()->codegen();
+    llvm::Value *R = binary->getRight()->codegen();
+    if (L == nullptr || R == nullptr) {
+      throw InternalError("null binary operand");
+    }
+    if (L->getType() != R->getType()) {
+      L = coerce(L, llvm::Type::getInt64Ty(cg->llvmContext));
+      R = coerce(R, llvm::Type::getInt64Ty(cg->llvmContext));
+    }
+    return emitComparison(binary->getOp(), L, R);
+  }
+
+  llvm::Value *CondV = cond->codegen();
+  if (CondV == nullptr) {
+    throw InternalError("failed to generate bitcode for the condition");
+  }
+
+  // Convert condition to a bool by comparing non-equal to 0.
+  return cg->irBuilder.CreateICmpNE(
+      CondV, llvm::ConstantInt::get(CondV->getType(), 0), "ifcond");
+}
+
+/*
+ * Branch on a condition.  The operands of "and", "or" and "not" become
+ * control flow, and the blocks are inserted into the function by the caller.
+ */
+void emitCondBr(ASTExpr *cond, llvm::BasicBlock *TrueBB,
+                llvm::BasicBlock *FalseBB) {
+  if (auto notExpr = dynamic_cast<ASTNotExpr *>(cond)) {
+    emitCondBr(notExpr->getBase(), FalseBB, TrueBB);
+    return;
+  }
+
+  if (isShortCircuit(cond)) {
+    auto binary = dynamic_cast<ASTBinaryExpr *>(cond);
+    cg->labelNum++;
+    llvm::BasicBlock *RightBB =
+        llvm::BasicBlock::Create(cg->llvmContext,
+                                 "rhs" + std::to_string(cg->labelNum));
+    if (binary->getOp() == "and") {
+      emitCondBr(binary->getLeft(), RightBB, FalseBB);
+    } else {
+      emitCondBr(binary->getLeft(), TrueBB, RightBB);
+    }
+
+    llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+    TheFunction->insert(TheFunction->end(), RightBB);
+    cg->irBuilder.SetInsertPoint(RightBB);
+    emitCondBr(binary->getRight(), TrueBB, FalseBB);
+    return;
+  }
+
+  cg->irBuilder.CreateCondBr(emitCondition(cond), TrueBB, FalseBB);
+}
+
+/*
+ * Check whether evaluating an expression has no effect other than producing
+ * its value and cannot fail, so that it can be evaluated once for all of the
+ * elements of an array.
+ */
+bool isPure(ASTExpr *expr) {
+  if (dynamic_cast<ASTNumberExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTBooleanExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTNullExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTVariableExpr *>(expr) != nullptr) {
+    return true;
+  } else if (auto binary = dynamic_cast<ASTBinaryExpr *>(expr)) {
+    return binary->getOp() != "/" && binary->getOp() != "%" &&
+           isPure(binary->getLeft()) && isPure(binary->getRight());
+  } else if (auto notExpr = dynamic_cast<ASTNotExpr *>(expr)) {
+    return isPure(notExpr->getBase());
+  } else if (auto neg = dynamic_cast<ASTNegExpr *>(expr)) {
+    return isPure(neg->getExpr());
+  }
+  return false;
+}
+
+/*
+ * Create a read-only copy of an array literal whose elements are all integer
+ * or boolean constants, including its length slot.  Returns nullptr when an
+ * element is not a constant.
+ */
+llvm::GlobalVariable *
+createArrayTemplate(const std::vector<ASTExpr *> &elements) {
+  std::vector<uint64_t> values;
+  values.push_back(elements.size());
+  for (auto e : elements) {
+    if (auto num = dynamic_cast<ASTNumberExpr *>(e)) {
+      values.push_back(num->getValue());
+    } else if (auto boolean = dynamic_cast<ASTBooleanExpr *>(e)) {
+      values.push_back(boolean->getValue());
+    } else {
+      return nullptr;
+    }
+  }
+
+  auto *init = llvm::ConstantDataArray::get(cg->llvmContext, values);
+  auto *tmpl = new llvm::GlobalVariable(*cg->CurrentModule, init->getType(),
+                                        true, llvm::GlobalValue::PrivateLinkage,
+                                        init, "arrayTemplate");
+  tmpl->setUnnamedAddr(llvm::GlobalValue::UnnamedAddr::Global);
+  tmpl->setAlignment(llvm::Align(8));
+  return tmpl;
+}
+
+/*
+ * Build an array of arrays [n of [m of e]] as a single allocation.  The row
+ * length is evaluated once and only checked when there is a row.  Elements
+ * are evaluated in row-major order, or once when the initializer is pure.
+ */
+llvm::Value *emitContiguousArray(ASTArrayFixedExpr *array,
+                                 llvm::Value *numRows) {
+  auto *row = dynamic_cast<ASTArrayFixedExpr *>(array->getInstance());
+  llvm::Value *rowLength = row->getNumber()->codegen();
+
+  llvm::Value *isNegative =
+      cg->irBuilder.CreateAnd(cg->irBuilder.CreateICmpSGT(numRows, cg->zeroV),
+                              cg->irBuilder.CreateICmpSLT(rowLength,
+                                                          cg->zeroV));
+
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *ErrorBB =
+      createFailureBlock(TheFunction, rowLength, "error");
+  llvm::BasicBlock *ContinueBB =
+      llvm::BasicBlock::Create(cg->llvmContext, "continue");
+
+  cg->irBuilder.CreateCondBr(isNegative, ErrorBB, ContinueBB, failureWeights());
+
+  TheFunction->insert(TheFunction->end(), ContinueBB);
+  cg->irBuilder.SetInsertPoint(ContinueBB);
+
+  llvm::Value *stride = rowStride(rowLength);
+  llvm::Value *numWords =
+      cg->irBuilder.CreateAdd(roundToLine(numRows),
+                              cg->irBuilder.CreateMul(numRows, stride),
+                              "numWords");
+  llvm::Value *arrayPtr =
+      cg->irBuilder.CreateCall(cg->arrayAllocFun, {numWords}, "arrayPtr");
+  tagAccess(cg->irBuilder.CreateStore(numRows, arrayLengthPtr(arrayPtr)),
+            lengthTag());
+  llvm::Value *firstRow = firstRowPtr(arrayPtr, numRows);
+
+  // The allocation is zeroed, so only other pure values need to be stored
+  llvm::Value *fillValue = nullptr;
+  bool fill = true;
+  if (isPure(row->getInstance())) {
+    fillValue = row->getInstance()->codegen();
+    auto *fillConst = llvm::dyn_cast<llvm::Constant>(fillValue);
+    fill = fillConst == nullptr || !fillConst->isNullValue();
+  }
+
+  emitCountedLoop(numRows, [&](llvm::Value *rowIndex) {
+    llvm::Value *rowPtr = cg->irBuilder.CreateInBoundsGEP(
+        llvm::Type::getInt64Ty(cg->llvmContext), firstRow,
+        cg->irBuilder.CreateMul(rowIndex, stride), "rowPtr");
+    tagAccess(cg->irBuilder.CreateStore(rowLength, arrayLengthPtr(rowPtr)),
+              lengthTag());
+    tagAccess(
+        cg->irBuilder.CreateStore(rowPtr, arrayElementPtr(arrayPtr, rowIndex)),
+        elementTag(array));
+    if (!fill) {
+      return;
+    }
+
+    auto *fillInt = llvm::dyn_cast_or_null<llvm::ConstantInt>(fillValue);
+    if (fillInt != nullptr && fillInt->getValue().isSplat(8)) {
+      cg->irBuilder.CreateMemSet(
+          rowPtr,
+          cg->irBuilder.getInt8(fillInt->getValue().trunc(8).getZExtValue()),
+          cg->irBuilder.CreateMul(rowLength, cg->irBuilder.getInt64(8)),
+          llvm::MaybeAlign(ARRAY_ALIGNMENT));
+      return;
+    }
+
+    emitCountedLoop(rowLength, [&](llvm::Value *index) {
+      llvm::Value *elementValue = fillValue;
+      if (elementValue == nullptr) {
+        cg->loopDepth++;
+        elementValue = row->getInstance()->codegen();
+        cg->loopDepth--;
+      }
+      tagAccess(cg->irBuilder.CreateStore(elementValue,
+                                          arrayElementPtr(rowPtr, index)),
+                elementTag(row));
+    });
+  });
+
+  return arrayPtr;
+}
+
+/*
+ * An array of records that is only used through field accesses can hold each
+ * field of the global record in a column of its own, so a loop over one field
+ * reads consecutive words.  The columns are padded to whole cache lines and
+ * the array is referenced by the first element of the first column, with the
+ * length in front of it as usual.
+ */
+bool isColumnar(ASTExpr *array) {
+  return cg->codeGenOptions.soa && cg->escapeResults != nullptr &&
+         cg->escapeResults->isColumnar(array);
+}
+
+// Returns the address of a field of an element of an array of columns.
+llvm::Value *columnElementPtr(llvm::Value *arrayPtr, llvm::Value *numElements,
+                              const std::string &field, llvm::Value *indexVal) {
+  llvm::Value *column = cg->irBuilder.CreateMul(
+      roundToLine(numElements), cg->irBuilder.getInt64(cg->fieldIndex[field]));
+  return cg->irBuilder.CreateInBoundsGEP(
+      llvm::Type::getInt64Ty(cg->llvmContext), arrayPtr,
+      cg->irBuilder.CreateAdd(column, indexVal), field);
+}
+
+// Allocate the zeroed columns of an array of records and store its length.
+llvm::Value *allocateColumns(llvm::Value *numElements) {
+  llvm::Value *numWords =
+      cg->irBuilder.CreateMul(roundToLine(numElements),
+                              cg->irBuilder.getInt64(cg->fieldIndex.size()),
+                              "numWords");
+  llvm::Value *arrayPtr =
+      cg->irBuilder.CreateCall(cg->arrayAllocFun, {numWords}, "arrayPtr");
+  tagAccess(cg->irBuilder.CreateStore(numElements, arrayLengthPtr(arrayPtr)),
+            lengthTag());
+  return arrayPtr;
+}
+
+// Store the fields of a record expression into an element of the columns.
+void storeColumns(ASTRecordExpr *record, llvm::Value *arrayPtr,
+                  llvm::Value *numElements, llvm::Value *indexVal) {
+  for (auto const &field : record->getFields()) {
+    llvm::Value *value = field->codegen();
+    tagAccess(cg->irBuilder.CreateStore(
+                  value, columnElementPtr(arrayPtr, numElements,
+                                          field->getField(), indexVal)),
+              fieldTag(record, field->getField()));
+  }
+}
+
+/*
+ * Build [n of {f: e, ...}] as columns.  Pure field initializers are evaluated
+ * once and zero values are left to the allocator; the others are evaluated for
+ * each element in order.
+ */
+llvm::Value *emitColumnarArray(ASTArrayFixedExpr *array,
+                               llvm::Value *numElements) {
+  auto *record = dynamic_cast<ASTRecordExpr *>(array->getInstance());
+  llvm::Value *arrayPtr = allocateColumns(numElements);
+
+  bool pure = true;
+  for (auto const &field : record->getFields()) {
+    pure = pure && isPure(field->getInitializer());
+  }
+  if (!pure) {
+    emitCountedLoop(numElements, [&](llvm::Value *index) {
+      cg->loopDepth++;
+      storeColumns(record, arrayPtr, numElements, index);
+      cg->loopDepth--;
+    });
+    return arrayPtr;
+  }
+
+  for (auto const &field : record->getFields()) {
+    llvm::Value *value = field->codegen();
+    auto *valueConst = llvm::dyn_cast<llvm::Constant>(value);
+    if (valueConst != nullptr && valueConst->isNullValue()) {
+      continue;
+    }
+    emitCountedLoop(numElements, [&](llvm::Value *index) {
+      tagAccess(cg->irBuilder.CreateStore(
+                    value, columnElementPtr(arrayPtr, numElements,
+                                            field->getField(), index)),
+                fieldTag(record, field->getField()));
+    });
+  }
+  return arrayPtr;
 }
 } // namespace
 
@@ -165,21 +1125,32 @@ llvm::AllocaInst *CreateEntryBlockAlloca(llvm::Function *TheFunction,
 
 std::shared_ptr<llvm::Module>
 ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
-                    const std::string &programName) {
+                    const std::string &programName,
+                    const CodeGenOptions &options,
+                    llvm::LLVMContext &context) {
   LOG_S(1) << "Generating code for program " << programName;
 
-  auto TheModule = std::make_shared<llvm::Module>(programName, llvmContext);
+  // The state of this compilation, current on this thread until it returns
+  CodeGenContext state(context);
+  CurrentContext current(state);
+
+  auto TheModule = std::make_shared<llvm::Module>(programName, cg->llvmContext);
 
   llvm::Triple targetTriple(llvm::sys::getProcessTriple());
   TheModule->setTargetTriple(targetTriple.str());
 
-  nop = llvm::Intrinsic::getDeclaration(TheModule.get(),
-                                        llvm::Intrinsic::donothing);
+  cg->nop = llvm::Intrinsic::getDeclaration(TheModule.get(),
+                                            llvm::Intrinsic::donothing);
+
+  cg->codeGenOptions = options;
+
+  cg->typeResults = semanticAnalysis->getTypeResults();
 
-  labelNum = 0;
+  cg->escapeResults = semanticAnalysis->getEscapeResults();
+  cg->boundsResults = semanticAnalysis->getBoundsResults();
 
   // Transfer the module for access by shared codegen routines
-  CurrentModule = std::move(TheModule);
+  cg->CurrentModule = std::move(TheModule);
 
   /*
    * This shallow pass over the function declarations builds the
@@ -194,7 +1165,7 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
 
     int funIndex = 0;
     for (auto const &fn : ASTProgram::getFunctions()) {
-      functionIndex[fn->getName()] = funIndex++;
+      cg->functionIndex[fn->getName()] = funIndex++;
 
       auto formalNames = fn->getFormals();
       std::vector<std::string> names;
@@ -202,7 +1173,7 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
                      std::back_inserter(names),
                      [](auto &d) { return d->getName(); });
 
-      functionFormalNames[fn->getName()] = names;
+      cg->functionFormalNames[fn->getName()] = names;
     }
 
     /*
@@ -219,7 +1190,7 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
     }
 
     // Holder for function pointer.
-    auto *FunctionOpaquePtrType = llvm::PointerType::get(llvmContext, 0);
+    auto *FunctionOpaquePtrType = llvm::PointerType::get(cg->llvmContext, 0);
     // Create Record Dispatch Table
 
     // Function table is array of pointers, which is the size of funIndex, i.e.
@@ -241,8 +1212,8 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
         llvm::ConstantArray::get(functionTableType, castProgramFunctions);
 
     // Create the global function dispatch table
-    tipFunctionTable = new llvm::GlobalVariable(
-        *CurrentModule, functionTableType, true,
+    cg->tipFunctionTable = new llvm::GlobalVariable(
+        *cg->CurrentModule, functionTableType, true,
         llvm::GlobalValue::InternalLinkage, ftableInit, "_tip_ftable");
   }
 
@@ -259,50 +1230,87 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
      * we never visit it during the codegen() traversals - since
      * the function doesn't exist in the TIP program.
      */
-    auto fidx = functionIndex.find("main");
-    if (fidx == functionIndex.end()) {
+    auto fidx = cg->functionIndex.find("main");
+    if (fidx == cg->functionIndex.end()) {
       auto *M = llvm::Function::Create(
-          llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext), false),
-          llvm::Function::ExternalLinkage, "_tip_main", CurrentModule.get());
-      llvm::BasicBlock *BB = llvm::BasicBlock::Create(llvmContext, "entry", M);
-      irBuilder.SetInsertPoint(BB);
+          llvm::FunctionType::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                  false),
+          llvm::Function::ExternalLinkage, "_tip_main",
+                                       cg->CurrentModule.get());
+      llvm::BasicBlock *BB =
+          llvm::BasicBlock::Create(cg->llvmContext, "entry", M);
+      cg->irBuilder.SetInsertPoint(BB);
 
       auto *undef = llvm::Function::Create(
-          llvm::FunctionType::get(llvm::Type::getVoidTy(llvmContext), false),
+          llvm::FunctionType::get(llvm::Type::getVoidTy(cg->llvmContext),
+                                  false),
           llvm::Function::ExternalLinkage, "_tip_main_undefined",
-          CurrentModule.get());
-      irBuilder.CreateCall(undef);
-      irBuilder.CreateRet(zeroV);
+          cg->CurrentModule.get());
+      cg->irBuilder.CreateCall(undef);
+      cg->irBuilder.CreateRet(cg->zeroV);
     }
 
     // create global _tip_num_inputs with init of numTIPArgs
-    tipNumInputs = new llvm::GlobalVariable(
-        *CurrentModule, llvm::Type::getInt64Ty(llvmContext), true,
+    cg->tipNumInputs = new llvm::GlobalVariable(
+        *cg->CurrentModule, llvm::Type::getInt64Ty(cg->llvmContext), true,
         llvm::GlobalValue::ExternalLinkage,
-        llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), numTIPArgs),
+        llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                               cg->numTIPArgs),
         "_tip_num_inputs");
 
     // create global _tip_input_array with up to numTIPArgs of Int64
     auto *inputArrayType =
-        llvm::ArrayType::get(llvm::Type::getInt64Ty(llvmContext), numTIPArgs);
-    std::vector<llvm::Constant *> zeros(numTIPArgs, zeroV);
-    tipInputArray = new llvm::GlobalVariable(
-        *CurrentModule, inputArrayType, false, llvm::GlobalValue::CommonLinkage,
+        llvm::ArrayType::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                             cg->numTIPArgs);
+    std::vector<llvm::Constant *> zeros(cg->numTIPArgs, cg->zeroV);
+    cg->tipInputArray = new llvm::GlobalVariable(
+        *cg->CurrentModule, inputArrayType, false,
+        llvm::GlobalValue::CommonLinkage,
         llvm::ConstantArray::get(inputArrayType, zeros), "_tip_input_array");
   }
 
   // declare the calloc function
   // the calloc function takes in two ints: the number of items and the size of
-  // the items
-  std::vector<llvm::Type *> twoInt(2, llvm::Type::getInt64Ty(llvmContext));
-  auto *FT = llvm::FunctionType::get(llvm::PointerType::get(llvmContext, 0),
+  // the items.  The garbage collected allocator of the runtime has the same
+  // signature and also returns zeroed memory.
+  std::vector<llvm::Type *> twoInt(2, llvm::Type::getInt64Ty(cg->llvmContext));
+  auto *FT = llvm::FunctionType::get(llvm::PointerType::get(cg->llvmContext, 0),
                                      twoInt, false);
-  callocFun = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                     "calloc", CurrentModule.get());
-  callocFun->addFnAttr(llvm::Attribute::NoUnwind);
-
-  callocFun->setAttributes(callocFun->getAttributes().addAttributeAtIndex(
-      callocFun->getContext(), 0, llvm::Attribute::NoAlias));
+  cg->callocFun = llvm::Function::Create(
+      FT, llvm::Function::ExternalLinkage,
+      options.gc ? "_tip_gc_alloc" : "calloc", cg->CurrentModule.get());
+
+  // The array allocator returns zeroed, cache line aligned elements
+  std::vector<llvm::Type *> oneInt(1, llvm::Type::getInt64Ty(cg->llvmContext));
+  cg->arrayAllocFun = llvm::Function::Create(
+      llvm::FunctionType::get(llvm::PointerType::get(cg->llvmContext, 0),
+                              oneInt, false),
+      llvm::Function::ExternalLinkage,
+      options.gc ? "_tip_gc_alloc_array" : "_tip_alloc_array",
+      cg->CurrentModule.get());
+  cg->arrayAllocFun->addFnAttr(llvm::Attribute::NoUnwind);
+  cg->arrayAllocFun->addRetAttr(llvm::Attribute::NoAlias);
+  cg->arrayAllocFun->addRetAttr(llvm::Attribute::getWithAlignment(
+      cg->llvmContext, llvm::Align(ARRAY_ALIGNMENT)));
+  cg->callocFun->addFnAttr(llvm::Attribute::NoUnwind);
+
+  cg->callocFun->setAttributes(
+      cg->callocFun->getAttributes().addAttributeAtIndex(
+          cg->callocFun->getContext(), 0, llvm::Attribute::NoAlias));
+
+  // The size of the result is the product of the arguments, the memory is
+  // zeroed, and both allocators return 8 byte aligned memory
+  cg->callocFun->addFnAttr(
+      llvm::Attribute::getWithAllocSizeArgs(cg->llvmContext, 1, 0));
+  cg->callocFun->addFnAttr(llvm::Attribute::get(
+      cg->llvmContext, llvm::Attribute::AllocKind,
+      static_cast<uint64_t>(llvm::AllocFnKind::Alloc |
+                            llvm::AllocFnKind::Zeroed)));
+  if (!options.gc) {
+    cg->callocFun->addFnAttr("alloc-family", "malloc");
+  }
+  cg->callocFun->addRetAttr(
+      llvm::Attribute::getWithAlignment(cg->llvmContext, llvm::Align(8)));
 
   /* We create a single unified record structure that is capable of representing
    * all records in a TIP program.  While wasteful of memory, this approach is
@@ -313,21 +1321,20 @@ ASTProgram::codegen(SemanticAnalysis *semanticAnalysis,
   std::vector<llvm::Type *> member_values;
   int index = 0;
   for (const auto &field : semanticAnalysis->getSymbolTable()->getFields()) {
-    member_values.push_back(llvm::IntegerType::getInt64Ty((llvmContext)));
-    fieldVector.push_back(field);
-    fieldIndex[field] = index;
+    member_values.push_back(llvm::IntegerType::getInt64Ty((cg->llvmContext)));
+    cg->fieldIndex[field] = index;
     index++;
   }
-  globalRecordType =
-      llvm::StructType::create(llvmContext, member_values, "globalRecord");
-  pointerToGlobalRecordType = llvm::PointerType::get(llvmContext, 0);
+  cg->globalRecordType =
+      llvm::StructType::create(cg->llvmContext, member_values, "globalRecord");
+  cg->pointerToGlobalRecordType = llvm::PointerType::get(cg->llvmContext, 0);
 
   // Code is generated into the module by the other routines
   for (auto const &fn : getFunctions()) {
     fn->codegen();
   }
 
-  TheModule = std::move(CurrentModule);
+  TheModule = std::move(cg->CurrentModule);
 
   verifyModule(*TheModule);
 
@@ -345,11 +1352,13 @@ llvm::Value *ASTFunction::codegen() {
 
   // create basic block to hold body of function definition
   llvm::BasicBlock *BB =
-      llvm::BasicBlock::Create(llvmContext, "entry", TheFunction);
-  irBuilder.SetInsertPoint(BB);
+      llvm::BasicBlock::Create(cg->llvmContext, "entry", TheFunction);
+  cg->irBuilder.SetInsertPoint(BB);
 
   // keep scope separate from prior definitions
-  namedValues.clear();
+  cg->namedValues.clear();
+  cg->namedDecls.clear();
+  cg->loopDepth = 0;
 
   /*
    * Add arguments to the symbol table
@@ -360,37 +1369,47 @@ llvm::Value *ASTFunction::codegen() {
     int argIdx = 0;
     // Note that the args are not in the LLVM function decl, so we use the AST
     // formals
-    for (auto &argName : functionFormalNames[getName()]) {
+    for (auto &argName : cg->functionFormalNames[getName()]) {
       // Create an alloca for this argument and store its value
       llvm::AllocaInst *argAlloc = CreateEntryBlockAlloca(TheFunction, argName);
 
       // Emit the GEP instruction to index into input array
       std::vector<llvm::Value *> indices;
-      indices.push_back(zeroV);
+      indices.push_back(cg->zeroV);
       indices.push_back(
-          llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), argIdx));
-      auto *gep = irBuilder.CreateInBoundsGEP(
-          tipInputArray->getValueType(), tipInputArray, indices, "inputidx");
+          llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 argIdx));
+      auto *gep = cg->irBuilder.CreateInBoundsGEP(
+          cg->tipInputArray->getValueType(), cg->tipInputArray, indices,
+                                                  "inputidx");
 
       // Load the value and store it into the arg's alloca
       auto *inVal =
-          irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), gep,
-                               "tipinput" + std::to_string(argIdx++));
+          cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext), gep,
+                                   "tipinput" + std::to_string(argIdx++));
 
-      irBuilder.CreateStore(inVal, argAlloc);
+      cg->irBuilder.CreateStore(inVal, argAlloc);
 
       // Record name binding to alloca
-      namedValues[argName] = argAlloc;
+      cg->namedValues[argName] = argAlloc;
     }
   } else {
+    auto formals = getFormals();
     for (auto &arg : TheFunction->args()) {
       // Create an alloca for this argument and store its value
       llvm::AllocaInst *argAlloc =
-          CreateEntryBlockAlloca(TheFunction, arg.getName().str());
-      irBuilder.CreateStore(&arg, argAlloc);
+          CreateEntryBlockAlloca(TheFunction, arg.getName().str(),
+                                 declType(formals[arg.getArgNo()]));
+      llvm::Value *argVal = coerce(&arg, argAlloc->getAllocatedType());
+      if (cg->typeResults != nullptr) {
+        assumeArrayAlignment(
+            argVal, cg->typeResults->getInferredType(formals[arg.getArgNo()]));
+      }
+      cg->irBuilder.CreateStore(argVal, argAlloc);
 
       // Record name binding to alloca
-      namedValues[arg.getName().str()] = argAlloc;
+      cg->namedValues[arg.getName().str()] = argAlloc;
+      cg->namedDecls[arg.getName().str()] = formals[arg.getArgNo()];
     }
   }
 
@@ -420,61 +1439,45 @@ llvm::Value *ASTFunction::codegen() {
 llvm::Value *ASTNumberExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext),
+  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
                                 getValue());
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTBinaryExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
+  // Logical operators short-circuit, so their operands are branched on
+  if (getOp() == "and" || getOp() == "or") {
+    return cg->irBuilder.CreateZExt(
+        emitCondition(this), llvm::IntegerType::getInt64Ty(cg->llvmContext),
+        getOp() + "tmp");
+  }
+
   llvm::Value *L = getLeft()->codegen();
   llvm::Value *R = getRight()->codegen();
   if (L == nullptr || R == nullptr) {
     throw InternalError("null binary operand");
   }
 
+  // Only equality applies to pointers; mixed operands are compared as Int64
+  if (L->getType() != R->getType()) {
+    L = coerce(L, llvm::Type::getInt64Ty(cg->llvmContext));
+    R = coerce(R, llvm::Type::getInt64Ty(cg->llvmContext));
+  }
+
   if (getOp() == "+") {
-    return irBuilder.CreateAdd(L, R, "addtmp");
+    return cg->irBuilder.CreateAdd(L, R, "addtmp");
   } else if (getOp() == "-") {
-    return irBuilder.CreateSub(L, R, "subtmp");
+    return cg->irBuilder.CreateSub(L, R, "subtmp");
   } else if (getOp() == "*") {
-    return irBuilder.CreateMul(L, R, "multmp");
+    return cg->irBuilder.CreateMul(L, R, "multmp");
   } else if (getOp() == "/") {
-    return irBuilder.CreateSDiv(L, R, "divtmp");
-  } else if (getOp() == ">") {
-    auto *cmp = irBuilder.CreateICmpSGT(L, R, "_gttmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "gttmp");
-  } else if (getOp() == "==") {
-    auto *cmp = irBuilder.CreateICmpEQ(L, R, "_eqtmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "eqtmp");
-  } else if (getOp() == "!=") {
-    auto *cmp = irBuilder.CreateICmpNE(L, R, "_neqtmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "neqtmp");
+    return cg->irBuilder.CreateSDiv(L, R, "divtmp");
   } else if (getOp() == "%") {
-    return irBuilder.CreateSRem(L, R, "modtmp");
-  } else if (getOp() == ">=") {
-    auto *cmp = irBuilder.CreateICmpSGE(L, R, "_getmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "getmp"); 
-  } else if (getOp() == "<") {
-    auto *cmp = irBuilder.CreateICmpSLT(L, R, "_lttmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "lttmp"); 
-  } else if (getOp() == "<=") {
-    auto *cmp = irBuilder.CreateICmpSLE(L, R, "_letmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "letmp"); 
-  } else if (getOp() == "and") {
-    auto *cmp = irBuilder.CreateAnd(L, R, "_andtmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "andtmp");
-  } else if (getOp() == "or") {
-    auto *cmp = irBuilder.CreateOr(L, R, "_ortmp");
-    return irBuilder.CreateIntCast(
-        cmp, llvm::IntegerType::getInt64Ty(llvmContext), false, "ortmp");
+    return cg->irBuilder.CreateSRem(L, R, "modtmp");
+  } else if (auto *cmp = emitComparison(getOp(), L, R)) {
+    return cg->irBuilder.CreateZExt(
+        cmp, llvm::IntegerType::getInt64Ty(cg->llvmContext), "cmptmp");
   } else {
     throw InternalError("Invalid binary operator: " + OP);
   }
@@ -490,35 +1493,39 @@ llvm::Value *ASTBinaryExpr::codegen() {
 llvm::Value *ASTVariableExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  auto nv = namedValues.find(getName());
-  if (nv != namedValues.end()) {
-    if (lValueGen) {
-      return namedValues[nv->first];
+  auto nv = cg->namedValues.find(getName());
+  if (nv != cg->namedValues.end()) {
+    if (cg->lValueGen) {
+      return cg->namedValues[nv->first];
     } else {
-      return irBuilder.CreateLoad(nv->second->getAllocatedType(), nv->second,
-                                  getName().c_str());
+      return markArrayLoad(
+          cg->irBuilder.CreateLoad(nv->second->getAllocatedType(), nv->second,
+                                   getName().c_str()),
+          this);
     }
   }
 
-  auto fidx = functionIndex.find(getName());
-  if (fidx == functionIndex.end()) {
+  auto fidx = cg->functionIndex.find(getName());
+  if (fidx == cg->functionIndex.end()) {
     throw InternalError("Unknown variable name: " + getName());
   }
 
-  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext),
+  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
                                 fidx->second);
 }
 
 llvm::Value *ASTInputExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  if (inputIntrinsic == nullptr) {
+  if (cg->inputIntrinsic == nullptr) {
     auto *FT =
-        llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext), false);
-    inputIntrinsic = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                            "_tip_input", CurrentModule.get());
+        llvm::FunctionType::get(llvm::Type::getInt64Ty(cg->llvmContext), false);
+    cg->inputIntrinsic = llvm::Function::Create(FT,
+                                                llvm::Function::ExternalLinkage,
+                                                "_tip_input",
+                                                cg->CurrentModule.get());
   }
-  return irBuilder.CreateCall(inputIntrinsic);
+  return cg->irBuilder.CreateCall(cg->inputIntrinsic);
 } // LCOV_EXCL_LINE
 
 /*
@@ -548,24 +1555,25 @@ llvm::Value *ASTFunAppExpr::codegen() {
    * pointer to be called.
    */
   std::vector<llvm::Value *> indices;
-  indices.push_back(zeroV);
+  indices.push_back(cg->zeroV);
   indices.push_back(funVal);
 
-  auto *gep = irBuilder.CreateInBoundsGEP(
-      tipFunctionTable->getValueType(), tipFunctionTable, indices, "ftableidx");
+  auto *gep = cg->irBuilder.CreateInBoundsGEP(
+      cg->tipFunctionTable->getValueType(), cg->tipFunctionTable, indices,
+                                              "ftableidx");
 
   // Load the function pointer
-  auto *functionPointer = irBuilder.CreateLoad(
-      llvm::PointerType::get(llvmContext, 0), gep, "genfptr");
+  auto *functionPointer = cg->irBuilder.CreateLoad(
+      llvm::PointerType::get(cg->llvmContext, 0), gep, "genfptr");
 
   /*
    * All functions are pointer types and return INT64.
    *
    */
-  std::vector<llvm::Type *> actualTypes(getActuals().size(),
-                                        llvm::Type::getInt64Ty(llvmContext));
-  auto *funType = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext),
-                                          actualTypes, false);
+  std::vector<llvm::Type *> actualTypes(
+      getActuals().size(), llvm::Type::getInt64Ty(cg->llvmContext));
+  auto *funType = llvm::FunctionType::get(
+      llvm::Type::getInt64Ty(cg->llvmContext), actualTypes, false);
 
   // Compute the actual parameters
   std::vector<llvm::Value *> argsV;
@@ -575,10 +1583,12 @@ llvm::Value *ASTFunAppExpr::codegen() {
       throw InternalError(                                // LCOV_EXCL_LINE
           "failed to generate bitcode for the argument"); // LCOV_EXCL_LINE
     }
-    argsV.push_back(argVal);
+    argsV.push_back(coerce(argVal, llvm::Type::getInt64Ty(cg->llvmContext)));
   }
 
-  return irBuilder.CreateCall(funType, functionPointer, argsV, "calltmp");
+  auto *call = cg->irBuilder.CreateCall(funType, functionPointer, argsV,
+                                        "calltmp");
+  return coerce(call, valueType(this));
 }
 
 /* 'alloc' Allocate expression
@@ -587,34 +1597,36 @@ llvm::Value *ASTFunAppExpr::codegen() {
 llvm::Value *ASTAllocExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  allocFlag = true;
+  cg->allocFlag = true;
   llvm::Value *argVal = getInitializer()->codegen();
-  allocFlag = false;
+  cg->allocFlag = false;
   if (argVal == nullptr) {
     throw InternalError("failed to generate bitcode for the initializer of the "
                         "alloc expression");
   }
 
-  // Allocate an int pointer with calloc
-  std::vector<llvm::Value *> twoArg;
-  twoArg.push_back(
-      llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 1));
-  twoArg.push_back(
-      llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 8));
-  auto *allocInst = irBuilder.CreateCall(callocFun, twoArg, "allocPtr");
+  llvm::Value *allocInst;
+  if (isStackAllocatable(this)) {
+    // The cell does not escape, so it lives in the stack frame
+    allocInst = CreateEntryBlockAlloca(
+        cg->irBuilder.GetInsertBlock()->getParent(), "allocPtr");
+  } else {
+    // Allocate an int pointer with calloc
+    allocInst = createAllocCall(
+        llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 1),
+        llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 8), 8,
+        "allocPtr");
+  }
 
   // Initialize with argument
-  irBuilder.CreateStore(argVal, allocInst);
+  tagAccess(cg->irBuilder.CreateStore(argVal, allocInst), cellTag(this));
 
-  return irBuilder.CreatePtrToInt(
-      allocInst, llvm::Type::getInt64Ty(llvmContext), "allocIntVal");
+  return allocInst;
 }
 
 llvm::Value *ASTNullExpr::codegen() {
-  auto *nullPtr =
-      llvm::ConstantPointerNull::get(llvm::PointerType::get(llvmContext, 0));
-  return irBuilder.CreatePtrToInt(nullPtr, llvm::Type::getInt64Ty(llvmContext),
-                                  "nullPtrIntVal");
+  return llvm::ConstantPointerNull::get(
+      llvm::PointerType::get(cg->llvmContext, 0));
 }
 
 /* '&' address of expression
@@ -626,33 +1638,31 @@ llvm::Value *ASTNullExpr::codegen() {
 llvm::Value *ASTRefExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *lValue = getVar()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   if (lValue == nullptr) {
     throw InternalError("could not generate l-value for address of");
   }
 
-  return irBuilder.CreatePtrToInt(lValue, llvm::Type::getInt64Ty(llvmContext),
-                                  "addrOfPtr");
+  return lValue;
 } // LCOV_EXCL_LINE
 
 /* '*' dereference expression
  *
- * The argument is assumed to be a reference expression, but
- * our code generation strategy stores everything as an integer.
- * Consequently, we convert the value with "inttoptr" before loading
- * the value at the pointed-to memory location.
+ * The argument is a reference expression.  It is a pointer unless its
+ * type is polymorphic, in which case we convert the value with "inttoptr"
+ * before loading the value at the pointed-to memory location.
  */
 llvm::Value *ASTDeRefExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  bool isLValue = lValueGen;
+  bool isLValue = cg->lValueGen;
 
   if (isLValue) {
     // This flag is reset here so that sub-expressions are treated as r-values
-    lValueGen = false;
+    cg->lValueGen = false;
   }
 
   llvm::Value *argVal = getPtr()->codegen();
@@ -661,16 +1671,19 @@ llvm::Value *ASTDeRefExpr::codegen() {
   }
 
   // compute the address
-  llvm::Value *address = irBuilder.CreateIntToPtr(
-      argVal, llvm::PointerType::get(llvmContext, 0), "ptrIntVal");
+  llvm::Value *address =
+      coerce(argVal, llvm::PointerType::get(cg->llvmContext, 0));
 
   if (isLValue) {
     // For an l-value, return the address
     return address;
   } else {
     // For an r-value, return the value at the address
-    return irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), address,
-                                "valueAt");
+    return tagAccess(
+        markArrayLoad(cg->irBuilder.CreateLoad(valueType(this), address,
+                                               "valueAt"),
+                      this),
+        cellTag(getPtr()));
   }
 }
 
@@ -682,61 +1695,78 @@ llvm::Value *ASTRecordExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   // If this is an alloc, we calloc the record
-  if (allocFlag) {
-    // Allocate a pointer to an global record
-    auto *allocaRecord = irBuilder.CreateAlloca(pointerToGlobalRecordType);
-
-    // Use irBuilder to create the calloc call using pre-defined callocFun
-    auto sizeOfGlobalRecord = CurrentModule->getDataLayout()
-                                  .getStructLayout(globalRecordType)
-                                  ->getSizeInBytes();
-    std::vector<llvm::Value *> callocArgs;
-    callocArgs.push_back(oneV);
-    callocArgs.push_back(llvm::ConstantInt::get(
-        llvm::Type::getInt64Ty(llvmContext), sizeOfGlobalRecord));
-    auto *calloc = irBuilder.CreateCall(callocFun, callocArgs, "callocedPtr");
-
-    // Bitcast the calloc call to theStruct Type
-    auto recordPtr = calloc;
-
-    // Store the ptr to the record in the record alloc
-    irBuilder.CreateStore(recordPtr, allocaRecord);
-
-    // Load allocaRecord
-    auto loadInst =
-        irBuilder.CreateLoad(pointerToGlobalRecordType, allocaRecord);
+  if (cg->allocFlag) {
+    llvm::Value *recordPtr;
+    if (isStackAllocatable(this)) {
+      // The record does not escape, so it lives in the stack frame.  It is
+      // cleared on every execution to match the semantics of calloc.
+      recordPtr = CreateEntryBlockAlloca(
+          cg->irBuilder.GetInsertBlock()->getParent(), "stackRecord",
+          cg->globalRecordType);
+      cg->irBuilder.CreateStore(
+          llvm::ConstantAggregateZero::get(cg->globalRecordType), recordPtr);
+    } else {
+      // Use irBuilder to create the calloc call using pre-defined callocFun
+      auto sizeOfGlobalRecord = cg->CurrentModule->getDataLayout()
+                                    .getStructLayout(cg->globalRecordType)
+                                    ->getSizeInBytes();
+      recordPtr = createAllocCall(
+          cg->oneV,
+          llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 sizeOfGlobalRecord),
+          sizeOfGlobalRecord, "callocedPtr");
+    }
 
     // For each field, generate GEP for location of field in the globalRecord
     // Generate the code for the field and store it in the GEP
     for (auto const &field : getFields()) {
-      auto *gep = irBuilder.CreateStructGEP(globalRecordType, loadInst,
-                                            fieldIndex[field->getField()],
-                                            field->getField());
+      auto *gep = cg->irBuilder.CreateStructGEP(
+          cg->globalRecordType, recordPtr, cg->fieldIndex[field->getField()],
+          field->getField());
       auto value = field->codegen();
-      irBuilder.CreateStore(value, gep);
+      tagAccess(cg->irBuilder.CreateStore(value, gep),
+                fieldTag(this, field->getField()));
     }
 
-    // Return int64 pointer to the pointer to the record
-    return irBuilder.CreatePtrToInt(
-        recordPtr, llvm::Type::getInt64Ty(llvmContext), "recordPtr");
+    // Return the pointer to the record
+    return recordPtr;
   } else {
-    // Allocate the space for a global record
-    auto *allocaRecord = irBuilder.CreateAlloca(globalRecordType);
+    /*
+     * A record built outside of a loop is built once per call, and a record
+     * that does not escape is only referenced by the variable it is assigned
+     * to, so both can use a single slot in the stack frame.  Other records
+     * need fresh storage on every execution, which is taken from the heap
+     * rather than growing the frame on every iteration.
+     */
+    llvm::Value *recordPtr;
+    if (cg->loopDepth == 0 || isStackAllocatable(this)) {
+      recordPtr = CreateEntryBlockAlloca(
+          cg->irBuilder.GetInsertBlock()->getParent(), "record",
+                                         cg->globalRecordType);
+    } else {
+      auto sizeOfGlobalRecord = cg->CurrentModule->getDataLayout()
+                                    .getStructLayout(cg->globalRecordType)
+                                    ->getSizeInBytes();
+      recordPtr = createAllocCall(
+          cg->oneV,
+          llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 sizeOfGlobalRecord),
+          sizeOfGlobalRecord, "record");
+    }
 
     // Codegen the fields present in this record and store them in the
     // appropriate location We do not give a value to fields that are not
     // explictly set. Thus, accessing them is undefined behavior
     for (auto const &field : getFields()) {
-      auto *gep = irBuilder.CreateStructGEP(
-          allocaRecord->getAllocatedType(), allocaRecord,
-          fieldIndex[field->getField()], field->getField());
+      auto *gep = cg->irBuilder.CreateStructGEP(
+          cg->globalRecordType, recordPtr, cg->fieldIndex[field->getField()],
+          field->getField());
       auto value = field->codegen();
-      irBuilder.CreateStore(value, gep);
+      tagAccess(cg->irBuilder.CreateStore(value, gep),
+                fieldTag(this, field->getField()));
     }
-    // Return int64 pointer to the record since all variables are pointers to
-    // ints
-    return irBuilder.CreatePtrToInt(
-        allocaRecord, llvm::Type::getInt64Ty(llvmContext), "record");
+    // Return the pointer to the record
+    return recordPtr;
   }
 }
 
@@ -758,30 +1788,55 @@ llvm::Value *ASTFieldExpr::codegen() {
 llvm::Value *ASTAccessExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  bool isLValue = lValueGen;
+  bool isLValue = cg->lValueGen;
 
   if (isLValue) {
     // This flag is reset here so that sub-expressions are treated as r-values
-    lValueGen = false;
+    cg->lValueGen = false;
   }
 
   // Get current field and check if it exists
   auto currField = this->getField();
-  if (fieldIndex.count(currField) == 0) {
+  if (cg->fieldIndex.count(currField) == 0) {
     throw InternalError("This field doesn't exist");
   }
 
+  // The field of an element of an array of columns is read from its column
+  if (cg->codeGenOptions.soa && cg->escapeResults != nullptr &&
+      cg->escapeResults->isColumnAccess(this)) {
+    auto *element = dynamic_cast<ASTArrayRefExpr *>(getRecord());
+    llvm::Value *arrayPtr = coerce(element->getArray()->codegen(),
+                                   llvm::Type::getInt64PtrTy(cg->llvmContext));
+    llvm::Value *indexVal = element->getIndex()->codegen();
+    emitBoundsChecks(element, arrayPtr, indexVal);
+
+    llvm::Value *numElements = tagAccess(
+        cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 arrayLengthPtr(arrayPtr), "numElements"),
+        lengthTag());
+    llvm::Value *fieldPtr =
+        columnElementPtr(arrayPtr, numElements, currField, indexVal);
+    if (isLValue) {
+      return fieldPtr;
+    }
+    return tagAccess(
+        markArrayLoad(
+            cg->irBuilder.CreateLoad(valueType(this), fieldPtr, "fieldAccess"),
+            this),
+        fieldTag(getRecord(), currField));
+  }
+
   // Generate record instruction address
   llvm::Value *recordVal = this->getRecord()->codegen();
-  llvm::Value *recordAddress =
-      irBuilder.CreateIntToPtr(recordVal, pointerToGlobalRecordType);
+  llvm::Value *recordAddress = coerce(recordVal, cg->pointerToGlobalRecordType);
 
   // Generate the field index
-  auto index = fieldIndex[currField];
+  auto index = cg->fieldIndex[currField];
 
   // Generate the location of the field
-  auto *gep = irBuilder.CreateStructGEP(globalRecordType, recordAddress, index,
-                                        currField);
+  auto *gep = cg->irBuilder.CreateStructGEP(cg->globalRecordType, recordAddress,
+                                            index,
+                                            currField);
 
   // If LHS, return location of field
   if (isLValue) {
@@ -789,10 +1844,11 @@ llvm::Value *ASTAccessExpr::codegen() {
   }
 
   // Load value at GEP and return it
-  auto fieldLoad =
-      irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), gep);
-  return irBuilder.CreatePtrToInt(
-      fieldLoad, llvm::Type::getInt64Ty(llvmContext), "fieldAccess");
+  return tagAccess(
+      markArrayLoad(cg->irBuilder.CreateLoad(valueType(this), gep,
+                                             "fieldAccess"),
+                    this),
+      fieldTag(getRecord(), currField));
 }
 
 llvm::Value *ASTDeclNode::codegen() {
@@ -803,19 +1859,23 @@ llvm::Value *ASTDeclStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   // The LLVM builder records the function we are currently generating
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
   llvm::AllocaInst *localAlloca = nullptr;
 
   // Register all variables and emit their initializer.
   for (auto l : getVars()) {
-    localAlloca = CreateEntryBlockAlloca(TheFunction, l->getName());
+    localAlloca = CreateEntryBlockAlloca(TheFunction, l->getName(),
+                                         declType(l));
 
     // Initialize all locals to "0"
-    irBuilder.CreateStore(zeroV, localAlloca);
+    cg->irBuilder.CreateStore(
+        llvm::Constant::getNullValue(localAlloca->getAllocatedType()),
+        localAlloca);
 
     // Remember this binding.
-    namedValues[l->getName()] = localAlloca;
+    cg->namedValues[l->getName()] = localAlloca;
+    cg->namedDecls[l->getName()] = l;
   }
 
   // Return the body computation.
@@ -826,9 +1886,9 @@ llvm::Value *ASTAssignStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   // trigger code generation for l-value expressions
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *lValue = getLHS()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   if (lValue == nullptr) {
     throw InternalError(
@@ -841,7 +1901,9 @@ llvm::Value *ASTAssignStmt::codegen() {
         "failed to generate bitcode for the rhs of the assignment");
   }
 
-  return irBuilder.CreateStore(rValue, lValue);
+  return tagAccess(
+      cg->irBuilder.CreateStore(coerce(rValue, valueType(getLHS())), lValue),
+      locationTag(getLHS()));
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTBlockStmt::codegen() {
@@ -854,7 +1916,7 @@ llvm::Value *ASTBlockStmt::codegen() {
   }
 
   // If the block was empty return a nop
-  return (lastStmt == nullptr) ? irBuilder.CreateCall(nop) : lastStmt;
+  return (lastStmt == nullptr) ? cg->irBuilder.CreateCall(cg->nop) : lastStmt;
 } // LCOV_EXCL_LINE
 
 /*
@@ -877,7 +1939,7 @@ llvm::Value *ASTBlockStmt::codegen() {
 llvm::Value *ASTWhileStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
   /*
    * Create blocks for the loop header, body, and exit; HeaderBB is first
@@ -887,39 +1949,32 @@ llvm::Value *ASTWhileStmt::codegen() {
    * any particular way because we will explicitly branch between them.
    * This can be optimized by later passes.
    */
-  labelNum++; // create shared labels for these BBs
+  cg->labelNum++; // create shared labels for these BBs
 
   llvm::BasicBlock *HeaderBB = llvm::BasicBlock::Create(
-      llvmContext, "header" + std::to_string(labelNum), TheFunction);
+      cg->llvmContext, "header" + std::to_string(cg->labelNum), TheFunction);
   llvm::BasicBlock *BodyBB =
-      llvm::BasicBlock::Create(llvmContext, "body" + std::to_string(labelNum));
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "body" + std::to_string(cg->labelNum));
   llvm::BasicBlock *ExitBB =
-      llvm::BasicBlock::Create(llvmContext, "exit" + std::to_string(labelNum));
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "exit" + std::to_string(cg->labelNum));
 
   // Add an explicit branch from the current BB to the header
-  irBuilder.CreateBr(HeaderBB);
+  cg->irBuilder.CreateBr(HeaderBB);
+  cg->loopDepth++;
 
   // Emit loop header
   {
-    irBuilder.SetInsertPoint(HeaderBB);
-
-    llvm::Value *CondV = getCondition()->codegen();
-    if (CondV == nullptr) {
-      throw InternalError(                                   // LCOV_EXCL_LINE
-          "failed to generate bitcode for the conditional"); // LCOV_EXCL_LINE
-    }
-
-    // Convert condition to a bool by comparing non-equal to 0.
-    CondV = irBuilder.CreateICmpNE(
-        CondV, llvm::ConstantInt::get(CondV->getType(), 0), "loopcond");
+    cg->irBuilder.SetInsertPoint(HeaderBB);
 
-    irBuilder.CreateCondBr(CondV, BodyBB, ExitBB);
+    emitCondBr(getCondition(), BodyBB, ExitBB);
   }
 
   // Emit loop body
   {
     TheFunction->insert(TheFunction->end(), BodyBB);
-    irBuilder.SetInsertPoint(BodyBB);
+    cg->irBuilder.SetInsertPoint(BodyBB);
 
     llvm::Value *BodyV = getBody()->codegen();
     if (BodyV == nullptr) {
@@ -927,13 +1982,14 @@ llvm::Value *ASTWhileStmt::codegen() {
           "failed to generate bitcode for the loop body"); // LCOV_EXCL_LINE
     }
 
-    irBuilder.CreateBr(HeaderBB);
+    cg->irBuilder.CreateBr(HeaderBB);
   }
+  cg->loopDepth--;
 
   // Emit loop exit block.
   TheFunction->insert(TheFunction->end(), ExitBB);
-  irBuilder.SetInsertPoint(ExitBB);
-  return irBuilder.CreateCall(nop);
+  cg->irBuilder.SetInsertPoint(ExitBB);
+  return cg->irBuilder.CreateCall(cg->nop);
 } // LCOV_EXCL_LINE
 
 /*
@@ -954,41 +2010,33 @@ llvm::Value *ASTWhileStmt::codegen() {
 llvm::Value *ASTIfStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Value *CondV = getCondition()->codegen();
-  if (CondV == nullptr) {
-    throw InternalError(
-        "failed to generate bitcode for the condition of the if statement");
-  }
-
-  // Convert condition to a bool by comparing non-equal to 0.
-  CondV = irBuilder.CreateICmpNE(
-      CondV, llvm::ConstantInt::get(CondV->getType(), 0), "ifcond");
-
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
-
   /*
-   * Create blocks for the then and else cases.  The then block is first, so
-   * it is inserted in the function in the constructor. The rest of the blocks
-   * need to be inserted explicitly into the functions basic block list
-   * (via a push_back() call).
+   * Create blocks for the then and else cases.  The blocks are inserted
+   * explicitly into the functions basic block list once the condition, which
+   * may add blocks of its own, has been generated.
    *
    * Blocks don't need to be contiguous or ordered in
    * any particular way because we will explicitly branch between them.
    * This can be optimized to fall through behavior by later passes.
    */
-  labelNum++; // create shared labels for these BBs
-  llvm::BasicBlock *ThenBB = llvm::BasicBlock::Create(
-      llvmContext, "then" + std::to_string(labelNum), TheFunction);
+  cg->labelNum++; // create shared labels for these BBs
+  llvm::BasicBlock *ThenBB =
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "then" + std::to_string(cg->labelNum));
   llvm::BasicBlock *ElseBB =
-      llvm::BasicBlock::Create(llvmContext, "else" + std::to_string(labelNum));
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "else" + std::to_string(cg->labelNum));
   llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(
-      llvmContext, "ifmerge" + std::to_string(labelNum));
+      cg->llvmContext, "ifmerge" + std::to_string(cg->labelNum));
+
+  emitCondBr(getCondition(), ThenBB, ElseBB);
 
-  irBuilder.CreateCondBr(CondV, ThenBB, ElseBB);
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
   // Emit then block.
   {
-    irBuilder.SetInsertPoint(ThenBB);
+    TheFunction->insert(TheFunction->end(), ThenBB);
+    cg->irBuilder.SetInsertPoint(ThenBB);
 
     llvm::Value *ThenV = getThen()->codegen();
     if (ThenV == nullptr) {
@@ -996,14 +2044,14 @@ llvm::Value *ASTIfStmt::codegen() {
           "failed to generate bitcode for the then block"); // LCOV_EXCL_LINE
     }
 
-    irBuilder.CreateBr(MergeBB);
+    cg->irBuilder.CreateBr(MergeBB);
   }
 
   // Emit else block.
   {
     TheFunction->insert(TheFunction->end(), ElseBB);
 
-    irBuilder.SetInsertPoint(ElseBB);
+    cg->irBuilder.SetInsertPoint(ElseBB);
 
     // if there is no ELSE then exist emit a "nop"
     llvm::Value *ElseV;
@@ -1014,28 +2062,29 @@ llvm::Value *ASTIfStmt::codegen() {
             "failed to generate bitcode for the else block"); // LCOV_EXCL_LINE
       }
     } else {
-      irBuilder.CreateCall(nop);
+      cg->irBuilder.CreateCall(cg->nop);
     }
 
-    irBuilder.CreateBr(MergeBB);
+    cg->irBuilder.CreateBr(MergeBB);
   }
 
   // Emit merge block.
   TheFunction->insert(TheFunction->end(), MergeBB);
-  irBuilder.SetInsertPoint(MergeBB);
-  return irBuilder.CreateCall(nop);
+  cg->irBuilder.SetInsertPoint(MergeBB);
+  return cg->irBuilder.CreateCall(cg->nop);
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTOutputStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  if (outputIntrinsic == nullptr) {
-    std::vector<llvm::Type *> oneInt(1, llvm::Type::getInt64Ty(llvmContext));
-    auto *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext),
+  if (cg->outputIntrinsic == nullptr) {
+    std::vector<llvm::Type *> oneInt(1,
+                                     llvm::Type::getInt64Ty(cg->llvmContext));
+    auto *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(cg->llvmContext),
                                        oneInt, false);
-    outputIntrinsic =
+    cg->outputIntrinsic =
         llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                               "_tip_output", CurrentModule.get());
+                               "_tip_output", cg->CurrentModule.get());
   }
 
   llvm::Value *argVal = getArg()->codegen();
@@ -1046,20 +2095,12 @@ llvm::Value *ASTOutputStmt::codegen() {
 
   std::vector<llvm::Value *> ArgsV(1, argVal);
 
-  return irBuilder.CreateCall(outputIntrinsic, ArgsV);
+  return cg->irBuilder.CreateCall(cg->outputIntrinsic, ArgsV);
 }
 
 llvm::Value *ASTErrorStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  if (errorIntrinsic == nullptr) {
-    std::vector<llvm::Type *> oneInt(1, llvm::Type::getInt64Ty(llvmContext));
-    auto *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext),
-                                       oneInt, false);
-    errorIntrinsic = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                            "_tip_error", CurrentModule.get());
-  }
-
   llvm::Value *argVal = getArg()->codegen();
   if (argVal == nullptr) {
     throw InternalError(
@@ -1068,14 +2109,41 @@ llvm::Value *ASTErrorStmt::codegen() {
 
   std::vector<llvm::Value *> ArgsV(1, argVal);
 
-  return irBuilder.CreateCall(errorIntrinsic, ArgsV);
+  return cg->irBuilder.CreateCall(getErrorIntrinsic(), ArgsV);
 }
 
+/*
+ * A call in the return statement is marked as a tail call when escape
+ * analysis shows that the callee cannot observe the caller's frame.  All TIP
+ * functions take and return Int64 values and use the same calling convention,
+ * so the call is guaranteed to reuse the frame ("musttail") whenever the
+ * caller and callee have the same number of parameters.
+ */
 llvm::Value *ASTReturnStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   llvm::Value *argVal = getArg()->codegen();
-  return irBuilder.CreateRet(argVal);
+
+  // A call result is an Int64, so undo its conversion to a pointer
+  if (auto *cast = llvm::dyn_cast<llvm::IntToPtrInst>(argVal)) {
+    if (llvm::isa<llvm::CallInst>(cast->getOperand(0)) && cast->use_empty()) {
+      argVal = cast->getOperand(0);
+      cast->eraseFromParent();
+    }
+  }
+  argVal = coerce(argVal, llvm::Type::getInt64Ty(cg->llvmContext));
+
+  auto *call = llvm::dyn_cast<llvm::CallInst>(argVal);
+  auto *funApp = dynamic_cast<ASTFunAppExpr *>(getArg());
+  if (call != nullptr && funApp != nullptr && cg->escapeResults != nullptr &&
+      cg->escapeResults->isTailCall(funApp)) {
+    llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+    call->setTailCallKind(call->arg_size() == TheFunction->arg_size()
+                              ? llvm::CallInst::TCK_MustTail
+                              : llvm::CallInst::TCK_Tail);
+  }
+
+  return cg->irBuilder.CreateRet(argVal);
 }
 
 // Begin SIP extension
@@ -1083,94 +2151,109 @@ llvm::Value *ASTReturnStmt::codegen() {
 llvm::Value *ASTTernaryExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Value *CondV = getCondition()->codegen();
-
-  // Convert condition to a bool by comparing non-equal to 0.
-  CondV = irBuilder.CreateICmpNE(
-      CondV, llvm::ConstantInt::get(CondV->getType(), 0), "ifcond");
-
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
-
-  labelNum++; // create shared labels for these BBs
-  llvm::BasicBlock *TrueBB = llvm::BasicBlock::Create(
-      llvmContext, "true" + std::to_string(labelNum), TheFunction);
+  cg->labelNum++; // create shared labels for these BBs
+  llvm::BasicBlock *TrueBB =
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "true" + std::to_string(cg->labelNum));
   llvm::BasicBlock *FalseBB = llvm::BasicBlock::Create(
-      llvmContext, "false" + std::to_string(labelNum));
+      cg->llvmContext, "false" + std::to_string(cg->labelNum));
   llvm::BasicBlock *MergeBB = llvm::BasicBlock::Create(
-      llvmContext, "ternmerge" + std::to_string(labelNum));
+      cg->llvmContext, "ternmerge" + std::to_string(cg->labelNum));
+
+  auto *itetemp = createTemporary("itetemp", valueType(this));
 
-  irBuilder.CreateCondBr(CondV, TrueBB, FalseBB);
+  emitCondBr(getCondition(), TrueBB, FalseBB);
 
-  auto *itetemp = CreateEntryBlockAlloca(irBuilder.GetInsertBlock()->getParent(), "itetemp");
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
   // Emit true block.
   {
-    irBuilder.SetInsertPoint(TrueBB);
+    TheFunction->insert(TheFunction->end(), TrueBB);
+    cg->irBuilder.SetInsertPoint(TrueBB);
 
     llvm::Value *TrueV = getThen()->codegen();
 
-    irBuilder.CreateStore(TrueV, itetemp);
+    cg->irBuilder.CreateStore(coerce(TrueV, itetemp->getAllocatedType()),
+                              itetemp);
 
-    irBuilder.CreateBr(MergeBB);
+    cg->irBuilder.CreateBr(MergeBB);
   }
 
   // Emit false block.
   {
     TheFunction->insert(TheFunction->end(), FalseBB);
 
-    irBuilder.SetInsertPoint(FalseBB);
+    cg->irBuilder.SetInsertPoint(FalseBB);
 
     llvm::Value *FalseV = getElse()->codegen();
 
-    irBuilder.CreateStore(FalseV, itetemp);
+    cg->irBuilder.CreateStore(coerce(FalseV, itetemp->getAllocatedType()),
+                              itetemp);
 
-    irBuilder.CreateBr(MergeBB);
+    cg->irBuilder.CreateBr(MergeBB);
   }
 
   // Emit merge block.
   TheFunction->insert(TheFunction->end(), MergeBB);
-  irBuilder.SetInsertPoint(MergeBB);
-  return irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), itetemp);
+  cg->irBuilder.SetInsertPoint(MergeBB);
+  llvm::Value *result =
+      cg->irBuilder.CreateLoad(itetemp->getAllocatedType(), itetemp);
+  endTemporary(itetemp);
+  return result;
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTIncrementStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   // trigger code generation for l-value expressions
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *baseVal = getBase()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   // Load base value
-  llvm::Value *base = irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), baseVal);
+  llvm::Value *base = tagAccess(
+      cg->irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(cg->llvmContext),
+                               baseVal),
+      locationTag(getBase()));
   // Add 1 to the loaded base value
-  llvm::Value *incrementedValue = irBuilder.CreateAdd(base, llvm::ConstantInt::get(llvm::IntegerType::getInt64Ty(llvmContext), 1));
+  llvm::Value *incrementedValue = cg->irBuilder.CreateAdd(
+      base,
+      llvm::ConstantInt::get(llvm::IntegerType::getInt64Ty(cg->llvmContext),
+                             1));
 
   // Store incremented base value back
-  return irBuilder.CreateStore(incrementedValue, baseVal);
+  return tagAccess(cg->irBuilder.CreateStore(incrementedValue, baseVal),
+                   locationTag(getBase()));
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTDecrementStmt::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
   // trigger code generation for l-value expressions
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *baseVal = getBase()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   // Load base value
-  llvm::Value *base = irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), baseVal);
+  llvm::Value *base = tagAccess(
+      cg->irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(cg->llvmContext),
+                               baseVal),
+      locationTag(getBase()));
   // Subtract 1 from the loaded base value
-  llvm::Value *decrementedValue = irBuilder.CreateSub(base, llvm::ConstantInt::get(llvm::IntegerType::getInt64Ty(llvmContext), 1));
+  llvm::Value *decrementedValue = cg->irBuilder.CreateSub(
+      base,
+      llvm::ConstantInt::get(llvm::IntegerType::getInt64Ty(cg->llvmContext),
+                             1));
 
   // Store decremented base value back
-  return irBuilder.CreateStore(decrementedValue, baseVal);
+  return tagAccess(cg->irBuilder.CreateStore(decrementedValue, baseVal),
+                   locationTag(getBase()));
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTBooleanExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext),
+  return llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
                                 getValue());
 } // LCOV_EXCL_LINE
 
@@ -1181,33 +2264,43 @@ llvm::Value *ASTArrayDefaultExpr::codegen() {
   const std::vector<ASTExpr *> &elements = getFields();
   size_t numElements = elements.size();
 
-  // adding one onto numElements as we are storing that value for easy array length processing
-  llvm::Value *totalSize = llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), numElements + 1);
-
-  // call calloc for memory allocation
-  std::vector<llvm::Value *> callocArgs = {
-    totalSize,
-    llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 8)
-  };
-
-  // allocating space for array, copied mostly from ASTRecordExpr, using 8 as we deal with int64
-  llvm::Value *calloc = irBuilder.CreateCall(callocFun, callocArgs, "callocedArray");
-  llvm::Value *arrayPtr = irBuilder.CreatePointerCast(calloc, llvm::Type::getInt64PtrTy(llvmContext), "arrayPtr");
+  if (isColumnar(this)) {
+    llvm::Value *length = cg->irBuilder.getInt64(numElements);
+    llvm::Value *arrayPtr = allocateColumns(length);
+    for (size_t i = 0; i < numElements; ++i) {
+      storeColumns(dynamic_cast<ASTRecordExpr *>(elements[i]), arrayPtr,
+                   length, cg->irBuilder.getInt64(i));
+    }
+    return arrayPtr;
+  }
 
-  // storing array size at position 0
-  irBuilder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), numElements), arrayPtr);
+  // a non-escaping array lives in the stack frame; every slot is stored below
+  llvm::Value *arrayPtr = allocateArray(
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                             numElements),
+      isStackAllocatable(this));
+
+  // a literal of constants is copied from a template, length slot included
+  if (numElements > 0) {
+    if (auto *tmpl = createArrayTemplate(elements)) {
+      cg->irBuilder.CreateMemCpy(arrayLengthPtr(arrayPtr), llvm::MaybeAlign(8),
+                                 tmpl, llvm::MaybeAlign(8),
+                                 8 * (numElements + 1));
+      return arrayPtr;
+    }
+  }
 
   // storing each element from the array
   for (size_t i = 0; i < numElements; ++i) {
     llvm::Value *element = elements[i]->codegen();
-    llvm::Value *elementPtr = irBuilder.CreateGEP(
-      llvm::Type::getInt64Ty(llvmContext), arrayPtr,
-      llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), i + 1));
+    llvm::Value *elementPtr = arrayElementPtr(
+      arrayPtr, llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext),
+                                       i));
 
-    irBuilder.CreateStore(element, elementPtr);
+    tagAccess(cg->irBuilder.CreateStore(element, elementPtr), elementTag(this));
   }
 
-  return irBuilder.CreatePtrToInt(arrayPtr, llvm::Type::getInt64Ty(llvmContext), "arrayPtr");
+  return arrayPtr;
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTArrayFixedExpr::codegen() {
@@ -1216,213 +2309,302 @@ llvm::Value *ASTArrayFixedExpr::codegen() {
   // retrieving size of the array
   llvm::Value *numElements = getNumber()->codegen();
 
-  llvm::Value *isNegative = irBuilder.CreateICmpSLT(
-      numElements, llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0));
-
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
-  llvm::BasicBlock *ErrorBB = llvm::BasicBlock::Create(llvmContext, "error", TheFunction);
-  llvm::BasicBlock *ContinueBB = llvm::BasicBlock::Create(llvmContext, "continue");
+  llvm::Value *isNegative = cg->irBuilder.CreateICmpSLT(
+      numElements,
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 0));
 
-  irBuilder.CreateCondBr(isNegative, ErrorBB, ContinueBB);
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
+  llvm::BasicBlock *ErrorBB =
+      createFailureBlock(TheFunction, numElements, "error");
+  llvm::BasicBlock *ContinueBB =
+      llvm::BasicBlock::Create(cg->llvmContext, "continue");
 
-  irBuilder.SetInsertPoint(ErrorBB);
-  llvm::Function *trap = llvm::Intrinsic::getDeclaration(
-    TheFunction->getParent(), llvm::Intrinsic::trap);
-  irBuilder.CreateCall(trap);
-  irBuilder.CreateUnreachable();
+  cg->irBuilder.CreateCondBr(isNegative, ErrorBB, ContinueBB, failureWeights());
 
   TheFunction->insert(TheFunction->end(), ContinueBB);
-  irBuilder.SetInsertPoint(ContinueBB);
+  cg->irBuilder.SetInsertPoint(ContinueBB);
 
-  // adding one onto numElements as we are storing that value for easy array length processing
-  llvm::Value *totalSize = irBuilder.CreateAdd(numElements, llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 1));
-
-  // call calloc for memory allocation
-  std::vector<llvm::Value *> callocArgs = {
-    totalSize,
-    llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 8)
-  };
+  if (cg->escapeResults != nullptr && cg->escapeResults->isContiguous(this)) {
+    return emitContiguousArray(this, numElements);
+  }
+  if (isColumnar(this)) {
+    return emitColumnarArray(this, numElements);
+  }
 
-  // allocating space for array, copied mostly from ASTRecordExpr, using 8 as we deal with int64
-  llvm::Value *calloc = irBuilder.CreateCall(callocFun, callocArgs, "callocedArray");
-  llvm::Value *arrayPtr = irBuilder.CreatePointerCast(calloc, llvm::Type::getInt64PtrTy(llvmContext), "arrayPtr");
+  // escape analysis only accepts constant lengths, so the frame size is fixed
+  llvm::Value *arrayPtr = allocateArray(numElements, isStackAllocatable(this));
 
-  llvm::Value *szp = irBuilder.CreateGEP(llvm::Type::getInt64PtrTy(llvmContext), arrayPtr, llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0));
+  /*
+   * A pure initializer has the same value for every element, so it is
+   * evaluated once.  Heap arrays are already zeroed, and values whose bytes
+   * are all the same are filled with a memset.  Any other value is stored by
+   * a loop that the vectorizer turns into splat stores.
+   */
+  llvm::Value *fillValue = nullptr;
+  if (isPure(getInstance())) {
+    fillValue = getInstance()->codegen();
+    auto *fillConst = llvm::dyn_cast<llvm::Constant>(fillValue);
+    if (fillConst != nullptr && fillConst->isNullValue() &&
+        !isStackAllocatable(this)) {
+      return arrayPtr;
+    }
 
-  // storing array size at position 0
-  irBuilder.CreateStore(numElements, szp);
+    auto *fillInt = llvm::dyn_cast<llvm::ConstantInt>(fillValue);
+    if (fillConst != nullptr && fillConst->isNullValue()) {
+      fillInt = cg->irBuilder.getInt64(0);
+    }
+    if (fillInt != nullptr && fillInt->getValue().isSplat(8)) {
+      cg->irBuilder.CreateMemSet(
+          arrayPtr,
+          cg->irBuilder.getInt8(fillInt->getValue().trunc(8).getZExtValue()),
+          cg->irBuilder.CreateMul(numElements, cg->irBuilder.getInt64(8)),
+          llvm::MaybeAlign(ARRAY_ALIGNMENT));
+      return arrayPtr;
+    }
+  }
 
-  // llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
-  llvm::Value *index = irBuilder.CreateAlloca(llvm::Type::getInt64Ty(llvmContext));
-  irBuilder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0), index);
+  llvm::AllocaInst *index = createTemporary("index");
+  cg->irBuilder.CreateStore(
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 0),
+      index);
 
-  labelNum++; // create shared labels for these BBs
-  llvm::BasicBlock *HeaderBB = 
-      llvm::BasicBlock::Create(llvmContext, "header" + std::to_string(labelNum), TheFunction);
+  cg->labelNum++; // create shared labels for these BBs
+  llvm::BasicBlock *HeaderBB = llvm::BasicBlock::Create(
+      cg->llvmContext, "header" + std::to_string(cg->labelNum), TheFunction);
   llvm::BasicBlock *BodyBB = 
-      llvm::BasicBlock::Create(llvmContext, "body" + std::to_string(labelNum));
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "body" + std::to_string(cg->labelNum));
   llvm::BasicBlock *ExitBB = 
-      llvm::BasicBlock::Create(llvmContext, "exit" + std::to_string(labelNum));
+      llvm::BasicBlock::Create(cg->llvmContext,
+                               "exit" + std::to_string(cg->labelNum));
 
-  irBuilder.CreateBr(HeaderBB);
+  cg->irBuilder.CreateBr(HeaderBB);
 
-  irBuilder.SetInsertPoint(HeaderBB);
-  llvm::Value *currentIndex = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), index, "currentIndex");
-  llvm::Value *condition = irBuilder.CreateICmpSLT(currentIndex, numElements);
-  irBuilder.CreateCondBr(condition, BodyBB, ExitBB);
+  cg->irBuilder.SetInsertPoint(HeaderBB);
+  llvm::Value *currentIndex = cg->irBuilder.CreateLoad(
+      llvm::Type::getInt64Ty(cg->llvmContext), index, "currentIndex");
+  llvm::Value *condition = cg->irBuilder.CreateICmpSLT(currentIndex,
+                                                       numElements);
+  cg->irBuilder.CreateCondBr(condition, BodyBB, ExitBB);
 
   TheFunction->insert(TheFunction->end(), BodyBB);
-  irBuilder.SetInsertPoint(BodyBB);
-  llvm::Value *elementValue = getInstance()->codegen();
-  currentIndex = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), index, "currentIndex");
+  cg->irBuilder.SetInsertPoint(BodyBB);
+  llvm::Value *elementValue = fillValue;
+  if (elementValue == nullptr) {
+    cg->loopDepth++;
+    elementValue = getInstance()->codegen();
+    cg->loopDepth--;
+  }
+  currentIndex = cg->irBuilder.CreateLoad(
+      llvm::Type::getInt64Ty(cg->llvmContext), index, "currentIndex");
+
+  llvm::Value *elementPtr = arrayElementPtr(arrayPtr, currentIndex);
 
-  llvm::Value *elementPtr = irBuilder.CreateGEP(
-      llvm::Type::getInt64Ty(llvmContext), arrayPtr, irBuilder.CreateAdd(
-          currentIndex, llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 1)));
-  
-  irBuilder.CreateStore(elementValue, elementPtr);
+  tagAccess(cg->irBuilder.CreateStore(elementValue, elementPtr),
+            elementTag(this));
 
   // incrementing index
-  llvm::Value *nextIndex = irBuilder.CreateAdd(currentIndex, llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 1));
-  irBuilder.CreateStore(nextIndex, index);
-  irBuilder.CreateBr(HeaderBB);
+  llvm::Value *nextIndex = cg->irBuilder.CreateAdd(
+      currentIndex,
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 1));
+  cg->irBuilder.CreateStore(nextIndex, index);
+  cg->irBuilder.CreateBr(HeaderBB);
 
   TheFunction->insert(TheFunction->end(), ExitBB);
-  irBuilder.SetInsertPoint(ExitBB);
+  cg->irBuilder.SetInsertPoint(ExitBB);
+  endTemporary(index);
 
-  return irBuilder.CreatePtrToInt(arrayPtr, llvm::Type::getInt64Ty(llvmContext), "arrayPtr");
+  return arrayPtr;
 }
 
 llvm::Value *ASTNotExpr::codegen() {
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Value *baseVal = getBase()->codegen();
-
-  // Checks if the base value is false. if baseVal=false, isFalse=true, effectively flipping the value
-  llvm::Value *isFalse = irBuilder.CreateIsNull(baseVal);
-
-  // Create opposite boolean value by casting isFalse to int64 (same data type as ASTBooleanExpr)
-  return irBuilder.CreateIntCast(isFalse, llvm::IntegerType::getInt64Ty(llvmContext), false, "nottmp");
+  // Negate the base as a condition and widen it to int64 (same data type as
+  // ASTBooleanExpr)
+  return cg->irBuilder.CreateZExt(
+      emitCondition(this), llvm::IntegerType::getInt64Ty(cg->llvmContext),
+      "nottmp");
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTForIteratorStmt::codegen() { // LCOV_EXCL_LINE
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
-  labelNum++;
+  cg->labelNum++;
 
   llvm::BasicBlock *HeaderBB = llvm::BasicBlock::Create(
-    llvmContext, "header" + std::to_string(labelNum), TheFunction);
+    cg->llvmContext, "header" + std::to_string(cg->labelNum), TheFunction);
   llvm::BasicBlock *BodyBB =
-    llvm::BasicBlock::Create(llvmContext, "body" + std::to_string(labelNum));
+    llvm::BasicBlock::Create(cg->llvmContext,
+                             "body" + std::to_string(cg->labelNum));
   llvm::BasicBlock *ExitBB =
-    llvm::BasicBlock::Create(llvmContext, "exit" + std::to_string(labelNum));
+    llvm::BasicBlock::Create(cg->llvmContext,
+                             "exit" + std::to_string(cg->labelNum));
 
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *elementPtr = getElement()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   llvm::Value *arrayVal = getIterable()->codegen();
 
-  llvm::Value *arrayPtr = irBuilder.CreateIntToPtr(arrayVal, llvm::Type::getInt64PtrTy(llvmContext));
-  llvm::Value *lenPtr = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), arrayPtr, zeroV);
-  llvm::Value *len = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), lenPtr);
+  llvm::Value *arrayPtr =
+      coerce(arrayVal, llvm::Type::getInt64PtrTy(cg->llvmContext));
+  llvm::Value *len = tagAccess(
+      cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                               arrayLengthPtr(arrayPtr)),
+      lengthTag());
 
-  llvm::Value *index = irBuilder.CreateAlloca(llvm::Type::getInt64Ty(llvmContext));
-  irBuilder.CreateStore(llvm::ConstantInt::get(llvm::Type::getInt64Ty(llvmContext), 0), index);
+  llvm::AllocaInst *index = createTemporary("index");
+  cg->irBuilder.CreateStore(
+      llvm::ConstantInt::get(llvm::Type::getInt64Ty(cg->llvmContext), 0),
+      index);
 
-  irBuilder.CreateBr(HeaderBB);
+  cg->irBuilder.CreateBr(HeaderBB);
 
   // Emit loop header
   {
-    irBuilder.SetInsertPoint(HeaderBB);
+    cg->irBuilder.SetInsertPoint(HeaderBB);
 
-    llvm::Value *indexVal = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), index);
-    llvm::Value *condV = irBuilder.CreateICmpSLT(indexVal, len);
+    llvm::Value *indexVal = cg->irBuilder.CreateLoad(
+        llvm::Type::getInt64Ty(cg->llvmContext), index);
+    llvm::Value *condV = cg->irBuilder.CreateICmpSLT(indexVal, len);
 
-    irBuilder.CreateCondBr(condV, BodyBB, ExitBB);
+    cg->irBuilder.CreateCondBr(condV, BodyBB, ExitBB);
   }
 
   // Emit loop body
   {
     TheFunction->insert(TheFunction->end(), BodyBB);
-    irBuilder.SetInsertPoint(BodyBB);
-
-    llvm::Value *indexVal = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), index);
-    llvm::Value *index1Ptr = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), arrayPtr, oneV);
-    llvm::Value *arrayAccess = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), index1Ptr, indexVal);
-    llvm::Value *arrayLoad = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), arrayAccess);
-    irBuilder.CreateStore(arrayLoad, elementPtr);
-
+    cg->irBuilder.SetInsertPoint(BodyBB);
+
+    llvm::Value *indexVal = cg->irBuilder.CreateLoad(
+        llvm::Type::getInt64Ty(cg->llvmContext), index);
+    llvm::Value *arrayAccess = arrayElementPtr(arrayPtr, indexVal);
+    llvm::Value *arrayLoad = tagAccess(
+        markArrayLoad(
+            cg->irBuilder.CreateLoad(valueType(getElement()), arrayAccess),
+            getElement()),
+        elementTag(getIterable()));
+    cg->irBuilder.CreateStore(arrayLoad, elementPtr);
+
+    cg->loopDepth++;
     getBody()->codegen();
+    cg->loopDepth--;
 
-    llvm::Value *incIndexVal = irBuilder.CreateAdd(indexVal, oneV);
-    irBuilder.CreateStore(incIndexVal, index);
+    llvm::Value *incIndexVal = cg->irBuilder.CreateAdd(indexVal, cg->oneV);
+    cg->irBuilder.CreateStore(incIndexVal, index);
 
-    irBuilder.CreateBr(HeaderBB);
+    cg->irBuilder.CreateBr(HeaderBB);
   }
 
   // Emmit loop exit block
   TheFunction->insert(TheFunction->end(), ExitBB);
-  irBuilder.SetInsertPoint(ExitBB);
-  return irBuilder.CreateCall(nop);
+  cg->irBuilder.SetInsertPoint(ExitBB);
+  endTemporary(index);
+  return cg->irBuilder.CreateCall(cg->nop);
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTForRangeStmt::codegen() { // LCOV_EXCL_LINE
   LOG_S(1) << "Generating code for " << *this;
 
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
+  llvm::Function *TheFunction = cg->irBuilder.GetInsertBlock()->getParent();
 
-  labelNum++;
+  cg->labelNum++;
 
   llvm::BasicBlock *HeaderBB = llvm::BasicBlock::Create(
-    llvmContext, "header" + std::to_string(labelNum), TheFunction);
+    cg->llvmContext, "header" + std::to_string(cg->labelNum), TheFunction);
   llvm::BasicBlock *BodyBB =
-    llvm::BasicBlock::Create(llvmContext, "body" + std::to_string(labelNum));
+    llvm::BasicBlock::Create(cg->llvmContext,
+                             "body" + std::to_string(cg->labelNum));
   llvm::BasicBlock *ExitBB =
-    llvm::BasicBlock::Create(llvmContext, "exit" + std::to_string(labelNum));
+    llvm::BasicBlock::Create(cg->llvmContext,
+                             "exit" + std::to_string(cg->labelNum));
 
-  lValueGen = true;
+  cg->lValueGen = true;
   llvm::Value *elementPtr = getElement()->codegen();
-  lValueGen = false;
+  cg->lValueGen = false;
 
   llvm::Value *lowerVal = getLower()->codegen();
   llvm::Value *upperVal = getUpper()->codegen();
   llvm::Value *stepVal = getStep()->codegen();
 
-  irBuilder.CreateStore(lowerVal, elementPtr);
-
-  irBuilder.CreateBr(HeaderBB);
-
-// Emit loop header
-{
-  irBuilder.SetInsertPoint(HeaderBB);
+  cg->irBuilder.CreateStore(lowerVal, elementPtr);
 
-  llvm::Value *elementVal = irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), elementPtr);
-  llvm::Value *condV = irBuilder.CreateICmpSLT(elementVal, upperVal);
-
-  irBuilder.CreateCondBr(condV, BodyBB, ExitBB);
-}
-
-// Emit loop body
-{
-  TheFunction->insert(TheFunction->end(), BodyBB);
-  irBuilder.SetInsertPoint(BodyBB);
+  std::vector<ASTArrayRefExpr *> hoisted;
+  if (cg->boundsResults != nullptr) {
+    hoisted = cg->boundsResults->getVersionedChecks(this);
+  }
 
-  getBody()->codegen();
+  if (hoisted.empty()) {
+    cg->irBuilder.CreateBr(HeaderBB);
+  } else {
+    /*
+     * The overflow checks of the hoisted accesses are replaced by a single
+     * test of the upper bound against the length of each array.  The loop is
+     * emitted twice and the test selects the copy without those checks when
+     * it holds; otherwise, the original loop reports the failing access at
+     * the same iteration as before.  A hoisted access need not run, e.g.,
+     * under an "if", so its array may never have been allocated.  Each array
+     * is therefore tested for null before its length is read, and a null
+     * array selects the original loop.
+     */
+    llvm::BasicBlock *GuardBB = llvm::BasicBlock::Create(
+      cg->llvmContext, "guard" + std::to_string(cg->labelNum), TheFunction);
+    llvm::BasicBlock *FastHeaderBB = llvm::BasicBlock::Create(
+      cg->llvmContext, "fastheader" + std::to_string(cg->labelNum),
+                                                              TheFunction);
+    llvm::BasicBlock *FastBodyBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "fastbody" + std::to_string(cg->labelNum));
+
+    llvm::Value *iterateV = cg->irBuilder.CreateICmpSLT(lowerVal, upperVal);
+    cg->irBuilder.CreateCondBr(iterateV, GuardBB, HeaderBB);
+
+    cg->irBuilder.SetInsertPoint(GuardBB);
+    std::set<std::string> guarded;
+    for (auto ref : hoisted) {
+      auto array = dynamic_cast<ASTVariableExpr *>(ref->getArray());
+      if (!guarded.insert(array->getName()).second) {
+        continue;
+      }
+      llvm::Value *arrayVal = array->codegen();
+      llvm::Value *arrayPtr =
+          coerce(arrayVal, llvm::Type::getInt64PtrTy(cg->llvmContext));
+
+      llvm::BasicBlock *LengthBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "guardlen" + std::to_string(cg->labelNum),
+        TheFunction, FastHeaderBB);
+      cg->irBuilder.CreateCondBr(cg->irBuilder.CreateIsNull(arrayPtr), HeaderBB,
+                                 LengthBB);
+
+      cg->irBuilder.SetInsertPoint(LengthBB);
+      llvm::Value *len = tagAccess(
+          cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                                   arrayLengthPtr(arrayPtr)),
+          lengthTag());
+      llvm::BasicBlock *NextBB = llvm::BasicBlock::Create(
+        cg->llvmContext, "guard" + std::to_string(cg->labelNum), TheFunction,
+        FastHeaderBB);
+      cg->irBuilder.CreateCondBr(cg->irBuilder.CreateICmpSLE(upperVal, len),
+                                 NextBB, HeaderBB);
+      cg->irBuilder.SetInsertPoint(NextBB);
+    }
+    cg->irBuilder.CreateBr(FastHeaderBB);
 
-  llvm::Value *elementVal = irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), elementPtr);
-  llvm::Value *incElementVal = irBuilder.CreateAdd(elementVal, stepVal);
-  irBuilder.CreateStore(incElementVal, elementPtr);
+    cg->hoistedChecks.insert(hoisted.begin(), hoisted.end());
+    emitRangeLoop(FastHeaderBB, FastBodyBB, ExitBB, elementPtr, upperVal,
+                  stepVal, getBody());
+    cg->hoistedChecks.clear();
+  }
 
-  irBuilder.CreateBr(HeaderBB);
-}
+  emitRangeLoop(HeaderBB, BodyBB, ExitBB, elementPtr, upperVal, stepVal,
+                getBody());
 
 // Emit loop exit block
   TheFunction->insert(TheFunction->end(), ExitBB);
-  irBuilder.SetInsertPoint(ExitBB);
-  return irBuilder.CreateCall(nop);
+  cg->irBuilder.SetInsertPoint(ExitBB);
+  return cg->irBuilder.CreateCall(cg->nop);
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTNegExpr::codegen() {
@@ -1431,7 +2613,7 @@ llvm::Value *ASTNegExpr::codegen() {
   llvm::Value *exprVal = getExpr()->codegen();
 
   // Create negative expression value
-  return irBuilder.CreateNeg(exprVal, "negtmp");
+  return cg->irBuilder.CreateNeg(exprVal, "negtmp");
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTArrayLenExpr::codegen() { // LCOV_EXCL_LINE
@@ -1439,79 +2621,78 @@ llvm::Value *ASTArrayLenExpr::codegen() { // LCOV_EXCL_LINE
 
   llvm::Value *arrayVal = getArray()->codegen();
 
-  llvm::Value *arrayPtr = irBuilder.CreateIntToPtr(arrayVal, llvm::Type::getInt64PtrTy(llvmContext));
-  llvm::Value *arrayAccess = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), arrayPtr, zeroV);
-
-  return irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(llvmContext), arrayAccess);
+  llvm::Value *arrayPtr =
+      coerce(arrayVal, llvm::Type::getInt64PtrTy(cg->llvmContext));
+  return tagAccess(
+      cg->irBuilder.CreateLoad(llvm::IntegerType::getInt64Ty(cg->llvmContext),
+                               arrayLengthPtr(arrayPtr)),
+      lengthTag());
 } // LCOV_EXCL_LINE
 
 llvm::Value *ASTArrayRefExpr::codegen() { // LCOV_EXCL_LINE
     LOG_S(1) << "Generating code for " << *this;
 
-  bool isLValue = lValueGen;
+  bool isLValue = cg->lValueGen;
 
   if (isLValue) {
     // This flag is reset here so that sub-expressions are treated as r-values
-    lValueGen = false;
+    cg->lValueGen = false;
   }
 
-  llvm::Value *arrayVal = getArray()->codegen();
-  llvm::Value *indexVal = getIndex()->codegen();
-
-  llvm::Value *arrayPtr = irBuilder.CreateIntToPtr(arrayVal, llvm::Type::getInt64PtrTy(llvmContext));
-  llvm::Value *lenPtr = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), arrayPtr, zeroV);
-  llvm::Value *len = irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), lenPtr);
-
-  llvm::Function *TheFunction = irBuilder.GetInsertBlock()->getParent();
-
-  labelNum++;
-  llvm::BasicBlock *ErrorBB = llvm::BasicBlock::Create(
-      llvmContext, "error" + std::to_string(labelNum), TheFunction);
-  llvm::BasicBlock *OverflowBB = llvm::BasicBlock::Create(
-      llvmContext, "overflow" + std::to_string(labelNum));
-  llvm::BasicBlock *ContinueBB = llvm::BasicBlock::Create(
-      llvmContext, "continue" + std::to_string(labelNum));
-
-  llvm::Value *underflowCond = irBuilder.CreateICmpSLT(indexVal, zeroV);
-  irBuilder.CreateCondBr(underflowCond, ErrorBB, OverflowBB);
-
-  // Emit error block.
-  {
-    irBuilder.SetInsertPoint(ErrorBB);
-
-      if (errorIntrinsic == nullptr) {
-        std::vector<llvm::Type *> oneInt(1, llvm::Type::getInt64Ty(llvmContext));
-        auto *FT = llvm::FunctionType::get(llvm::Type::getInt64Ty(llvmContext),
-                                           oneInt, false);
-        errorIntrinsic = llvm::Function::Create(FT, llvm::Function::ExternalLinkage,
-                                                "_tip_error", CurrentModule.get());
-      }
-
-      std::vector<llvm::Value *> ArgsV(1, indexVal);
-
-      irBuilder.CreateCall(errorIntrinsic, ArgsV);
-
-      irBuilder.CreateBr(ContinueBB);
+  /*
+   * The rows of a contiguous array are a fixed stride apart, so the element
+   * address is computed from the row index instead of loading the row.  The
+   * lengths involved do not change, so their loads and the checks against
+   * them can be hoisted out of loops.
+   */
+  if (cg->escapeResults != nullptr && cg->escapeResults->isStrided(this)) {
+    auto *row = dynamic_cast<ASTArrayRefExpr *>(getArray());
+    llvm::Value *arrayPtr = coerce(row->getArray()->codegen(),
+                                   llvm::Type::getInt64PtrTy(cg->llvmContext));
+    llvm::Value *rowIndex = row->getIndex()->codegen();
+    emitBoundsChecks(row, arrayPtr, rowIndex);
+
+    llvm::Value *numRows = tagAccess(
+        cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 arrayLengthPtr(arrayPtr), "numRows"),
+        lengthTag());
+    llvm::Value *firstRow = firstRowPtr(arrayPtr, numRows);
+    llvm::Value *indexVal = getIndex()->codegen();
+    emitBoundsChecks(this, firstRow, indexVal);
+
+    llvm::Value *rowLength = tagAccess(
+        cg->irBuilder.CreateLoad(llvm::Type::getInt64Ty(cg->llvmContext),
+                                 arrayLengthPtr(firstRow), "rowLength"),
+        lengthTag());
+    llvm::Value *arrayAccess = arrayElementPtr(
+        firstRow,
+        cg->irBuilder.CreateAdd(cg->irBuilder.CreateMul(rowIndex,
+                                                        rowStride(rowLength)),
+                                indexVal));
+    if (isLValue) {
+      return arrayAccess;
+    }
+    return tagAccess(
+        markArrayLoad(cg->irBuilder.CreateLoad(valueType(this), arrayAccess),
+                      this),
+        elementTag(getArray()));
   }
 
-  // Emit overflow block.
-  {
-      TheFunction->insert(TheFunction->end(), OverflowBB);
-      irBuilder.SetInsertPoint(OverflowBB);
+  llvm::Value *arrayVal = getArray()->codegen();
+  llvm::Value *indexVal = getIndex()->codegen();
 
-      llvm::Value *overflowCond = irBuilder.CreateICmpSGE(indexVal, len);
-      irBuilder.CreateCondBr(overflowCond, ErrorBB, ContinueBB);
-  }
+  llvm::Value *arrayPtr =
+      coerce(arrayVal, llvm::Type::getInt64PtrTy(cg->llvmContext));
 
-  // Emit continue block.
-  TheFunction->insert(TheFunction->end(), ContinueBB);
-  irBuilder.SetInsertPoint(ContinueBB);
+  emitBoundsChecks(this, arrayPtr, indexVal);
 
-  llvm::Value *index1Ptr = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), arrayPtr, oneV);
-  llvm::Value *arrayAccess = irBuilder.CreateGEP(llvm::Type::getInt64Ty(llvmContext), index1Ptr, indexVal);
+  llvm::Value *arrayAccess = arrayElementPtr(arrayPtr, indexVal);
 
   if (isLValue) {
     return arrayAccess;
   }
-  return irBuilder.CreateLoad(llvm::Type::getInt64Ty(llvmContext), arrayAccess);
+  return tagAccess(
+      markArrayLoad(cg->irBuilder.CreateLoad(valueType(this), arrayAccess),
+                    this),
+      elementTag(getArray()));
 } // LCOV_EXCL_LINE
\ No newline at end of file
@@ -0,0 +1,18 @@
+#pragma once
+
+/*! \struct CodeGenOptions
+ *  \brief Options that select between alternative code generation strategies.
+ *
+ * The defaults produce the code expected by the standard runtime library.
+ */
+struct CodeGenOptions {
+  //! Allocate heap memory from the garbage collected heap of the runtime
+  bool gc = false;
+
+  //! Compile failed runtime checks to a trap instead of reporting the error
+  bool trap = false;
+
+  //! Store arrays of records that are only used through field accesses as
+  //! one column per field
+  bool soa = false;
+};
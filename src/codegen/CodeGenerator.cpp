@@ -5,21 +5,49 @@
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/ToolOutputFile.h"
 
+#include "OutputError.h"
+
 using namespace llvm;
 
 std::shared_ptr<Module>
 CodeGenerator::generate(ASTProgram *program, SemanticAnalysis *analysisResults,
-                        std::string fileName) {
-  return std::move(program->codegen(analysisResults, fileName));
+                        std::string fileName, LLVMContext &context,
+                        const CodeGenOptions &options) {
+  return std::move(
+      program->codegen(analysisResults, fileName, options, context));
 } // LCOV_EXCL_LINE
 
+namespace {
+
+// Open an output file, throwing an error if it cannot be created
+std::unique_ptr<ToolOutputFile> openOutput(const std::string &filename) {
+  std::error_code ec;
+  auto result =
+      std::make_unique<ToolOutputFile>(filename, ec, sys::fs::OF_None);
+  if (ec) {
+    throw OutputError("failed to open '" + filename + "' for writing");
+  }
+  return result;
+}
+
+// Keep an output file once it is written, or remove it if the write failed
+void keepOutput(const std::string &filename, ToolOutputFile &result) {
+  result.os().close();
+  if (result.os().has_error()) {
+    result.os().clear_error();
+    throw OutputError("failed to write '" + filename + "'");
+  }
+  result.keep();
+}
+
+} // namespace
+
 void CodeGenerator::emit(llvm::Module *m, std::string filename) {
   if (filename.empty()) {
     filename = m->getModuleIdentifier() + LLVM_BC_EXT;
   }
 
-  std::error_code ec;
-  ToolOutputFile result(filename, ec, sys::fs::OF_None);
+  auto result = openOutput(filename);
 
   // Only enable this routine if the build type is Debug, TIPC_DEBUG definition is declared in src/codegen/CMakeLists.txt
 #ifdef TIPC_DEBUG
@@ -45,8 +73,8 @@ void CodeGenerator::emit(llvm::Module *m, std::string filename) {
 
 #endif
 
-  WriteBitcodeToFile(*m, result.os());
-  result.keep();
+  WriteBitcodeToFile(*m, result->os());
+  keepOutput(filename, *result);
 }
 
 void CodeGenerator::emitHumanReadableAssembly(llvm::Module *m,
@@ -55,8 +83,7 @@ void CodeGenerator::emitHumanReadableAssembly(llvm::Module *m,
     filename = m->getModuleIdentifier() + LLVM_ASM_EXT;
   }
 
-  std::error_code ec;
-  ToolOutputFile result(filename, ec, sys::fs::OF_None);
-  m->print(result.os(), nullptr);
-  result.keep();
+  auto result = openOutput(filename);
+  m->print(result->os(), nullptr);
+  keepOutput(filename, *result);
 }
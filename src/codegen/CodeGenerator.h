@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ASTProgram.h"
+#include "CodeGenOptions.h"
 #include "SemanticAnalysis.h"
 #include "llvm/IR/Module.h"
 
@@ -19,19 +20,26 @@ public:
    *  \brief Generate LLVM IR for ast.
    *
    * Apply a series of basic optimization passes to the given LLVM module.
+   * The state of the generator belongs to this call, so programs may be
+   * generated concurrently on separate threads into separate contexts.
    * \param program the root of an AST encoding the program
    * \param analysisResults the results from semantic analysis of the program
    * \param fileName the name of the source file holding the program
+   * \param context the LLVM context that owns the generated module
+   * \param options the code generation strategies to use
    * \return the LLVM module holding the generated program
    */
   static std::shared_ptr<llvm::Module>
   generate(ASTProgram *program, SemanticAnalysis *analysisResults,
-           std::string fileName);
+           std::string fileName, llvm::LLVMContext &context,
+           const CodeGenOptions &options = CodeGenOptions());
 
   /*! \fn emit
    *  \brief Emit LLVM IR to a file.
    *
    * \param m the LLVM module holding the generated program
+   * \param filename the output file, by default named after the module
+   * \throws OutputError when the file cannot be written
    */
   static void emit(llvm::Module *m, std::string filename = "");
 
@@ -39,6 +47,8 @@ public:
    *  \brief Emit LLVM human-readable assembly to a file.
    *
    * \param m the LLVM module holding the generated program
+   * \param filename the output file, by default named after the module
+   * \throws OutputError when the file cannot be written
    */
   static void emitHumanReadableAssembly(llvm::Module *m,
                                         std::string filename = "");
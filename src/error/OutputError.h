@@ -0,0 +1,17 @@
+#pragma once
+
+#include "Error.h"
+
+/*! \brief Class for tipc output errors.
+ *
+ * Failures to write the code of a program, e.g., an output file that cannot
+ * be opened or an executable that cannot be linked, generate instances of
+ * this type.  The message is reported by the caller, so that the errors of
+ * files compiled concurrently are not interleaved.
+ * \sa Error
+ */
+class OutputError : public Error {
+public:
+  OutputError(const std::string &msg)
+      : Error(msg) {} //! Construct output error with message
+};
@@ -54,18 +54,6 @@ std::string ASTBuilder::opString(int op) {
   return opStr;
 }
 
-/*
- * Globals for communicating information up from visited subtrees
- * These are overwritten by every visit call.
- * We use multiple variables here to avoid downcasting of shared smart pointers.
- */
-static std::shared_ptr<ASTStmt> visitedStmt = nullptr;
-static std::shared_ptr<ASTDeclNode> visitedDeclNode = nullptr;
-static std::shared_ptr<ASTDeclStmt> visitedDeclStmt = nullptr;
-static std::shared_ptr<ASTExpr> visitedExpr = nullptr;
-static std::shared_ptr<ASTFieldExpr> visitedFieldExpr = nullptr;
-static std::shared_ptr<ASTFunction> visitedFunction = nullptr;
-
 /**********************************************************************
  * These methods override selected methods in the TIPBaseVisitor.
  *
@@ -84,7 +72,7 @@ static std::shared_ptr<ASTFunction> visitedFunction = nullptr;
  * be lost by the methods you don't override).  Instead you must create
  * your own structure that is local to the visitor to communicate between
  * the calls during the visit.  In the case of this visitor it is the
- * visitedX variables above.
+ * visitedX members declared in ASTBuilder.h.
  *
  * Note that the visit methods are required to return a value, but
  * we make no use of that value, so we simply return the empty string ("")
@@ -21,6 +21,21 @@ using namespace antlrcpp;
 class ASTBuilder : public TIPBaseVisitor {
 private:
   TIPParser *parser;
+
+  /*
+   * Members for communicating information up from visited subtrees
+   * These are overwritten by every visit call.
+   * We use multiple variables here to avoid downcasting of shared smart
+   * pointers.  Each builder has its own, so that programs can be built
+   * concurrently.
+   */
+  std::shared_ptr<ASTStmt> visitedStmt = nullptr;
+  std::shared_ptr<ASTDeclNode> visitedDeclNode = nullptr;
+  std::shared_ptr<ASTDeclStmt> visitedDeclStmt = nullptr;
+  std::shared_ptr<ASTExpr> visitedExpr = nullptr;
+  std::shared_ptr<ASTFieldExpr> visitedFieldExpr = nullptr;
+  std::shared_ptr<ASTFunction> visitedFunction = nullptr;
+
   std::string opString(int op);
   std::string generateSHA256(std::string tohash);
 
@@ -4,6 +4,7 @@
 #include <ostream>
 
 class SemanticAnalysis;
+struct CodeGenOptions;
 
 /*! \brief Class for a program which is a name and a list of functions.
  *
@@ -20,7 +21,9 @@ public:
   std::vector<ASTFunction *> getFunctions() const;
   ASTFunction *findFunctionByName(std::string);
   void accept(ASTVisitor *visitor) override;
-  std::shared_ptr<llvm::Module> codegen(SemanticAnalysis *st, const std::string& name);
+  std::shared_ptr<llvm::Module> codegen(SemanticAnalysis *st, const std::string& name,
+                                        const CodeGenOptions &options,
+                                        llvm::LLVMContext &context);
 
 private:
   llvm::Value *codegen() override;
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/*
+ * The operations of the bytecode interpreter.  Operands a, b and c name
+ * registers of the current frame unless noted otherwise.  Jump targets are
+ * instruction indices within the function and are always held in operand a.
+ */
+#define TIP_OPCODES(X)                                                         \
+  X(Move)           /* a = b */                                                \
+  X(LoadConst)      /* a = constant b of the function */                       \
+  X(Add)            /* a = b + c */                                            \
+  X(Sub)            /* a = b - c */                                            \
+  X(Mul)            /* a = b * c */                                            \
+  X(Div)            /* a = b / c */                                            \
+  X(Mod)            /* a = b % c */                                            \
+  X(AddImm)         /* a = b + immediate c */                                  \
+  X(Neg)            /* a = -b */                                               \
+  X(Not)            /* a = b == 0 */                                           \
+  X(Eq)             /* a = b == c */                                           \
+  X(Ne)             /* a = b != c */                                           \
+  X(Lt)             /* a = b < c */                                            \
+  X(Le)             /* a = b <= c */                                           \
+  X(Gt)             /* a = b > c */                                            \
+  X(Ge)             /* a = b >= c */                                           \
+  X(Jump)           /* goto a */                                               \
+  X(JumpIfZero)     /* if b == 0 goto a */                                     \
+  X(JumpIfNonZero)  /* if b != 0 goto a */                                     \
+  X(JumpEq)         /* if b == c goto a */                                     \
+  X(JumpNe)         /* if b != c goto a */                                     \
+  X(JumpLt)         /* if b < c goto a */                                      \
+  X(JumpLe)         /* if b <= c goto a */                                     \
+  X(JumpGt)         /* if b > c goto a */                                      \
+  X(JumpGe)         /* if b >= c goto a */                                     \
+  X(Call)           /* a = call of function value b, arguments from c */       \
+  X(CallFunction)   /* a = call of function index b, arguments from c */       \
+  X(Return)         /* return a */                                             \
+  X(Input)          /* a = input */                                            \
+  X(Output)         /* output a */                                             \
+  X(Error)          /* error a */                                              \
+  X(Alloc)          /* a = new cell holding b */                               \
+  X(Load)           /* a = *b */                                               \
+  X(Store)          /* *a = b */                                               \
+  X(NewRecord)      /* a = new record with every field zero */                 \
+  X(LoadField)      /* a = b.(field index c) */                                \
+  X(StoreField)     /* a.(field index b) = c */                                \
+  X(FieldAddress)   /* a = &b.(field index c) */                               \
+  X(FrameAlloc)     /* a = b zeroed words, reused by later executions */       \
+  X(Release)        /* free the words allocated by FrameAlloc in a */          \
+  X(NewArray)       /* a = new array of b zero elements */                     \
+  X(Fill)           /* every element of array a = b */                         \
+  X(ArrayLength)    /* a = #b */                                               \
+  X(LoadElement)    /* a = b[c], checking the index */                         \
+  X(StoreElement)   /* a[b] = c, where the index is known to be valid */       \
+  X(ElementAddress) /* a = &b[c], checking the index */                        \
+  X(MainUndefined)  /* report that the program has no main function */
+
+/*! \enum Opcode
+ *  \brief Operation performed by a bytecode instruction.
+ */
+enum class Opcode : uint8_t {
+#define TIP_OPCODE_ENUM(name) name,
+  TIP_OPCODES(TIP_OPCODE_ENUM)
+#undef TIP_OPCODE_ENUM
+};
+
+/*! \struct Instruction
+ *  \brief A register-based bytecode instruction.
+ */
+struct Instruction {
+  Opcode op;
+  int32_t a = 0;
+  int32_t b = 0;
+  int32_t c = 0;
+};
+
+/*! \struct BytecodeFunction
+ *  \brief The bytecode of a TIP function.
+ *
+ * The parameters are held in the first registers of the frame, followed by
+ * the local variables and the temporaries.  A variable whose address is taken
+ * holds a pointer to a cell instead of its value.
+ */
+struct BytecodeFunction {
+  std::string name;
+  int32_t numParams = 0;
+  int32_t numRegisters = 0;
+  std::vector<Instruction> code;
+  std::vector<int64_t> constants;
+};
+
+/*! \struct BytecodeProgram
+ *  \brief The bytecode of a TIP program.
+ *
+ * Functions are numbered as in the function table of the generated code,
+ * and function values are these numbers.
+ */
+struct BytecodeProgram {
+  std::vector<BytecodeFunction> functions;
+
+  //! Index of the main function, which reports an error if it is undefined
+  int32_t mainIndex = -1;
+
+  //! Number of fields of the records, which all have the same layout
+  int32_t numFields = 0;
+};
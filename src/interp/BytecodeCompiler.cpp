@@ -0,0 +1,752 @@
+#include "BytecodeCompiler.h"
+#include "AST.h"
+#include "ASTVisitor.h"
+#include "InternalError.h"
+
+#include "loguru.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <map>
+#include <set>
+
+namespace {
+
+// What the functions of a program need to know about the whole program
+struct ProgramInfo {
+  std::map<std::string, int32_t> functionIndex;
+  std::map<std::string, int32_t> fieldIndex;
+  int32_t recordWords = 1;
+  EscapeAnalysis *escape = nullptr;
+};
+
+// Check whether the expression has the same value for every evaluation.
+bool isPure(ASTExpr *expr) {
+  if (dynamic_cast<ASTNumberExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTBooleanExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTNullExpr *>(expr) != nullptr ||
+      dynamic_cast<ASTVariableExpr *>(expr) != nullptr) {
+    return true;
+  } else if (auto binary = dynamic_cast<ASTBinaryExpr *>(expr)) {
+    return binary->getOp() != "/" && binary->getOp() != "%" &&
+           isPure(binary->getLeft()) && isPure(binary->getRight());
+  } else if (auto notExpr = dynamic_cast<ASTNotExpr *>(expr)) {
+    return isPure(notExpr->getBase());
+  } else if (auto neg = dynamic_cast<ASTNegExpr *>(expr)) {
+    return isPure(neg->getExpr());
+  }
+  return false;
+}
+
+// Check whether the expression is a constant whose bits are all zero.
+bool isZero(ASTExpr *expr) {
+  if (auto num = dynamic_cast<ASTNumberExpr *>(expr)) {
+    return num->getValue() == 0;
+  } else if (auto boolean = dynamic_cast<ASTBooleanExpr *>(expr)) {
+    return !boolean->getValue();
+  }
+  return dynamic_cast<ASTNullExpr *>(expr) != nullptr;
+}
+
+bool isComparison(const std::string &op) {
+  return op == ">" || op == "==" || op == "!=" || op == ">=" || op == "<" ||
+         op == "<=";
+}
+
+// The operation computing the value of a binary operator
+Opcode binaryOpcode(const std::string &op) {
+  static const std::map<std::string, Opcode> opcodes = {
+      {"+", Opcode::Add}, {"-", Opcode::Sub},  {"*", Opcode::Mul},
+      {"/", Opcode::Div}, {"%", Opcode::Mod},  {"==", Opcode::Eq},
+      {"!=", Opcode::Ne}, {"<", Opcode::Lt},   {"<=", Opcode::Le},
+      {">", Opcode::Gt},  {">=", Opcode::Ge}};
+  auto opcode = opcodes.find(op);
+  if (opcode == opcodes.end()) {
+    throw InternalError("Invalid binary operator: " + op);
+  }
+  return opcode->second;
+}
+
+// The jump taken when a comparison holds, or when it fails
+Opcode jumpOpcode(const std::string &op, bool holds) {
+  if (op == ">") {
+    return holds ? Opcode::JumpGt : Opcode::JumpLe;
+  } else if (op == ">=") {
+    return holds ? Opcode::JumpGe : Opcode::JumpLt;
+  } else if (op == "<") {
+    return holds ? Opcode::JumpLt : Opcode::JumpGe;
+  } else if (op == "<=") {
+    return holds ? Opcode::JumpLe : Opcode::JumpGt;
+  } else if (op == "==") {
+    return holds ? Opcode::JumpEq : Opcode::JumpNe;
+  }
+  return holds ? Opcode::JumpNe : Opcode::JumpEq;
+}
+
+// Check whether the instruction only writes its result to register a.
+bool writesResult(Opcode op) {
+  switch (op) {
+  case Opcode::Move:
+  case Opcode::LoadConst:
+  case Opcode::Add:
+  case Opcode::Sub:
+  case Opcode::Mul:
+  case Opcode::Div:
+  case Opcode::Mod:
+  case Opcode::AddImm:
+  case Opcode::Neg:
+  case Opcode::Not:
+  case Opcode::Eq:
+  case Opcode::Ne:
+  case Opcode::Lt:
+  case Opcode::Le:
+  case Opcode::Gt:
+  case Opcode::Ge:
+  case Opcode::Call:
+  case Opcode::CallFunction:
+  case Opcode::Input:
+  case Opcode::Alloc:
+  case Opcode::Load:
+  case Opcode::NewRecord:
+  case Opcode::LoadField:
+  case Opcode::FieldAddress:
+  case Opcode::NewArray:
+  case Opcode::ArrayLength:
+  case Opcode::LoadElement:
+  case Opcode::ElementAddress:
+    return true;
+  default:
+    return false;
+  }
+}
+
+/*
+ * Collect the variables of a function whose address is taken, which are kept
+ * in cells, and the allocations that escape analysis places in the frame.
+ */
+class FrameScanner : public ASTVisitor {
+public:
+  explicit FrameScanner(EscapeAnalysis *escape) : escape(escape) {}
+
+  void endVisit(ASTRefExpr *element) override {
+    if (auto var = dynamic_cast<ASTVariableExpr *>(element->getVar())) {
+      cells.insert(var->getName());
+    }
+  }
+
+  void endVisit(ASTAllocExpr *element) override { recordSite(element); }
+
+  void endVisit(ASTRecordExpr *element) override { recordSite(element); }
+
+  std::set<std::string> cells;
+  std::vector<ASTNode *> frameSites;
+
+private:
+  void recordSite(ASTNode *site) {
+    if (escape != nullptr && escape->isStackAllocatable(site)) {
+      frameSites.push_back(site);
+    }
+  }
+
+  EscapeAnalysis *escape;
+};
+
+/*
+ * A location that is assigned, incremented or has its address taken.  It is
+ * a variable held in a register, a word whose address is in a register, or a
+ * field of the record in a register.
+ */
+struct Place {
+  enum Kind { Register, Memory, Field } kind;
+  int32_t reg;
+  int32_t field = 0;
+};
+
+/*
+ * Compiles one function.  Registers are assigned to the parameters, then to
+ * the local variables and the allocations placed in the frame, and the
+ * remaining registers hold temporaries.  Temporaries are allocated in stack
+ * order and released at the end of each statement.  The arguments of a call
+ * are placed in consecutive temporaries above every live one, so that they
+ * become the parameters of the frame of the callee.
+ */
+class FunctionCompiler {
+public:
+  FunctionCompiler(const ProgramInfo &info, BytecodeFunction &fn)
+      : info(info), fn(fn) {}
+
+  void compile(ASTFunction *function) {
+    LOG_S(1) << "Compiling bytecode for " << *function;
+
+    FrameScanner scanner(info.escape);
+    function->accept(&scanner);
+    cells = scanner.cells;
+
+    int32_t reg = 0;
+    for (auto formal : function->getFormals()) {
+      variables[formal->getName()] = reg++;
+    }
+    fn.numParams = reg;
+    for (auto decl : function->getDeclarations()) {
+      for (auto var : decl->getVars()) {
+        variables[var->getName()] = reg++;
+      }
+    }
+    for (auto site : scanner.frameSites) {
+      slots.push_back(reg);
+      frameSlots[site] = reg++;
+    }
+    firstTemp = nextTemp = fn.numRegisters = reg;
+
+    // Locals start out as zero, and variables whose address is taken as cells
+    for (auto formal : function->getFormals()) {
+      if (cells.count(formal->getName()) != 0) {
+        int32_t var = variables[formal->getName()];
+        emit(Opcode::Alloc, var, var);
+      }
+    }
+    for (auto decl : function->getDeclarations()) {
+      for (auto var : decl->getVars()) {
+        int32_t local = variables[var->getName()];
+        loadConst(local, 0);
+        if (cells.count(var->getName()) != 0) {
+          emit(Opcode::Alloc, local, local);
+        }
+      }
+    }
+    for (auto slot : slots) {
+      loadConst(slot, 0);
+    }
+
+    for (auto stmt : function->getStmts()) {
+      compileStmt(stmt);
+    }
+  }
+
+private:
+  const ProgramInfo &info;
+  BytecodeFunction &fn;
+  std::map<std::string, int32_t> variables;
+  std::set<std::string> cells;
+  std::map<ASTNode *, int32_t> frameSlots;
+  std::vector<int32_t> slots;
+  std::map<int64_t, int32_t> constantIndex;
+  int32_t firstTemp = 0;
+  int32_t nextTemp = 0;
+
+  // Index of the last instruction that is the target of a jump
+  size_t labelPc = std::numeric_limits<size_t>::max();
+
+  int32_t temp() {
+    int32_t reg = nextTemp++;
+    fn.numRegisters = std::max(fn.numRegisters, nextTemp);
+    return reg;
+  }
+
+  size_t emit(Opcode op, int32_t a = 0, int32_t b = 0, int32_t c = 0) {
+    fn.code.push_back({op, a, b, c});
+    return fn.code.size() - 1;
+  }
+
+  void loadConst(int32_t dst, int64_t value) {
+    auto index = constantIndex.find(value);
+    if (index == constantIndex.end()) {
+      index = constantIndex.emplace(value, fn.constants.size()).first;
+      fn.constants.push_back(value);
+    }
+    emit(Opcode::LoadConst, dst, index->second);
+  }
+
+  // The index of the next instruction, which is the target of a jump
+  int32_t label() {
+    labelPc = fn.code.size();
+    return static_cast<int32_t>(fn.code.size());
+  }
+
+  // Direct the jumps to the next instruction
+  void patch(const std::vector<size_t> &jumps) {
+    int32_t target = label();
+    for (auto jump : jumps) {
+      fn.code[jump].a = target;
+    }
+  }
+
+  /*
+   * Copy a value into a register.  When the value was just computed into a
+   * temporary, the instruction computing it writes the register instead.
+   */
+  void move(int32_t dst, int32_t src) {
+    if (dst == src) {
+      return;
+    }
+    if (src >= firstTemp && !fn.code.empty() && labelPc != fn.code.size()) {
+      Instruction &last = fn.code.back();
+      if (writesResult(last.op) && last.a == src) {
+        last.a = dst;
+        return;
+      }
+    }
+    emit(Opcode::Move, dst, src);
+  }
+
+  int32_t exprToTemp(ASTExpr *expr) {
+    int32_t reg = compileExpr(expr);
+    if (reg >= firstTemp) {
+      return reg;
+    }
+    int32_t copy = temp();
+    emit(Opcode::Move, copy, reg);
+    return copy;
+  }
+
+  int32_t fieldIndex(const std::string &field) {
+    auto index = info.fieldIndex.find(field);
+    if (index == info.fieldIndex.end()) {
+      throw InternalError("This field doesn't exist");
+    }
+    return index->second;
+  }
+
+  Place place(ASTExpr *lValue) {
+    if (auto var = dynamic_cast<ASTVariableExpr *>(lValue)) {
+      auto reg = variables.find(var->getName());
+      if (reg == variables.end()) {
+        throw InternalError("Unknown variable name: " + var->getName());
+      }
+      if (cells.count(var->getName()) != 0) {
+        return {Place::Memory, reg->second};
+      }
+      return {Place::Register, reg->second};
+    } else if (auto deref = dynamic_cast<ASTDeRefExpr *>(lValue)) {
+      return {Place::Memory, compileExpr(deref->getPtr())};
+    } else if (auto access = dynamic_cast<ASTAccessExpr *>(lValue)) {
+      int32_t field = fieldIndex(access->getField());
+      return {Place::Field, compileExpr(access->getRecord()), field};
+    } else if (auto ref = dynamic_cast<ASTArrayRefExpr *>(lValue)) {
+      int32_t dst = temp();
+      int32_t array = compileExpr(ref->getArray());
+      int32_t index = compileExpr(ref->getIndex());
+      emit(Opcode::ElementAddress, dst, array, index);
+      nextTemp = dst + 1;
+      return {Place::Memory, dst};
+    }
+    throw InternalError("could not generate l-value");
+  }
+
+  int32_t load(const Place &p) {
+    if (p.kind == Place::Register) {
+      return p.reg;
+    }
+    int32_t dst = temp();
+    if (p.kind == Place::Memory) {
+      emit(Opcode::Load, dst, p.reg);
+    } else {
+      emit(Opcode::LoadField, dst, p.reg, p.field);
+    }
+    return dst;
+  }
+
+  void store(const Place &p, int32_t value) {
+    if (p.kind == Place::Register) {
+      move(p.reg, value);
+    } else if (p.kind == Place::Memory) {
+      emit(Opcode::Store, p.reg, value);
+    } else {
+      emit(Opcode::StoreField, p.reg, p.field, value);
+    }
+  }
+
+  /*
+   * Emit a branch that is taken when the condition has the given truth
+   * value, and add its jumps to the list.  Comparisons jump on their operands
+   * and logical operators short-circuit.
+   */
+  void branch(ASTExpr *cond, bool when, std::vector<size_t> &jumps) {
+    int32_t mark = nextTemp;
+    if (auto notExpr = dynamic_cast<ASTNotExpr *>(cond)) {
+      branch(notExpr->getBase(), !when, jumps);
+      return;
+    }
+    if (auto binary = dynamic_cast<ASTBinaryExpr *>(cond)) {
+      const std::string &op = binary->getOp();
+      if ((op == "and" && !when) || (op == "or" && when)) {
+        branch(binary->getLeft(), when, jumps);
+        branch(binary->getRight(), when, jumps);
+        return;
+      } else if (op == "and" || op == "or") {
+        std::vector<size_t> skip;
+        branch(binary->getLeft(), !when, skip);
+        branch(binary->getRight(), when, jumps);
+        patch(skip);
+        return;
+      } else if (isComparison(op)) {
+        int32_t left = compileExpr(binary->getLeft());
+        int32_t right = compileExpr(binary->getRight());
+        jumps.push_back(emit(jumpOpcode(op, when), 0, left, right));
+        nextTemp = mark;
+        return;
+      }
+    }
+    int32_t value = compileExpr(cond);
+    jumps.push_back(
+        emit(when ? Opcode::JumpIfNonZero : Opcode::JumpIfZero, 0, value));
+    nextTemp = mark;
+  }
+
+  // The value of a condition, which is one if it holds and zero otherwise
+  int32_t conditionValue(ASTExpr *cond) {
+    int32_t dst = temp();
+    std::vector<size_t> falseJumps;
+    branch(cond, false, falseJumps);
+    loadConst(dst, 1);
+    size_t end = emit(Opcode::Jump);
+    patch(falseJumps);
+    loadConst(dst, 0);
+    patch({end});
+    return dst;
+  }
+
+  // Emit a loop that runs the body with each index from zero up to count.
+  template <typename Body> void countedLoop(int32_t count, Body body) {
+    int32_t index = temp();
+    loadConst(index, 0);
+    int32_t header = label();
+    size_t exit = emit(Opcode::JumpGe, 0, index, count);
+    body(index);
+    emit(Opcode::AddImm, index, index, 1);
+    emit(Opcode::Jump, header);
+    patch({exit});
+  }
+
+  int32_t compileCall(ASTFunAppExpr *app) {
+    Opcode op = Opcode::Call;
+    int32_t callee;
+    auto name = dynamic_cast<ASTVariableExpr *>(app->getFunction());
+    if (name != nullptr && variables.count(name->getName()) == 0 &&
+        info.functionIndex.count(name->getName()) != 0) {
+      op = Opcode::CallFunction;
+      callee = info.functionIndex.at(name->getName());
+    } else {
+      callee = compileExpr(app->getFunction());
+    }
+
+    int32_t dst = temp();
+    auto actuals = app->getActuals();
+    int32_t args = nextTemp;
+    for (size_t i = 0; i < actuals.size(); i++) {
+      temp();
+    }
+    for (size_t i = 0; i < actuals.size(); i++) {
+      int32_t mark = nextTemp;
+      move(args + static_cast<int32_t>(i), compileExpr(actuals[i]));
+      nextTemp = mark;
+    }
+    emit(op, dst, callee, args);
+    nextTemp = dst + 1;
+    return dst;
+  }
+
+  int32_t compileExpr(ASTExpr *expr) {
+    int32_t mark = nextTemp;
+
+    if (auto num = dynamic_cast<ASTNumberExpr *>(expr)) {
+      int32_t dst = temp();
+      loadConst(dst, num->getValue());
+      return dst;
+    } else if (auto boolean = dynamic_cast<ASTBooleanExpr *>(expr)) {
+      int32_t dst = temp();
+      loadConst(dst, boolean->getValue());
+      return dst;
+    } else if (dynamic_cast<ASTNullExpr *>(expr) != nullptr) {
+      int32_t dst = temp();
+      loadConst(dst, 0);
+      return dst;
+    } else if (auto var = dynamic_cast<ASTVariableExpr *>(expr)) {
+      auto reg = variables.find(var->getName());
+      if (reg != variables.end()) {
+        if (cells.count(var->getName()) == 0) {
+          return reg->second;
+        }
+        int32_t dst = temp();
+        emit(Opcode::Load, dst, reg->second);
+        return dst;
+      }
+      auto index = info.functionIndex.find(var->getName());
+      if (index == info.functionIndex.end()) {
+        throw InternalError("Unknown variable name: " + var->getName());
+      }
+      int32_t dst = temp();
+      loadConst(dst, index->second);
+      return dst;
+    } else if (dynamic_cast<ASTInputExpr *>(expr) != nullptr) {
+      int32_t dst = temp();
+      emit(Opcode::Input, dst);
+      return dst;
+    } else if (auto binary = dynamic_cast<ASTBinaryExpr *>(expr)) {
+      if (binary->getOp() == "and" || binary->getOp() == "or") {
+        return conditionValue(binary);
+      }
+      int32_t dst = temp();
+      int32_t left = compileExpr(binary->getLeft());
+      int32_t right = compileExpr(binary->getRight());
+      emit(binaryOpcode(binary->getOp()), dst, left, right);
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto notExpr = dynamic_cast<ASTNotExpr *>(expr)) {
+      int32_t dst = temp();
+      emit(Opcode::Not, dst, compileExpr(notExpr->getBase()));
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto neg = dynamic_cast<ASTNegExpr *>(expr)) {
+      int32_t dst = temp();
+      emit(Opcode::Neg, dst, compileExpr(neg->getExpr()));
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto ternary = dynamic_cast<ASTTernaryExpr *>(expr)) {
+      int32_t dst = temp();
+      std::vector<size_t> falseJumps;
+      branch(ternary->getCondition(), false, falseJumps);
+      move(dst, compileExpr(ternary->getThen()));
+      nextTemp = dst + 1;
+      size_t end = emit(Opcode::Jump);
+      patch(falseJumps);
+      move(dst, compileExpr(ternary->getElse()));
+      nextTemp = dst + 1;
+      patch({end});
+      return dst;
+    } else if (auto app = dynamic_cast<ASTFunAppExpr *>(expr)) {
+      return compileCall(app);
+    } else if (auto alloc = dynamic_cast<ASTAllocExpr *>(expr)) {
+      auto slot = frameSlots.find(alloc);
+      if (slot != frameSlots.end()) {
+        int32_t value = compileExpr(alloc->getInitializer());
+        emit(Opcode::FrameAlloc, slot->second, 1);
+        emit(Opcode::Store, slot->second, value);
+        nextTemp = mark;
+        return slot->second;
+      }
+      int32_t dst = temp();
+      emit(Opcode::Alloc, dst, compileExpr(alloc->getInitializer()));
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto ref = dynamic_cast<ASTRefExpr *>(expr)) {
+      Place p = place(ref->getVar());
+      if (p.kind == Place::Memory) {
+        return p.reg;
+      } else if (p.kind == Place::Field) {
+        int32_t dst = temp();
+        emit(Opcode::FieldAddress, dst, p.reg, p.field);
+        return dst;
+      }
+      throw InternalError("could not generate l-value for address of");
+    } else if (auto deref = dynamic_cast<ASTDeRefExpr *>(expr)) {
+      int32_t dst = temp();
+      emit(Opcode::Load, dst, compileExpr(deref->getPtr()));
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto record = dynamic_cast<ASTRecordExpr *>(expr)) {
+      int32_t dst;
+      auto slot = frameSlots.find(record);
+      if (slot != frameSlots.end()) {
+        dst = slot->second;
+        emit(Opcode::FrameAlloc, dst, info.recordWords);
+      } else {
+        dst = temp();
+        emit(Opcode::NewRecord, dst);
+      }
+      int32_t fieldMark = nextTemp;
+      for (auto field : record->getFields()) {
+        int32_t value = compileExpr(field->getInitializer());
+        emit(Opcode::StoreField, dst, fieldIndex(field->getField()), value);
+        nextTemp = fieldMark;
+      }
+      return dst;
+    } else if (auto access = dynamic_cast<ASTAccessExpr *>(expr)) {
+      int32_t field = fieldIndex(access->getField());
+      int32_t dst = temp();
+      emit(Opcode::LoadField, dst, compileExpr(access->getRecord()), field);
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto array = dynamic_cast<ASTArrayDefaultExpr *>(expr)) {
+      auto elements = array->getFields();
+      int32_t dst = temp();
+      int32_t length = temp();
+      loadConst(length, elements.size());
+      emit(Opcode::NewArray, dst, length);
+      for (size_t i = 0; i < elements.size(); i++) {
+        int32_t index = temp();
+        loadConst(index, i);
+        emit(Opcode::StoreElement, dst, index, compileExpr(elements[i]));
+        nextTemp = length + 1;
+      }
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto array = dynamic_cast<ASTArrayFixedExpr *>(expr)) {
+      int32_t dst = temp();
+      int32_t count = compileExpr(array->getNumber());
+      emit(Opcode::NewArray, dst, count);
+
+      // a pure initializer is evaluated once, and zero is already stored
+      if (isPure(array->getInstance())) {
+        if (!isZero(array->getInstance())) {
+          emit(Opcode::Fill, dst, compileExpr(array->getInstance()));
+        }
+      } else {
+        countedLoop(count, [&](int32_t index) {
+          int32_t bodyMark = nextTemp;
+          emit(Opcode::StoreElement, dst, index,
+               compileExpr(array->getInstance()));
+          nextTemp = bodyMark;
+        });
+      }
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto len = dynamic_cast<ASTArrayLenExpr *>(expr)) {
+      int32_t dst = temp();
+      emit(Opcode::ArrayLength, dst, compileExpr(len->getArray()));
+      nextTemp = dst + 1;
+      return dst;
+    } else if (auto ref = dynamic_cast<ASTArrayRefExpr *>(expr)) {
+      int32_t dst = temp();
+      int32_t array = compileExpr(ref->getArray());
+      int32_t index = compileExpr(ref->getIndex());
+      emit(Opcode::LoadElement, dst, array, index);
+      nextTemp = dst + 1;
+      return dst;
+    }
+    throw InternalError("unsupported expression in bytecode compilation");
+  }
+
+  void compileStmt(ASTStmt *stmt) {
+    int32_t mark = nextTemp;
+
+    if (auto block = dynamic_cast<ASTBlockStmt *>(stmt)) {
+      for (auto s : block->getStmts()) {
+        compileStmt(s);
+      }
+    } else if (auto assign = dynamic_cast<ASTAssignStmt *>(stmt)) {
+      Place p = place(assign->getLHS());
+      store(p, compileExpr(assign->getRHS()));
+    } else if (auto inc = dynamic_cast<ASTIncrementStmt *>(stmt)) {
+      Place p = place(inc->getBase());
+      int32_t value = load(p);
+      int32_t result = temp();
+      emit(Opcode::AddImm, result, value, 1);
+      store(p, result);
+    } else if (auto dec = dynamic_cast<ASTDecrementStmt *>(stmt)) {
+      Place p = place(dec->getBase());
+      int32_t value = load(p);
+      int32_t result = temp();
+      emit(Opcode::AddImm, result, value, -1);
+      store(p, result);
+    } else if (auto whileStmt = dynamic_cast<ASTWhileStmt *>(stmt)) {
+      int32_t header = label();
+      std::vector<size_t> exits;
+      branch(whileStmt->getCondition(), false, exits);
+      compileStmt(whileStmt->getBody());
+      emit(Opcode::Jump, header);
+      patch(exits);
+    } else if (auto ifStmt = dynamic_cast<ASTIfStmt *>(stmt)) {
+      std::vector<size_t> elseJumps;
+      branch(ifStmt->getCondition(), false, elseJumps);
+      compileStmt(ifStmt->getThen());
+      if (ifStmt->getElse() != nullptr) {
+        size_t end = emit(Opcode::Jump);
+        patch(elseJumps);
+        compileStmt(ifStmt->getElse());
+        patch({end});
+      } else {
+        patch(elseJumps);
+      }
+    } else if (auto forRange = dynamic_cast<ASTForRangeStmt *>(stmt)) {
+      // the bounds and the step are evaluated once, before the first store
+      Place element = place(forRange->getElement());
+      int32_t lower = compileExpr(forRange->getLower());
+      int32_t upper = exprToTemp(forRange->getUpper());
+      int32_t step = exprToTemp(forRange->getStep());
+      store(element, lower);
+
+      int32_t header = label();
+      int32_t bodyMark = nextTemp;
+      size_t exit = emit(Opcode::JumpGe, 0, load(element), upper);
+      nextTemp = bodyMark;
+      compileStmt(forRange->getBody());
+      int32_t next = temp();
+      emit(Opcode::Add, next, load(element), step);
+      store(element, next);
+      nextTemp = bodyMark;
+      emit(Opcode::Jump, header);
+      patch({exit});
+    } else if (auto forIterator = dynamic_cast<ASTForIteratorStmt *>(stmt)) {
+      Place element = place(forIterator->getElement());
+      int32_t array = exprToTemp(forIterator->getIterable());
+      int32_t length = temp();
+      emit(Opcode::ArrayLength, length, array);
+      countedLoop(length, [&](int32_t index) {
+        int32_t bodyMark = nextTemp;
+        int32_t value = temp();
+        emit(Opcode::LoadElement, value, array, index);
+        store(element, value);
+        nextTemp = bodyMark;
+        compileStmt(forIterator->getBody());
+      });
+    } else if (auto output = dynamic_cast<ASTOutputStmt *>(stmt)) {
+      emit(Opcode::Output, compileExpr(output->getArg()));
+    } else if (auto error = dynamic_cast<ASTErrorStmt *>(stmt)) {
+      emit(Opcode::Error, compileExpr(error->getArg()));
+    } else if (auto ret = dynamic_cast<ASTReturnStmt *>(stmt)) {
+      int32_t value = compileExpr(ret->getArg());
+      for (auto slot : slots) {
+        emit(Opcode::Release, slot);
+      }
+      emit(Opcode::Return, value);
+    } else {
+      throw InternalError("unsupported statement in bytecode compilation");
+    }
+
+    nextTemp = mark;
+  }
+};
+
+} // namespace
+
+std::unique_ptr<BytecodeProgram>
+BytecodeCompiler::compile(ASTProgram *program, SemanticAnalysis *analysis) {
+  auto bytecode = std::make_unique<BytecodeProgram>();
+
+  ProgramInfo info;
+  info.escape = analysis->getEscapeResults();
+  for (const auto &field : analysis->getSymbolTable()->getFields()) {
+    info.fieldIndex[field] = bytecode->numFields++;
+  }
+  info.recordWords = std::max(bytecode->numFields, 1);
+
+  auto functions = program->getFunctions();
+  for (size_t i = 0; i < functions.size(); i++) {
+    info.functionIndex[functions[i]->getName()] = i;
+  }
+
+  bytecode->functions.resize(functions.size());
+  for (size_t i = 0; i < functions.size(); i++) {
+    bytecode->functions[i].name = functions[i]->getName();
+    FunctionCompiler(info, bytecode->functions[i]).compile(functions[i]);
+    if (functions[i]->getName() == "main") {
+      bytecode->mainIndex = i;
+    }
+  }
+
+  // A program without a main function reports it when it is run
+  if (bytecode->mainIndex < 0) {
+    BytecodeFunction undefined;
+    undefined.name = "_tip_main";
+    undefined.numRegisters = 1;
+    undefined.constants.push_back(0);
+    undefined.code.push_back({Opcode::MainUndefined});
+    undefined.code.push_back({Opcode::LoadConst, 0, 0});
+    undefined.code.push_back({Opcode::Return, 0});
+    bytecode->mainIndex = bytecode->functions.size();
+    bytecode->functions.push_back(undefined);
+  }
+
+  return bytecode;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "ASTProgram.h"
+#include "Bytecode.h"
+#include "SemanticAnalysis.h"
+
+#include <memory>
+
+/*! \class BytecodeCompiler
+ *  \brief Translate a checked program to bytecode for the interpreter.
+ *
+ * The bytecode has the semantics of the code generated for the program.
+ * Records, arrays and cells have the same layout, and the allocations that
+ * escape analysis places in the stack frame are reused by later executions
+ * of the same call.  Conditions are compiled to branches that compare their
+ * operands directly.
+ */
+class BytecodeCompiler {
+public:
+  /*! \fn compile
+   *  \brief Compile a program to bytecode.
+   *
+   * \param program the program to compile
+   * \param analysis the results of semantic analysis of the program
+   * \return the bytecode of the program
+   */
+  static std::unique_ptr<BytecodeProgram> compile(ASTProgram *program,
+                                                  SemanticAnalysis *analysis);
+};
@@ -0,0 +1,337 @@
+#include "Interpreter.h"
+#include "tip_rtlib.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+// Handlers jump to the next handler through a table of label addresses
+#if defined(__GNUC__)
+#define TIP_THREADED_DISPATCH 1
+#else
+#define TIP_THREADED_DISPATCH 0
+#endif
+
+namespace {
+
+// The state of a caller while its callee runs
+struct Frame {
+  const BytecodeFunction *function;
+  const Instruction *returnPc;
+  size_t base;
+  int32_t result;
+};
+
+int64_t *words(int64_t value) { return reinterpret_cast<int64_t *>(value); }
+
+int64_t value(void *pointer) { return reinterpret_cast<int64_t>(pointer); }
+
+// Integer arithmetic wraps around, as it does in the generated code
+int64_t wrap(uint64_t result) { return static_cast<int64_t>(result); }
+
+// The index is reported as the error when it lies outside the array
+int64_t *checkedElement(int64_t array, int64_t index) {
+  int64_t *elements = words(array);
+  if (index < 0 || index >= elements[-1]) {
+    _tip_error(index);
+  }
+  return elements + index;
+}
+
+/*
+ * Run the main function with the given inputs and return its result.  The
+ * registers of all frames are kept in one stack.  The frame of a callee
+ * starts at the arguments of the call, which are the last live registers of
+ * the caller, so arguments are passed without copying.
+ */
+int64_t execute(const BytecodeProgram &program, const int64_t *inputs) {
+  const size_t recordWords = std::max<int32_t>(program.numFields, 1);
+
+  const BytecodeFunction *fn = &program.functions[program.mainIndex];
+  std::vector<int64_t> stack(std::max<size_t>(4096, fn->numRegisters));
+  std::vector<Frame> frames;
+  std::copy(inputs, inputs + fn->numParams, stack.begin());
+
+  size_t base = 0;
+  int64_t *regs = stack.data();
+  const Instruction *code = fn->code.data();
+  const int64_t *constants = fn->constants.data();
+  const Instruction *pc = code;
+  const BytecodeFunction *callee = nullptr;
+
+#define R(operand) regs[pc->operand]
+
+#if TIP_THREADED_DISPATCH
+  static const void *const handlers[] = {
+#define TIP_OPCODE_LABEL(name) &&op_##name,
+      TIP_OPCODES(TIP_OPCODE_LABEL)
+#undef TIP_OPCODE_LABEL
+  };
+#define DISPATCH() goto *handlers[static_cast<size_t>(pc->op)]
+#define OP(name) op_##name:
+#else
+#define DISPATCH() goto dispatch
+#define OP(name) case Opcode::name:
+#endif
+
+#define NEXT()                                                                 \
+  do {                                                                         \
+    ++pc;                                                                      \
+    DISPATCH();                                                                \
+  } while (0)
+
+#define JUMP_IF(condition)                                                     \
+  do {                                                                         \
+    pc = (condition) ? code + pc->a : pc + 1;                                  \
+    DISPATCH();                                                                \
+  } while (0)
+
+  DISPATCH();
+
+#if !TIP_THREADED_DISPATCH
+dispatch:
+  switch (pc->op) {
+#endif
+
+  OP(Move) {
+    R(a) = R(b);
+    NEXT();
+  }
+  OP(LoadConst) {
+    R(a) = constants[pc->b];
+    NEXT();
+  }
+  OP(Add) {
+    R(a) = wrap(static_cast<uint64_t>(R(b)) + static_cast<uint64_t>(R(c)));
+    NEXT();
+  }
+  OP(Sub) {
+    R(a) = wrap(static_cast<uint64_t>(R(b)) - static_cast<uint64_t>(R(c)));
+    NEXT();
+  }
+  OP(Mul) {
+    R(a) = wrap(static_cast<uint64_t>(R(b)) * static_cast<uint64_t>(R(c)));
+    NEXT();
+  }
+  OP(Div) {
+    R(a) = R(b) / R(c);
+    NEXT();
+  }
+  OP(Mod) {
+    R(a) = R(b) % R(c);
+    NEXT();
+  }
+  OP(AddImm) {
+    R(a) = wrap(static_cast<uint64_t>(R(b)) + static_cast<uint64_t>(pc->c));
+    NEXT();
+  }
+  OP(Neg) {
+    R(a) = wrap(0 - static_cast<uint64_t>(R(b)));
+    NEXT();
+  }
+  OP(Not) {
+    R(a) = R(b) == 0;
+    NEXT();
+  }
+  OP(Eq) {
+    R(a) = R(b) == R(c);
+    NEXT();
+  }
+  OP(Ne) {
+    R(a) = R(b) != R(c);
+    NEXT();
+  }
+  OP(Lt) {
+    R(a) = R(b) < R(c);
+    NEXT();
+  }
+  OP(Le) {
+    R(a) = R(b) <= R(c);
+    NEXT();
+  }
+  OP(Gt) {
+    R(a) = R(b) > R(c);
+    NEXT();
+  }
+  OP(Ge) {
+    R(a) = R(b) >= R(c);
+    NEXT();
+  }
+  OP(Jump) {
+    pc = code + pc->a;
+    DISPATCH();
+  }
+  OP(JumpIfZero) { JUMP_IF(R(b) == 0); }
+  OP(JumpIfNonZero) { JUMP_IF(R(b) != 0); }
+  OP(JumpEq) { JUMP_IF(R(b) == R(c)); }
+  OP(JumpNe) { JUMP_IF(R(b) != R(c)); }
+  OP(JumpLt) { JUMP_IF(R(b) < R(c)); }
+  OP(JumpLe) { JUMP_IF(R(b) <= R(c)); }
+  OP(JumpGt) { JUMP_IF(R(b) > R(c)); }
+  OP(JumpGe) { JUMP_IF(R(b) >= R(c)); }
+  OP(Call) {
+    callee = &program.functions[R(b)];
+    goto call;
+  }
+  OP(CallFunction) {
+    callee = &program.functions[pc->b];
+    goto call;
+  }
+  OP(Return) {
+    int64_t result = R(a);
+    if (frames.empty()) {
+      return result;
+    }
+    const Frame &caller = frames.back();
+    fn = caller.function;
+    pc = caller.returnPc;
+    base = caller.base;
+    regs = stack.data() + base;
+    regs[caller.result] = result;
+    code = fn->code.data();
+    constants = fn->constants.data();
+    frames.pop_back();
+    DISPATCH();
+  }
+  OP(Input) {
+    R(a) = _tip_input();
+    NEXT();
+  }
+  OP(Output) {
+    _tip_output(R(a));
+    NEXT();
+  }
+  OP(Error) { _tip_error(R(a)); }
+  OP(Alloc) {
+    int64_t initial = R(b);
+    int64_t *cell = static_cast<int64_t *>(calloc(1, sizeof(int64_t)));
+    *cell = initial;
+    R(a) = value(cell);
+    NEXT();
+  }
+  OP(Load) {
+    R(a) = *words(R(b));
+    NEXT();
+  }
+  OP(Store) {
+    *words(R(a)) = R(b);
+    NEXT();
+  }
+  OP(NewRecord) {
+    R(a) = value(calloc(recordWords, sizeof(int64_t)));
+    NEXT();
+  }
+  OP(LoadField) {
+    R(a) = words(R(b))[pc->c];
+    NEXT();
+  }
+  OP(StoreField) {
+    words(R(a))[pc->b] = R(c);
+    NEXT();
+  }
+  OP(FieldAddress) {
+    R(a) = value(words(R(b)) + pc->c);
+    NEXT();
+  }
+  OP(FrameAlloc) {
+    if (R(a) == 0) {
+      R(a) = value(calloc(pc->b, sizeof(int64_t)));
+    } else {
+      memset(words(R(a)), 0, pc->b * sizeof(int64_t));
+    }
+    NEXT();
+  }
+  OP(Release) {
+    free(words(R(a)));
+    NEXT();
+  }
+  OP(NewArray) {
+    int64_t length = R(b);
+    if (length < 0) {
+      _tip_error(length);
+    }
+    int64_t *elements = static_cast<int64_t *>(_tip_alloc_array(length));
+    elements[-1] = length;
+    R(a) = value(elements);
+    NEXT();
+  }
+  OP(Fill) {
+    int64_t *elements = words(R(a));
+    std::fill(elements, elements + elements[-1], R(b));
+    NEXT();
+  }
+  OP(ArrayLength) {
+    R(a) = words(R(b))[-1];
+    NEXT();
+  }
+  OP(LoadElement) {
+    R(a) = *checkedElement(R(b), R(c));
+    NEXT();
+  }
+  OP(StoreElement) {
+    words(R(a))[R(b)] = R(c);
+    NEXT();
+  }
+  OP(ElementAddress) {
+    R(a) = value(checkedElement(R(b), R(c)));
+    NEXT();
+  }
+  OP(MainUndefined) {
+    _tip_main_undefined();
+    NEXT();
+  }
+
+#if !TIP_THREADED_DISPATCH
+  }
+#endif
+
+call : {
+  size_t calleeBase = base + pc->c;
+  size_t calleeEnd = calleeBase + callee->numRegisters;
+  if (calleeEnd > stack.size()) {
+    stack.resize(std::max(2 * stack.size(), calleeEnd));
+  }
+  frames.push_back({fn, pc + 1, base, pc->a});
+  fn = callee;
+  base = calleeBase;
+  regs = stack.data() + base;
+  code = fn->code.data();
+  constants = fn->constants.data();
+  pc = code;
+  DISPATCH();
+}
+
+#undef JUMP_IF
+#undef NEXT
+#undef OP
+#undef DISPATCH
+#undef R
+}
+
+// The program started by _tip_start, which calls back into the interpreter
+thread_local const BytecodeProgram *startedProgram = nullptr;
+thread_local const int64_t *startedInputs = nullptr;
+
+int64_t interpretedMain() { return execute(*startedProgram, startedInputs); }
+
+} // namespace
+
+int Interpreter::run(const BytecodeProgram &program,
+                     const std::vector<std::string> &args) {
+  int64_t numInputs = program.functions[program.mainIndex].numParams;
+  std::vector<int64_t> inputs(numInputs + 1);
+
+  std::string programName = "tipc";
+  std::vector<char *> argv;
+  argv.push_back(&programName[0]);
+  for (auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  startedProgram = &program;
+  startedInputs = inputs.data();
+  return _tip_start(interpretedMain, numInputs, inputs.data(), argv.size() - 1,
+                    argv.data());
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "Bytecode.h"
+
+#include <string>
+#include <vector>
+
+/*! \class Interpreter
+ *  \brief Routines to run the bytecode of a program within tipc.
+ *
+ * Programs start without any code generation, so the interpreter suits
+ * short runs, and it serves as a reference for the compiled code.  Input,
+ * output, errors and allocation go through the runtime library that is built
+ * into tipc, so a program behaves as its native executable does.
+ *
+ * Instructions are dispatched by jumping from each handler directly to the
+ * handler of the next instruction where the compiler supports computed goto.
+ */
+class Interpreter {
+public:
+  /*! \fn run
+   *  \brief Run the main function of a program.
+   *
+   * The arguments are read into the inputs of the TIP main function, as the
+   * runtime library does for a native executable.  Runtime errors exit the
+   * process with their usual status.
+   * \param program the bytecode of the program
+   * \param args the arguments of the TIP main function
+   * \return the exit status of the program
+   */
+  static int run(const BytecodeProgram &program,
+                 const std::vector<std::string> &args);
+};
@@ -0,0 +1,252 @@
+#include "JIT.h"
+#include "CallGraph.h"
+#include "tip_rtlib.h"
+
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/Error.h"
+#include "llvm/Support/TargetSelect.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/Threading.h"
+
+#include "loguru.hpp"
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+
+namespace {
+
+// Report a failure of the JIT and return the status for it.
+int reportError(llvm::Error error) {
+  std::string message;
+  llvm::raw_string_ostream stream(message);
+  stream << error;
+  LOG_S(ERROR) << "tipc: error: " << stream.str();
+  return -1;
+}
+
+/*
+ * Bind the calls of the program to the runtime library built into tipc, and
+ * to the C library for calloc and the targets of the memory intrinsics.
+ */
+llvm::Error defineRuntime(llvm::orc::LLJIT &jit) {
+  auto &mainDylib = jit.getMainJITDylib();
+  llvm::orc::MangleAndInterner mangle(jit.getExecutionSession(),
+                                      jit.getDataLayout());
+  auto flags = llvm::JITSymbolFlags::Exported;
+  llvm::orc::SymbolMap runtime{
+      {mangle("_tip_input"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_input), flags}},
+      {mangle("_tip_output"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_output), flags}},
+      {mangle("_tip_error"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_error), flags}},
+      {mangle("_tip_gc_collect"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_gc_collect), flags}},
+      {mangle("_tip_gc_alloc"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_gc_alloc), flags}},
+      {mangle("_tip_alloc_array"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_alloc_array), flags}},
+      {mangle("_tip_gc_alloc_array"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_gc_alloc_array), flags}},
+      {mangle("_tip_main_undefined"),
+       {llvm::orc::ExecutorAddr::fromPtr(&_tip_main_undefined), flags}}};
+  if (auto error = mainDylib.define(llvm::orc::absoluteSymbols(runtime))) {
+    return error;
+  }
+
+  auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(
+      jit.getDataLayout().getGlobalPrefix());
+  if (!process) {
+    return process.takeError();
+  }
+  mainDylib.addGenerator(std::move(*process));
+  return llvm::Error::success();
+}
+
+// Returns the name of the LLVM function generated for a TIP function.
+std::string functionName(ASTFunction *f) {
+  return f->getName() == "main" ? "_tip_main" : f->getName();
+}
+
+/*
+ * Compiles the callees of each function in lazy mode once the function
+ * itself is compiled, so that they are usually ready by their first call.
+ */
+class Precompiler {
+  llvm::orc::LLLazyJIT &jit;
+  std::map<std::string, std::vector<std::string>> callees;
+  std::set<std::string> requested;
+  std::mutex lock;
+
+public:
+  Precompiler(llvm::orc::LLLazyJIT &jit, CallGraph *callGraph) : jit(jit) {
+    for (auto *f : callGraph->getVertices()) {
+      for (auto *callee : callGraph->getCallees(f)) {
+        callees[functionName(f)].push_back(functionName(callee));
+      }
+    }
+  }
+
+  // Request the compilation of the callees of a compiled function.
+  void compiled(const std::string &caller) {
+    auto &session = jit.getExecutionSession();
+    // the bodies of lazily compiled functions are kept in the ".impl" dylib
+    auto *implDylib = session.getJITDylibByName(
+        jit.getMainJITDylib().getName() + ".impl");
+    if (implDylib == nullptr) {
+      return;
+    }
+
+    llvm::orc::MangleAndInterner mangle(session, jit.getDataLayout());
+    llvm::orc::SymbolLookupSet symbols;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      for (auto &callee : callees[caller]) {
+        if (requested.insert(callee).second) {
+          symbols.add(mangle(callee));
+        }
+      }
+    }
+    if (symbols.empty()) {
+      return;
+    }
+
+    LOG_S(1) << "JIT: compiling the callees of " << caller;
+    session.lookup(
+        llvm::orc::LookupKind::Static,
+        llvm::orc::makeJITDylibSearchOrder(implDylib), std::move(symbols),
+        llvm::orc::SymbolState::Ready,
+        [](llvm::Expected<llvm::orc::SymbolMap> result) {
+          // a callee that fails to compile is reported on its first call
+          llvm::consumeError(result.takeError());
+        },
+        llvm::orc::NoDependenciesToRegister);
+  }
+};
+
+} // namespace
+
+int JIT::run(llvm::Module *m, const std::vector<std::string> &args,
+             const JITOptions &options) {
+  llvm::InitializeNativeTarget();
+  llvm::InitializeNativeTargetAsmPrinter();
+
+  /*
+   * The JIT takes ownership of the module and its context, while the module
+   * is owned by the code generator, so a copy is made in a new context.
+   */
+  llvm::SmallVector<char, 0> bitcode;
+  llvm::raw_svector_ostream bitcodeStream(bitcode);
+  llvm::WriteBitcodeToFile(*m, bitcodeStream);
+
+  auto context = std::make_unique<llvm::LLVMContext>();
+  auto module = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()),
+                            m->getModuleIdentifier()),
+      *context);
+  if (!module) {
+    return reportError(module.takeError());
+  }
+  llvm::orc::ThreadSafeModule program(std::move(*module), std::move(context));
+
+  // the JIT is destroyed first, which waits for its compile threads
+  std::unique_ptr<Precompiler> precompiler;
+  std::unique_ptr<llvm::orc::LLJIT> jit;
+  if (options.lazy) {
+    unsigned threads = options.threads != 0
+                           ? options.threads
+                           : llvm::hardware_concurrency().compute_thread_count();
+    auto lazyJit =
+        llvm::orc::LLLazyJITBuilder().setNumCompileThreads(threads).create();
+    if (!lazyJit) {
+      return reportError(lazyJit.takeError());
+    }
+    (*lazyJit)->setPartitionFunction(
+        llvm::orc::CompileOnDemandLayer::compileRequested);
+
+    // Functions keep their names when they are split into partitions, so
+    // that the call graph can name the functions to compile ahead
+    program.withModuleDo([](llvm::Module &programModule) {
+      for (auto &f : programModule) {
+        if (f.hasLocalLinkage()) {
+          f.setLinkage(llvm::GlobalValue::ExternalLinkage);
+          f.setVisibility(llvm::GlobalValue::HiddenVisibility);
+        }
+      }
+    });
+
+    if (options.callGraph != nullptr && threads > 1) {
+      precompiler =
+          std::make_unique<Precompiler>(**lazyJit, options.callGraph);
+    }
+    auto *ahead = precompiler.get();
+    auto optimize = options.optimize;
+    (*lazyJit)->getIRTransformLayer().setTransform(
+        [ahead, optimize](llvm::orc::ThreadSafeModule partition,
+                          const llvm::orc::MaterializationResponsibility &)
+            -> llvm::Expected<llvm::orc::ThreadSafeModule> {
+          partition.withModuleDo([&](llvm::Module &partitionModule) {
+            if (optimize) {
+              optimize(&partitionModule);
+            }
+            for (auto &f : partitionModule) {
+              if (ahead != nullptr && !f.isDeclaration()) {
+                ahead->compiled(f.getName().str());
+              }
+            }
+          });
+          return std::move(partition);
+        });
+
+    if (auto error = defineRuntime(**lazyJit)) {
+      return reportError(std::move(error));
+    }
+    if (auto error = (*lazyJit)->addLazyIRModule(std::move(program))) {
+      return reportError(std::move(error));
+    }
+    jit = std::move(*lazyJit);
+  } else {
+    auto eagerJit = llvm::orc::LLJITBuilder().create();
+    if (!eagerJit) {
+      return reportError(eagerJit.takeError());
+    }
+    if (auto error = defineRuntime(**eagerJit)) {
+      return reportError(std::move(error));
+    }
+    if (auto error = (*eagerJit)->addIRModule(std::move(program))) {
+      return reportError(std::move(error));
+    }
+    jit = std::move(*eagerJit);
+  }
+
+  auto tipMain = jit->lookup("_tip_main");
+  if (!tipMain) {
+    return reportError(tipMain.takeError());
+  }
+  auto numInputs = jit->lookup("_tip_num_inputs");
+  if (!numInputs) {
+    return reportError(numInputs.takeError());
+  }
+  auto inputArray = jit->lookup("_tip_input_array");
+  if (!inputArray) {
+    return reportError(inputArray.takeError());
+  }
+
+  std::vector<char *> argv;
+  argv.push_back(const_cast<char *>(m->getModuleIdentifier().c_str()));
+  for (auto &arg : args) {
+    argv.push_back(const_cast<char *>(arg.c_str()));
+  }
+  argv.push_back(nullptr);
+
+  LOG_S(1) << "Running " << m->getModuleIdentifier();
+  return _tip_start(tipMain->toPtr<int64_t (*)()>(),
+                    *numInputs->toPtr<int64_t *>(),
+                    inputArray->toPtr<int64_t *>(), argv.size() - 1,
+                    argv.data());
+}
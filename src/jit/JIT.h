@@ -0,0 +1,53 @@
+#pragma once
+
+#include "llvm/IR/Module.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+class CallGraph;
+
+/*! \struct JITOptions
+ *  \brief Settings for running a program in memory.
+ */
+struct JITOptions {
+  //! Compile each function on its first call instead of the whole module
+  bool lazy = false;
+
+  //! Optimizes the module holding each function compiled in lazy mode
+  std::function<void(llvm::Module *)> optimize;
+
+  //! Call graph of the program, whose callees are compiled ahead in lazy mode
+  CallGraph *callGraph = nullptr;
+
+  //! Number of threads compiling functions in lazy mode, 0 for one per core
+  unsigned threads = 0;
+};
+
+/*! \class JIT
+ *  \brief Routines to run a compiled program within tipc.
+ *
+ * The program is compiled to memory with the ORC LLJIT and linked against
+ * the runtime library that is built into tipc, so nothing is written to disk.
+ *
+ * In lazy mode every function, including those reached through the function
+ * table, starts out as a stub that optimizes and compiles the function on its
+ * first call.  When a function is compiled, its callees in the call graph are
+ * compiled ahead of their first call by a pool of threads.
+ */
+class JIT {
+public:
+  /*! \fn run
+   *  \brief Compile a module in memory and run its main function.
+   *
+   * The arguments are read into the inputs of the TIP main function, as the
+   * runtime library does for a native executable.  Runtime errors exit the
+   * process with their usual status.
+   * \param m the LLVM module holding the generated program
+   * \param args the arguments of the TIP main function
+   * \param options settings for compilation
+   * \return the exit status of the program, or -1 if it could not be compiled
+   */
+  static int run(llvm::Module *m, const std::vector<std::string> &args,
+                 const JITOptions &options = JITOptions());
+};
@@ -0,0 +1,31 @@
+#include "Compiler.h"
+
+#include "CodeGenerator.h"
+#include "FrontEnd.h"
+
+#include "loguru.hpp"
+
+std::unique_ptr<Compilation>
+Compiler::compile(std::istream &source, const std::string &name,
+                  const CompilerOptions &options) {
+  LOG_S(1) << "Compiling " << name;
+
+  std::unique_ptr<Compilation> compilation(new Compilation());
+  compilation->context = std::make_unique<llvm::LLVMContext>();
+
+  compilation->ast = FrontEnd::parse(source);
+  compilation->analysis =
+      SemanticAnalysis::analyze(compilation->ast.get(), options.polymorphic);
+  compilation->module = CodeGenerator::generate(
+      compilation->ast.get(), compilation->analysis.get(), name,
+      *compilation->context, options.codeGen);
+
+  if (options.optimize) {
+    OptimizerOptions optimizerOptions = options.optimizer;
+    optimizerOptions.callGraph = compilation->analysis->getCallGraph();
+    Optimizer::optimize(compilation->module.get(), options.optimizations,
+                        optimizerOptions);
+  }
+
+  return compilation;
+}
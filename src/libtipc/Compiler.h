@@ -0,0 +1,79 @@
+#pragma once
+
+#include "ASTProgram.h"
+#include "CodeGenOptions.h"
+#include "Optimizer.h"
+#include "SemanticAnalysis.h"
+#include "llvm/IR/LLVMContext.h"
+#include "llvm/IR/Module.h"
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+
+/*! \struct CompilerOptions
+ *  \brief Settings for compiling a program to an LLVM module.
+ */
+struct CompilerOptions {
+  //! Perform polymorphic type inference
+  bool polymorphic = false;
+
+  //! Run the optimizer on the generated module
+  bool optimize = true;
+
+  //! The optional passes run by the optimizer
+  std::vector<Optimization> optimizations;
+
+  //! The code generation strategies to use
+  CodeGenOptions codeGen;
+
+  //! Settings for the optimizer, whose call graph is that of the program
+  OptimizerOptions optimizer;
+};
+
+/*! \class Compilation
+ *  \brief The result of compiling a program.
+ *
+ * A compilation owns the LLVM context of its module, along with the AST and
+ * the semantic analysis results that the module was generated from.  The
+ * module is destroyed before its context.
+ */
+class Compilation {
+  std::unique_ptr<llvm::LLVMContext> context;
+  std::shared_ptr<ASTProgram> ast;
+  std::shared_ptr<SemanticAnalysis> analysis;
+  std::shared_ptr<llvm::Module> module;
+
+  friend class Compiler;
+
+public:
+  llvm::LLVMContext &getContext() const { return *context; }
+  ASTProgram *getProgram() const { return ast.get(); }
+  SemanticAnalysis *getAnalysis() const { return analysis.get(); }
+  llvm::Module *getModule() const { return module.get(); }
+};
+
+/*! \class Compiler
+ *  \brief Routines to compile programs to LLVM modules in memory.
+ *
+ * Every compilation keeps its state to itself, from the parser to the LLVM
+ * context of its module, so any number of programs may be compiled
+ * concurrently, each on a thread of its own.
+ */
+class Compiler {
+public:
+  /*! \fn compile
+   *  \brief Compile a program to an LLVM module.
+   *
+   * The program is parsed, checked, and translated to LLVM IR, which is then
+   * optimized unless disabled by the options.  Errors in the program are
+   * reported by throwing a ParseError or a SemanticError.
+   * \param source the stream holding the program
+   * \param name the name of the module, usually the source file name
+   * \param options settings for the compilation
+   * \return the compilation holding the module
+   */
+  static std::unique_ptr<Compilation>
+  compile(std::istream &source, const std::string &name,
+          const CompilerOptions &options = CompilerOptions());
+};
@@ -1,6 +1,15 @@
 #include "Optimizer.h"
+#include "Backend.h"
+#include "CallGraph.h"
+#include "InternalError.h"
 
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
 #include "llvm/Passes/PassBuilder.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Target/TargetMachine.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
 
 #include "llvm/Transforms/InstCombine/InstCombine.h"
 #include "llvm/Transforms/Scalar/GVN.h"
@@ -14,69 +23,173 @@
 #include "llvm/Transforms/Scalar/LoopUnrollPass.h"
 #include "llvm/Transforms/IPO/MergeFunctions.h"
 #include "llvm/Transforms/Scalar/LoopRotation.h"
+#include "llvm/Transforms/Scalar/TailRecursionElimination.h"
+#include "llvm/Analysis/InlineCost.h"
+#include "llvm/Transforms/IPO/Inliner.h"
+#include "llvm/Transforms/Vectorize/LoopVectorize.h"
+#include "llvm/Transforms/Vectorize/SLPVectorizer.h"
 
 // For logging
 #include "loguru.hpp"
 
+#include <algorithm>
+#include <map>
+#include <set>
+
 // From project5demo branch in tipc repo 
 namespace { // Anonymous namespace for local function
 	    
-bool contains(Optimization o, llvm::cl::list<Optimization> &l) {
+bool contains(Optimization o, const std::vector<Optimization> &l) {
   for (unsigned i = 0; i != l.size(); ++i) {
     if (o == l[i]) return true;
   }
   return false;
 }
 
+/*
+ * Tail recursion elimination skips functions that contain "musttail" calls,
+ * which codegen emits for calls in tail position.  Self-recursive calls are
+ * relaxed to ordinary tail calls so that they can be turned into loops.
+ */
+struct RelaxSelfMustTailPass : llvm::PassInfoMixin<RelaxSelfMustTailPass> {
+  llvm::PreservedAnalyses run(llvm::Function &F,
+                              llvm::FunctionAnalysisManager &) {
+    bool changed = false;
+    for (auto &BB : F) {
+      for (auto &I : BB) {
+        auto *call = llvm::dyn_cast<llvm::CallInst>(&I);
+        if (call != nullptr && call->isMustTailCall() &&
+            call->getCalledFunction() == &F) {
+          call->setTailCallKind(llvm::CallInst::TCK_Tail);
+          changed = true;
+        }
+      }
+    }
+    return changed ? llvm::PreservedAnalyses::none()
+                   : llvm::PreservedAnalyses::all();
+  }
+};
+
+llvm::OptimizationLevel toOptimizationLevel(char level) {
+  switch (level) {
+  case '0':
+    return llvm::OptimizationLevel::O0;
+  case '1':
+    return llvm::OptimizationLevel::O1;
+  case '2':
+    return llvm::OptimizationLevel::O2;
+  case 's':
+    return llvm::OptimizationLevel::Os;
+  case 'z':
+    return llvm::OptimizationLevel::Oz;
+  default:
+    return llvm::OptimizationLevel::O3;
+  }
 }
 
+// Check whether f can reach itself through the call graph
+bool isRecursive(ASTFunction *f, CallGraph *callGraph) {
+  std::set<ASTFunction *> visited;
+  std::vector<ASTFunction *> worklist(1, f);
+  while (!worklist.empty()) {
+    auto *caller = worklist.back();
+    worklist.pop_back();
+    for (auto *callee : callGraph->getCallees(caller)) {
+      if (callee == f) {
+        return true;
+      }
+      if (visited.insert(callee).second) {
+        worklist.push_back(callee);
+      }
+    }
+  }
+  return false;
+}
 
-//  Minimal optimization pass using LLVM pass managers
-void Optimizer::optimize(llvm::Module *theModule, 
-                llvm::cl::list<Optimization> &enabledOpts) {
-  LOG_S(1) << "Optimizing program " << theModule->getName().str();
+/*
+ * Use the TIP call graph to guide the inliner.  A non-recursive function with
+ * a single caller is always inlined, since its body is then needed only
+ * once.  Leaf functions are hinted as profitable, since inlining them leaves
+ * no calls behind.
+ */
+void addInliningHints(llvm::Module *theModule, CallGraph *callGraph) {
+  for (auto *f : callGraph->getVertices()) {
+    auto *llvmFun = theModule->getFunction(f->getName());
+    if (llvmFun == nullptr || llvmFun->isDeclaration() ||
+        f->getName() == "main") {
+      continue;
+    }
 
-  // New pass builder
-  llvm::PassBuilder passBuilder;
+    if (callGraph->getCallees(f).empty()) {
+      LOG_S(1) << "Inliner: hint to inline leaf function " << f->getName();
+      llvmFun->addFnAttr(llvm::Attribute::InlineHint);
+    }
 
-  // Setting-up Analysis Managers for different granularities of optimizations
-  llvm::FunctionAnalysisManager functionAnalysisManager;
-  llvm::ModuleAnalysisManager moduleAnalysisManager;
-  llvm::LoopAnalysisManager loopAnalysisManager;
-  llvm::CGSCCAnalysisManager cgsccAnalysisManager;
-
-  // Registering the analysis managers with the pass builder
-  passBuilder.registerModuleAnalyses(moduleAnalysisManager);
-  passBuilder.registerCGSCCAnalyses(cgsccAnalysisManager);
-  passBuilder.registerFunctionAnalyses(functionAnalysisManager);
-  passBuilder.registerLoopAnalyses(loopAnalysisManager);
-
-  // Cross Register Proxies so that analysis results can be reused as needed.
-  passBuilder.crossRegisterProxies(loopAnalysisManager, functionAnalysisManager,
-                                   cgsccAnalysisManager, moduleAnalysisManager);
-
-  // Initiating Function and Module level PassManagers
-  llvm::ModulePassManager modulePassManager;
+    if (callGraph->getCallers(f).size() == 1 && !isRecursive(f, callGraph)) {
+      LOG_S(1) << "Inliner: always inline single caller function "
+               << f->getName();
+      llvmFun->addFnAttr(llvm::Attribute::AlwaysInline);
+    }
+  }
+}
+
+/*
+ * The analysis managers of a pass builder.  They are declared in this order
+ * so that they are destroyed in the right order, since they refer to each
+ * other through their proxies.
+ */
+struct AnalysisManagers {
+  llvm::LoopAnalysisManager loop;
+  llvm::FunctionAnalysisManager function;
+  llvm::CGSCCAnalysisManager cgscc;
+  llvm::ModuleAnalysisManager module;
+
+  explicit AnalysisManagers(llvm::PassBuilder &passBuilder) {
+    passBuilder.registerModuleAnalyses(module);
+    passBuilder.registerCGSCCAnalyses(cgscc);
+    passBuilder.registerFunctionAnalyses(function);
+    passBuilder.registerLoopAnalyses(loop);
+
+    // Cross Register Proxies so that analysis results can be reused as needed.
+    passBuilder.crossRegisterProxies(loop, function, cgscc, module);
+  }
+
+  // Forget every result, once the code was changed outside the pass managers
+  void clear() {
+    loop.clear();
+    function.clear();
+    cgscc.clear();
+    module.clear();
+  }
+};
+
+/*
+ * The function passes: the basic passes, unless the standard pipeline is
+ * used, followed by the enabled optional passes.  The pipeline is built
+ * once for every thread that runs it.
+ */
+llvm::FunctionPassManager
+buildFunctionPipeline(const std::vector<Optimization> &enabledOpts,
+                      bool standardPipeline) {
   llvm::FunctionPassManager functionPassManager;
-  llvm::LoopPassManager loopPassManagerWithMSSA;
   llvm::LoopPassManager loopPassManager;
 
-  // Adding passes to the pipeline
-
-  // Constructs SSA and is a pre-requisite for many other passes
-  functionPassManager.addPass(llvm::PromotePass());
+  if (!standardPipeline) {
+    // Constructs SSA and is a pre-requisite for many other passes
+    functionPassManager.addPass(llvm::PromotePass());
 
-  // Instruction combine pass scans for a variety of patterns and replaces bitcodes matched with improvements.
-  functionPassManager.addPass(llvm::InstCombinePass());
+    // Instruction combine pass scans for a variety of patterns and replaces bitcodes matched with improvements.
+    functionPassManager.addPass(llvm::InstCombinePass());
 
-  // Reassociate expressions.
-  functionPassManager.addPass(llvm::ReassociatePass());
+    // Reassociate expressions.
+    functionPassManager.addPass(llvm::ReassociatePass());
 
-  // Eliminate Common SubExpressions using the Global Value Numbering (GVN) algorithm.
-  functionPassManager.addPass(llvm::GVNPass());
+    // Eliminate Common SubExpressions using the Global Value Numbering (GVN) algorithm.
+    functionPassManager.addPass(llvm::GVNPass());
 
-  // Simplify the control flow graph (deleting unreachable blocks, etc).
-  functionPassManager.addPass(llvm::SimplifyCFGPass());
+    // Simplify the control flow graph (deleting unreachable blocks, etc).
+    functionPassManager.addPass(llvm::SimplifyCFGPass());
+  }
 
   // Begin SIP extension
 
@@ -99,23 +212,363 @@ void Optimizer::optimize(llvm::Module *theModule,
     functionPassManager.addPass(llvm::LoopUnrollPass(unrollOptions)); 
   }
 
-  // merge function pass
-  if (contains(mfp, enabledOpts)){
-    modulePassManager.addPass(llvm::MergeFunctionsPass());
-  }
-
   // loop rotation pass
   if (contains(lrp, enabledOpts)) {
     loopPassManager.addPass(llvm::LoopRotatePass());
   }
 
-  functionPassManager.addPass(
-      createFunctionToLoopPassAdaptor(std::move(loopPassManager)));
+  // loops are rotated so that the vectorizer can handle them
+  if (contains(vec, enabledOpts) && !contains(lrp, enabledOpts) &&
+      !standardPipeline) {
+    loopPassManager.addPass(llvm::LoopRotatePass());
+  }
+
+  // tail recursion elimination
+  if (contains(tre, enabledOpts)) {
+    functionPassManager.addPass(RelaxSelfMustTailPass());
+    functionPassManager.addPass(llvm::TailCallElimPass());
+  }
+
+  // The standard pipeline is only extended with the passes that were enabled
+  if (!standardPipeline || !loopPassManager.isEmpty()) {
+    functionPassManager.addPass(
+        createFunctionToLoopPassAdaptor(std::move(loopPassManager)));
+  }
+
+  // loop and SLP vectorization, the standard pipeline includes these already
+  if (contains(vec, enabledOpts) && !standardPipeline) {
+    functionPassManager.addPass(llvm::LoopVectorizePass());
+    functionPassManager.addPass(llvm::SLPVectorizerPass());
+    functionPassManager.addPass(llvm::InstCombinePass());
+  }
+
+  return functionPassManager;
+}
+
+// What each thread needs to run the function passes on its own
+struct FunctionPipeline {
+  const std::vector<Optimization> &enabledOpts;
+  bool standardPipeline;
+  llvm::PipelineTuningOptions tuningOptions;
+  llvm::TargetMachine *targetMachine;
+};
+
+std::string writeBitcode(llvm::Module &m) {
+  std::string bitcode;
+  llvm::raw_string_ostream stream(bitcode);
+  llvm::WriteBitcodeToFile(m, stream);
+  stream.flush();
+  return bitcode;
+}
+
+std::unique_ptr<llvm::Module> readBitcode(const std::string &bitcode,
+                                          llvm::LLVMContext &context) {
+  return llvm::cantFail(llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(bitcode, "partition"), context));
+}
+
+/*
+ * Assign the defined functions to partitions of about the same number of
+ * instructions.  The largest functions are placed first, each in the
+ * partition holding the fewest instructions so far.
+ */
+std::vector<std::set<std::string>> partitionFunctions(llvm::Module *theModule,
+                                                      unsigned jobs) {
+  std::vector<llvm::Function *> functions;
+  for (auto &fun : *theModule) {
+    if (!fun.isDeclaration()) {
+      functions.push_back(&fun);
+    }
+  }
+  std::stable_sort(functions.begin(), functions.end(),
+                   [](llvm::Function *f, llvm::Function *g) {
+                     return f->getInstructionCount() >
+                            g->getInstructionCount();
+                   });
+
+  std::vector<std::set<std::string>> partitions(
+      std::min<size_t>(jobs, functions.size()));
+  std::vector<unsigned> sizes(partitions.size(), 0);
+  for (auto *fun : functions) {
+    auto smallest = std::min_element(sizes.begin(), sizes.end()) - sizes.begin();
+    partitions[smallest].insert(fun->getName().str());
+    sizes[smallest] += fun->getInstructionCount();
+  }
+  return partitions;
+}
+
+/*
+ * Run the function passes on the functions defined in a partition, which
+ * is read into a context of its own so that no LLVM state is shared with
+ * the other threads.  The optimized partition is returned as bitcode.
+ */
+std::string optimizePartition(const std::string &bitcode,
+                              const FunctionPipeline &pipeline) {
+  llvm::LLVMContext context;
+  auto partition = readBitcode(bitcode, context);
+
+  std::unique_ptr<llvm::TargetMachine> targetMachine;
+  if (pipeline.targetMachine != nullptr) {
+    targetMachine = Backend::cloneTargetMachine(*pipeline.targetMachine);
+  }
+  llvm::PassBuilder passBuilder(targetMachine.get(), pipeline.tuningOptions);
+  if (targetMachine != nullptr) {
+    targetMachine->registerPassBuilderCallbacks(passBuilder);
+  }
+  AnalysisManagers analysisManagers(passBuilder);
+
+  llvm::ModulePassManager modulePassManager;
+  modulePassManager.addPass(createModuleToFunctionPassAdaptor(
+      buildFunctionPipeline(pipeline.enabledOpts, pipeline.standardPipeline),
+      true));
+  modulePassManager.run(*partition, analysisManagers.module);
+
+  return writeBitcode(*partition);
+}
+
+// Maps the struct types of a partition read back into the context of the
+// program, which are renamed by the reader, to the types of the program.
+class StructTypeRemapper : public llvm::ValueMapTypeRemapper {
+public:
+  StructTypeRemapper(llvm::Module &partition, llvm::LLVMContext &context) {
+    for (auto *type : partition.getIdentifiedStructTypes()) {
+      auto *original = llvm::StructType::getTypeByName(
+          context, type->getName().rsplit('.').first);
+      if (original != nullptr && original != type &&
+          original->isLayoutIdentical(type)) {
+        types[type] = original;
+      }
+    }
+  }
+
+  llvm::Type *remapType(llvm::Type *type) override {
+    auto mapped = types.find(type);
+    return mapped == types.end() ? type : mapped->second;
+  }
+
+private:
+  std::map<llvm::Type *, llvm::Type *> types;
+};
+
+/*
+ * Move the optimized function bodies of a partition into the program.  The
+ * values of the partition refer to the values of the program with the same
+ * name, except for local values that the passes of an earlier partition
+ * added, which are kept apart.
+ */
+void mergePartition(llvm::Module *theModule, llvm::Module &partition,
+                    std::set<llvm::GlobalValue *> &added) {
+  StructTypeRemapper types(partition, theModule->getContext());
+  llvm::ValueToValueMapTy valueMap;
+  // each added variable with the variable of the partition it was made for,
+  // since a name that collides with an earlier partition's is changed
+  std::vector<std::pair<llvm::GlobalVariable *, llvm::GlobalVariable *>>
+      addedVariables;
+
+  for (auto &value : partition.global_values()) {
+    auto *target = theModule->getNamedValue(value.getName());
+    if (target != nullptr &&
+        (added.count(target) == 0 || !target->hasLocalLinkage())) {
+      valueMap[&value] = target;
+      continue;
+    }
+
+    if (auto *fun = llvm::dyn_cast<llvm::Function>(&value)) {
+      auto *newFun =
+          llvm::Function::Create(fun->getFunctionType(), fun->getLinkage(),
+                                 fun->getName(), theModule);
+      newFun->copyAttributesFrom(fun);
+      target = newFun;
+    } else if (auto *var = llvm::dyn_cast<llvm::GlobalVariable>(&value)) {
+      auto *newVar = new llvm::GlobalVariable(
+          *theModule, types.remapType(var->getValueType()), var->isConstant(),
+          var->getLinkage(), nullptr, var->getName());
+      newVar->copyAttributesFrom(var);
+      addedVariables.emplace_back(newVar, var);
+      target = newVar;
+    } else {
+      throw InternalError("unexpected global value in an optimized partition");
+    }
+    added.insert(target);
+    valueMap[&value] = target;
+  }
+
+  auto flags = llvm::RF_NoModuleLevelChanges | llvm::RF_IgnoreMissingLocals;
+  for (auto [var, original] : addedVariables) {
+    if (original->hasInitializer()) {
+      var->setInitializer(llvm::MapValue(original->getInitializer(), valueMap,
+                                         flags, &types));
+    }
+  }
+
+  for (auto &fun : partition) {
+    if (fun.isDeclaration()) {
+      continue;
+    }
+    auto *target = llvm::cast<llvm::Function>(valueMap[&fun]);
+    auto linkage = target->getLinkage();
+    target->deleteBody();
+    target->setLinkage(linkage);
+    target->setAttributes(fun.getAttributes());
+    for (size_t i = 0; i < fun.arg_size(); i++) {
+      valueMap[fun.getArg(i)] = target->getArg(i);
+    }
+    target->splice(target->end(), &fun);
+    llvm::RemapFunction(*target, valueMap, flags, &types);
+  }
+}
+
+/*
+ * Run the function passes over the functions of a module on several
+ * threads.  The module is cloned once per partition, with the bodies of the
+ * functions of the partition and the initializers of all global variables,
+ * so that loads from the function table still fold to direct calls.  The
+ * optimized bodies are merged back in the order of the partitions, so the
+ * result does not depend on the order in which the threads finish.
+ */
+void optimizeInParallel(llvm::Module *theModule,
+                        const FunctionPipeline &pipeline, unsigned jobs) {
+  auto partitions = partitionFunctions(theModule, jobs);
+  LOG_S(1) << "Optimizing functions of " << theModule->getName().str()
+           << " in " << partitions.size() << " partitions";
+
+  std::vector<std::string> bitcode;
+  for (auto &functions : partitions) {
+    llvm::ValueToValueMapTy valueMap;
+    auto partition = llvm::CloneModule(
+        *theModule, valueMap, [&](const llvm::GlobalValue *value) {
+          return llvm::isa<llvm::GlobalVariable>(value) ||
+                 functions.count(value->getName().str()) != 0;
+        });
+    bitcode.push_back(writeBitcode(*partition));
+  }
+
+  std::vector<std::string> optimized(partitions.size());
+  {
+    llvm::ThreadPool threads(llvm::hardware_concurrency(partitions.size()));
+    for (size_t i = 0; i < partitions.size(); i++) {
+      threads.async([&, i]() {
+        optimized[i] = optimizePartition(bitcode[i], pipeline);
+      });
+    }
+    threads.wait();
+  }
+
+  std::set<llvm::GlobalValue *> added;
+  for (auto &result : optimized) {
+    auto partition = readBitcode(result, theModule->getContext());
+    mergePartition(theModule, *partition, added);
+  }
+}
+
+}
+
+
+//  Minimal optimization pass using LLVM pass managers
+void Optimizer::optimize(llvm::Module *theModule, 
+                const std::vector<Optimization> &enabledOpts,
+                const OptimizerOptions &options) {
+  LOG_S(1) << "Optimizing program " << theModule->getName().str();
+
+  bool standardPipeline = options.level != '\0';
+
+  // The target machine gives the passes the cost models of the CPU
+  auto targetMachine = Backend::createTargetMachine(theModule, options.cpu,
+                                                    options.features);
+
+  // The threshold also applies to the inliner of the standard pipeline
+  llvm::PipelineTuningOptions tuningOptions;
+  if (contains(inl, enabledOpts)) {
+    tuningOptions.InlinerThreshold = options.inlineThreshold;
+  }
+
+  // Vectorize at the levels where clang does, or when requested
+  bool vectorize = contains(vec, enabledOpts) ||
+                   std::string("23s").find(options.level) != std::string::npos;
+  tuningOptions.LoopVectorization = vectorize;
+  tuningOptions.SLPVectorization = vectorize;
+
+  // New pass builder, which registers the analyses of the target machine
+  llvm::PassBuilder passBuilder(targetMachine.get(), tuningOptions);
+  if (targetMachine != nullptr) {
+    targetMachine->registerPassBuilderCallbacks(passBuilder);
+  }
+
+  // Self-recursive tail calls must be relaxed before the standard pipeline
+  // runs its own tail recursion elimination
+  if (standardPipeline && contains(tre, enabledOpts)) {
+    passBuilder.registerPeepholeEPCallback(
+        [](llvm::FunctionPassManager &fpm, llvm::OptimizationLevel) {
+          fpm.addPass(RelaxSelfMustTailPass());
+        });
+  }
+
+  // Setting-up Analysis Managers for different granularities of optimizations
+  AnalysisManagers analysisManagers(passBuilder);
+
+  // Initiating the module level PassManager
+  llvm::ModulePassManager modulePassManager;
+
+  if (contains(inl, enabledOpts) && options.callGraph != nullptr) {
+    addInliningHints(theModule, options.callGraph);
+  }
+
+  // Adding passes to the pipeline
+
+  if (standardPipeline) {
+    // The standard pipeline for the level, which includes the inliner
+    auto level = toOptimizationLevel(options.level);
+    if (level == llvm::OptimizationLevel::O0) {
+      modulePassManager = passBuilder.buildO0DefaultPipeline(level);
+    } else {
+      modulePassManager = passBuilder.buildPerModuleDefaultPipeline(level);
+    }
+  }
+
+  // merge function pass
+  if (contains(mfp, enabledOpts)){
+    modulePassManager.addPass(llvm::MergeFunctionsPass());
+  }
 
   // Passing the function pass manager to the modulePassManager using a function
   // adaptor, then passing theModule to the ModulePassManager along with
-  // ModuleAnalysisManager.
-  modulePassManager.addPass(
-      createModuleToFunctionPassAdaptor(std::move(functionPassManager), true));
-  modulePassManager.run(*theModule, moduleAnalysisManager);
+  // ModuleAnalysisManager.  With several jobs the function passes instead run
+  // on partitions of the module once the module passes before them are done.
+  // The standard pipeline is one module pass, whose function simplification
+  // runs inside its inliner, so with a level only the optional function
+  // passes are partitioned.
+  auto functionPassManager = buildFunctionPipeline(enabledOpts, standardPipeline);
+  if (!standardPipeline || !functionPassManager.isEmpty()) {
+    if (options.jobs > 1) {
+      modulePassManager.run(*theModule, analysisManagers.module);
+      modulePassManager = llvm::ModulePassManager();
+
+      FunctionPipeline pipeline{enabledOpts, standardPipeline, tuningOptions,
+                                targetMachine.get()};
+      optimizeInParallel(theModule, pipeline, options.jobs);
+      analysisManagers.clear();
+    } else {
+      modulePassManager.addPass(createModuleToFunctionPassAdaptor(
+          std::move(functionPassManager), true));
+    }
+  }
+
+  // inliner, run once calls through the function table have become direct
+  if (contains(inl, enabledOpts) && !standardPipeline) {
+    llvm::ModuleInlinerWrapperPass inliner(
+        llvm::getInlineParams(options.inlineThreshold));
+
+    // Simplify the callers in bottom-up order so that inlining decisions
+    // further up the call graph see the reduced function sizes
+    llvm::FunctionPassManager inlineCleanup;
+    inlineCleanup.addPass(llvm::InstCombinePass());
+    inlineCleanup.addPass(llvm::GVNPass());
+    inlineCleanup.addPass(llvm::SimplifyCFGPass());
+    inliner.getPM().addPass(
+        llvm::createCGSCCToFunctionPassAdaptor(std::move(inlineCleanup)));
+
+    modulePassManager.addPass(std::move(inliner));
+  }
+
+  modulePassManager.run(*theModule, analysisManagers.module);
 }
@@ -3,8 +3,42 @@
 #include "llvm/IR/Module.h"
 #include "llvm/Support/CommandLine.h"
 
+#include <vector>
+
+class CallGraph;
+
 enum Optimization {
-  adce, ivs, lup, mfp, lrp
+  adce, ivs, lup, mfp, lrp, tre, inl, vec
+};
+
+/*! \struct OptimizerOptions
+ *  \brief Settings that tune the optimization pipeline.
+ */
+struct OptimizerOptions {
+  /*! Level of the standard LLVM pipeline: '0'-'3', 's' or 'z'.  When unset
+   * the legacy pipeline of basic passes is used.
+   */
+  char level = '\0';
+
+  //! Call graph of the program, used for inlining hints
+  CallGraph *callGraph = nullptr;
+
+  //! Cost threshold of the inliner
+  int inlineThreshold = 225;
+
+  //! Target CPU for the cost models, "native" selects the host CPU
+  std::string cpu = "native";
+
+  /*! Target features, e.g., "+avx2,-fma", for the cost models; "native"
+   * selects the features of the host CPU
+   */
+  std::string features = "native";
+
+  /*! Number of threads that run the function passes.  The standard pipeline
+   * selected by level runs its own function passes on one thread, so only
+   * the basic passes and the optional passes are run on several.
+   */
+  unsigned jobs = 1;
 };
 
 /*! \class Optimizer
@@ -14,9 +48,19 @@ class Optimizer {
 public:
   /*! \brief optimize LLVM module.
    *
-   * Apply a series of basic optimization passes to the given LLVM module.
+   * Apply either the standard LLVM pipeline for an optimization level or a
+   * series of basic optimization passes to the given LLVM module, followed by
+   * the enabled optional passes.
+   *
+   * With more than one job, the function passes run concurrently on
+   * partitions of the module, each in a context of its own, and the optimized
+   * functions are merged back in a fixed order.  The module passes run on the
+   * whole module before and after them.
    * \param theModule an LLVM module to be optimized
+   * \param enabledOpts the optional passes to run
+   * \param options settings for the pipeline
    */
   static void optimize(llvm::Module *theModule, 
-		                   llvm::cl::list<Optimization> &enabledOpts);
+		                   const std::vector<Optimization> &enabledOpts,
+		                   const OptimizerOptions &options = OptimizerOptions());
 };
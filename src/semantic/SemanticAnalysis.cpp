@@ -8,7 +8,10 @@ std::shared_ptr<SemanticAnalysis> SemanticAnalysis::analyze(ASTProgram *ast,
   auto callGraph = CallGraph::build(ast, symTable.get());
   auto typeResults =
       TypeInference::run(ast, polyInf, callGraph.get(), symTable.get());
-  return std::make_shared<SemanticAnalysis>(symTable, typeResults, callGraph);
+  auto escapeResults = EscapeAnalysis::analyze(ast);
+  auto boundsResults = BoundsAnalysis::analyze(ast);
+  return std::make_shared<SemanticAnalysis>(symTable, typeResults, callGraph,
+                                            escapeResults, boundsResults);
 }
 
 SymbolTable *SemanticAnalysis::getSymbolTable() { return symTable.get(); };
@@ -16,3 +19,11 @@ SymbolTable *SemanticAnalysis::getSymbolTable() { return symTable.get(); };
 TypeInference *SemanticAnalysis::getTypeResults() { return typeResults.get(); };
 
 CallGraph *SemanticAnalysis::getCallGraph() { return callGraph.get(); };
+
+EscapeAnalysis *SemanticAnalysis::getEscapeResults() {
+  return escapeResults.get();
+};
+
+BoundsAnalysis *SemanticAnalysis::getBoundsResults() {
+  return boundsResults.get();
+};
@@ -5,6 +5,8 @@
 #include "SymbolTable.h"
 #include "TypeInference.h"
 #include "cfa/CallGraph.h" //call graph builder header
+#include "bounds/BoundsAnalysis.h"
+#include "escape/EscapeAnalysis.h"
 #include <memory>
 
 /*! \class SemanticAnalysis
@@ -12,20 +14,26 @@
  *
  * This class provides the analyze method to run a set of semantic analyses,
  * including l-value checking for assignment statements, proper use of symbols,
- * and type checking and control flow analysis \sa SymbolTable \sa TypeInference
- * \sa CallGraph
+ * type checking, control flow analysis, escape analysis and bounds check
+ * analysis \sa SymbolTable \sa TypeInference \sa CallGraph \sa EscapeAnalysis
+ * \sa BoundsAnalysis
  */
 class SemanticAnalysis {
   std::shared_ptr<SymbolTable> symTable;
   std::shared_ptr<TypeInference> typeResults;
   std::shared_ptr<CallGraph> callGraph;
+  std::shared_ptr<EscapeAnalysis> escapeResults;
+  std::shared_ptr<BoundsAnalysis> boundsResults;
 
 public:
   SemanticAnalysis(std::shared_ptr<SymbolTable> s,
                    std::shared_ptr<TypeInference> t,
-                   std::shared_ptr<CallGraph> cg)
+                   std::shared_ptr<CallGraph> cg,
+                   std::shared_ptr<EscapeAnalysis> e,
+                   std::shared_ptr<BoundsAnalysis> b)
       : symTable(std::move(s)), typeResults(std::move(t)),
-        callGraph(std::move(cg)) {}
+        callGraph(std::move(cg)), escapeResults(std::move(e)),
+        boundsResults(std::move(b)) {}
 
   /*! \fn analyze
    *  \brief Perform semantic analysis on program AST.
@@ -57,4 +65,16 @@ public:
    * \sa CallGraph
    */
   CallGraph *getCallGraph();
+
+  /*! \fn getEscapeResults
+   *  \brief Returns the escape analysis results.
+   * \sa EscapeAnalysis
+   */
+  EscapeAnalysis *getEscapeResults();
+
+  /*! \fn getBoundsResults
+   *  \brief Returns the bounds check analysis results.
+   * \sa BoundsAnalysis
+   */
+  BoundsAnalysis *getBoundsResults();
 };
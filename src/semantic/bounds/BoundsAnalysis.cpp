@@ -0,0 +1,27 @@
+#include "BoundsAnalysis.h"
+#include "BoundsVisitor.h"
+
+std::shared_ptr<BoundsAnalysis> BoundsAnalysis::analyze(ASTProgram *ast) {
+  BoundsVisitor visitor;
+  ast->accept(&visitor);
+  return std::make_shared<BoundsAnalysis>(visitor.getLowerSafe(),
+                                          visitor.getUpperSafe(),
+                                          visitor.getVersioned());
+}
+
+bool BoundsAnalysis::needsLowerCheck(ASTArrayRefExpr *ref) {
+  return lowerSafe.count(ref) == 0;
+}
+
+bool BoundsAnalysis::needsUpperCheck(ASTArrayRefExpr *ref) {
+  return upperSafe.count(ref) == 0;
+}
+
+std::vector<ASTArrayRefExpr *>
+BoundsAnalysis::getVersionedChecks(ASTForRangeStmt *loop) {
+  auto it = versioned.find(loop);
+  if (it == versioned.end()) {
+    return {};
+  }
+  return it->second;
+}
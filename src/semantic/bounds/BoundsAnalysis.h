@@ -0,0 +1,80 @@
+#pragma once
+
+#include "ASTArrayRefExpr.h"
+#include "ASTForRangeStmt.h"
+#include "ASTProgram.h"
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+/*! \class BoundsAnalysis
+ *  \brief Identifies array accesses whose bounds checks are redundant.
+ *
+ * The analysis bounds the values of loop induction variables.  For a range
+ * loop whose element is a local variable that the body never modifies, the
+ * element lies in [lower, upper) with lower the initial value, so an index
+ * that is the element cannot underflow when the lower bound is a
+ * non-negative constant or an array length and the step is positive.  When
+ * the upper bound is the length of an array variable that the body never
+ * reassigns, accesses to that array indexed by the element cannot overflow.
+ *
+ * A while loop guarded by "i < #a", where i is set to a non-negative
+ * constant just before the loop and the body only increases it, gives the
+ * same facts; i never underflows in the body, and accesses to a indexed by i
+ * cannot overflow until the body first modifies i.
+ *
+ * The remaining overflow checks of an innermost range loop with a safe lower
+ * bound are reported as versioned checks.  They can be replaced by a single
+ * test of the upper bound against the array lengths before the loop, which
+ * selects between a copy of the loop without those checks and the original.
+ * The accesses need not run on every iteration, so that test must not read
+ * the length of an array that is null.
+ *
+ * \sa BoundsVisitor
+ */
+class BoundsAnalysis {
+  std::set<ASTArrayRefExpr *> lowerSafe;
+  std::set<ASTArrayRefExpr *> upperSafe;
+  std::map<ASTForRangeStmt *, std::vector<ASTArrayRefExpr *>> versioned;
+
+public:
+  BoundsAnalysis(
+      std::set<ASTArrayRefExpr *> lower, std::set<ASTArrayRefExpr *> upper,
+      std::map<ASTForRangeStmt *, std::vector<ASTArrayRefExpr *>> loops)
+      : lowerSafe(std::move(lower)), upperSafe(std::move(upper)),
+        versioned(std::move(loops)) {}
+
+  /*! \fn analyze
+   *  \brief Compute the redundant bounds checks of a program.
+   * \param ast The program AST
+   * \return The shared pointer to the bounds analysis results
+   */
+  static std::shared_ptr<BoundsAnalysis> analyze(ASTProgram *ast);
+
+  /*! \fn needsLowerCheck
+   *  \brief Check whether the index of an access may be negative.
+   * \param ref An array access
+   * \return false if the index is proven to be non-negative
+   */
+  bool needsLowerCheck(ASTArrayRefExpr *ref);
+
+  /*! \fn needsUpperCheck
+   *  \brief Check whether the index of an access may exceed the array length.
+   * \param ref An array access
+   * \return false if the index is proven to be less than the array length
+   */
+  bool needsUpperCheck(ASTArrayRefExpr *ref);
+
+  /*! \fn getVersionedChecks
+   *  \brief Returns the accesses whose overflow check can be hoisted.
+   *
+   * Each returned access indexes an array variable that the loop never
+   * reassigns by the loop element, and the accesses are all in bounds when
+   * the loop executes no iteration or its upper bound does not exceed the
+   * length of any of the arrays.
+   * \param loop A range loop
+   * \return The accesses, or an empty vector if the loop is not versioned
+   */
+  std::vector<ASTArrayRefExpr *> getVersionedChecks(ASTForRangeStmt *loop);
+};
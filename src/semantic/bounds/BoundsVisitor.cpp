@@ -0,0 +1,262 @@
+#include "BoundsVisitor.h"
+#include "loguru.hpp"
+
+namespace {
+
+// Returns the name of a variable expression, or the empty string.
+std::string varName(ASTExpr *expr) {
+  if (auto v = dynamic_cast<ASTVariableExpr *>(expr)) {
+    return v->getName();
+  }
+  return "";
+}
+
+// Check whether an expression is a non-negative constant or an array length.
+bool isNonNegative(ASTExpr *expr) {
+  if (auto num = dynamic_cast<ASTNumberExpr *>(expr)) {
+    return num->getValue() >= 0;
+  }
+  return dynamic_cast<ASTArrayLenExpr *>(expr) != nullptr;
+}
+
+// Check whether the statement tree writes the named variable.
+bool modifies(ASTNode *node, const std::string &var) {
+  if (auto assign = dynamic_cast<ASTAssignStmt *>(node)) {
+    if (varName(assign->getLHS()) == var) {
+      return true;
+    }
+  } else if (auto inc = dynamic_cast<ASTIncrementStmt *>(node)) {
+    if (varName(inc->getBase()) == var) {
+      return true;
+    }
+  } else if (auto dec = dynamic_cast<ASTDecrementStmt *>(node)) {
+    if (varName(dec->getBase()) == var) {
+      return true;
+    }
+  } else if (auto range = dynamic_cast<ASTForRangeStmt *>(node)) {
+    if (varName(range->getElement()) == var) {
+      return true;
+    }
+  } else if (auto iter = dynamic_cast<ASTForIteratorStmt *>(node)) {
+    if (varName(iter->getElement()) == var) {
+      return true;
+    }
+  }
+  for (auto &c : node->getChildren()) {
+    if (modifies(c.get(), var)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * Check that every write of the named variable in the statement tree adds a
+ * non-negative constant to it, so its value never decreases.
+ */
+bool onlyIncreases(ASTNode *node, const std::string &var) {
+  if (auto assign = dynamic_cast<ASTAssignStmt *>(node)) {
+    if (varName(assign->getLHS()) == var) {
+      auto add = dynamic_cast<ASTBinaryExpr *>(assign->getRHS());
+      if (add == nullptr || add->getOp() != "+") {
+        return false;
+      }
+      auto left = dynamic_cast<ASTNumberExpr *>(add->getLeft());
+      auto right = dynamic_cast<ASTNumberExpr *>(add->getRight());
+      bool increment =
+          (varName(add->getLeft()) == var && right != nullptr &&
+           right->getValue() >= 0) ||
+          (varName(add->getRight()) == var && left != nullptr &&
+           left->getValue() >= 0);
+      if (!increment) {
+        return false;
+      }
+    }
+  } else if (auto dec = dynamic_cast<ASTDecrementStmt *>(node)) {
+    if (varName(dec->getBase()) == var) {
+      return false;
+    }
+  } else if (auto range = dynamic_cast<ASTForRangeStmt *>(node)) {
+    if (varName(range->getElement()) == var) {
+      return false;
+    }
+  } else if (auto iter = dynamic_cast<ASTForIteratorStmt *>(node)) {
+    if (varName(iter->getElement()) == var) {
+      return false;
+    }
+  }
+  for (auto &c : node->getChildren()) {
+    if (!onlyIncreases(c.get(), var)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Collect the array accesses in the tree.
+void collectRefs(ASTNode *node, std::vector<ASTArrayRefExpr *> &refs) {
+  if (auto ref = dynamic_cast<ASTArrayRefExpr *>(node)) {
+    refs.push_back(ref);
+  }
+  for (auto &c : node->getChildren()) {
+    collectRefs(c.get(), refs);
+  }
+}
+
+// Collect the variables whose address is taken in the tree.
+void collectAddressed(ASTNode *node, std::set<std::string> &vars) {
+  if (auto ref = dynamic_cast<ASTRefExpr *>(node)) {
+    auto name = varName(ref->getVar());
+    if (!name.empty()) {
+      vars.insert(name);
+    }
+  }
+  for (auto &c : node->getChildren()) {
+    collectAddressed(c.get(), vars);
+  }
+}
+
+// Check whether the tree contains a loop statement.
+bool containsLoop(ASTNode *node) {
+  if (dynamic_cast<ASTWhileStmt *>(node) != nullptr ||
+      dynamic_cast<ASTForRangeStmt *>(node) != nullptr ||
+      dynamic_cast<ASTForIteratorStmt *>(node) != nullptr) {
+    return true;
+  }
+  for (auto &c : node->getChildren()) {
+    if (containsLoop(c.get())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+} // namespace
+
+bool BoundsVisitor::visit(ASTFunction *element) {
+  addressed.clear();
+  collectAddressed(element, addressed);
+  analyzeWhileLoops(element->getStmts());
+  return true;
+}
+
+bool BoundsVisitor::visit(ASTBlockStmt *element) {
+  analyzeWhileLoops(element->getStmts());
+  return true;
+}
+
+// A variable keeps its value across the body when it is only written directly.
+bool BoundsVisitor::isInvariant(const std::string &var, ASTStmt *body) {
+  return !var.empty() && addressed.count(var) == 0 && !modifies(body, var);
+}
+
+bool BoundsVisitor::visit(ASTForRangeStmt *element) {
+  auto index = varName(element->getElement());
+  auto step = dynamic_cast<ASTNumberExpr *>(element->getStep());
+  auto body = element->getBody();
+  if (!isInvariant(index, body) || step == nullptr || step->getValue() <= 0 ||
+      !isNonNegative(element->getLower())) {
+    return true;
+  }
+
+  std::string bound;
+  if (auto len = dynamic_cast<ASTArrayLenExpr *>(element->getUpper())) {
+    bound = varName(len->getArray());
+  }
+
+  // Versioning duplicates the body, so it is restricted to innermost loops
+  bool innermost = !containsLoop(body);
+
+  std::vector<ASTArrayRefExpr *> refs;
+  collectRefs(body, refs);
+  std::vector<ASTArrayRefExpr *> hoisted;
+  for (auto ref : refs) {
+    if (varName(ref->getIndex()) != index) {
+      continue;
+    }
+    LOG_S(1) << "Bounds analysis: " << *ref << " cannot underflow";
+    lowerSafe.insert(ref);
+
+    auto array = varName(ref->getArray());
+    if (!isInvariant(array, body)) {
+      continue;
+    }
+    if (array == bound) {
+      LOG_S(1) << "Bounds analysis: " << *ref << " cannot overflow";
+      upperSafe.insert(ref);
+    } else if (innermost) {
+      hoisted.push_back(ref);
+    }
+  }
+
+  if (!hoisted.empty()) {
+    LOG_S(1) << "Bounds analysis: versioning " << *element;
+    versioned[element] = hoisted;
+  }
+  return true;
+}
+
+void BoundsVisitor::analyzeWhileLoops(const std::vector<ASTStmt *> &stmts) {
+  for (size_t k = 1; k < stmts.size(); k++) {
+    auto loop = dynamic_cast<ASTWhileStmt *>(stmts[k]);
+    auto init = dynamic_cast<ASTAssignStmt *>(stmts[k - 1]);
+    auto cond = loop == nullptr
+                    ? nullptr
+                    : dynamic_cast<ASTBinaryExpr *>(loop->getCondition());
+    if (init == nullptr || cond == nullptr) {
+      continue;
+    }
+
+    // Accept "i < #a" and "#a > i"
+    std::string index;
+    ASTArrayLenExpr *len = nullptr;
+    if (cond->getOp() == "<") {
+      index = varName(cond->getLeft());
+      len = dynamic_cast<ASTArrayLenExpr *>(cond->getRight());
+    } else if (cond->getOp() == ">") {
+      index = varName(cond->getRight());
+      len = dynamic_cast<ASTArrayLenExpr *>(cond->getLeft());
+    }
+
+    auto body = loop->getBody();
+    if (len == nullptr || index.empty() || addressed.count(index) != 0 ||
+        varName(init->getLHS()) != index || !isNonNegative(init->getRHS()) ||
+        !onlyIncreases(body, index)) {
+      continue;
+    }
+
+    std::vector<ASTArrayRefExpr *> refs;
+    collectRefs(body, refs);
+    for (auto ref : refs) {
+      if (varName(ref->getIndex()) == index) {
+        LOG_S(1) << "Bounds analysis: " << *ref << " cannot underflow";
+        lowerSafe.insert(ref);
+      }
+    }
+
+    auto bound = varName(len->getArray());
+    if (!isInvariant(bound, body)) {
+      continue;
+    }
+
+    // The guard holds until the body first modifies the index
+    std::vector<ASTStmt *> prefix{body};
+    if (auto block = dynamic_cast<ASTBlockStmt *>(body)) {
+      prefix = block->getStmts();
+    }
+    for (auto s : prefix) {
+      if (modifies(s, index)) {
+        break;
+      }
+      refs.clear();
+      collectRefs(s, refs);
+      for (auto ref : refs) {
+        if (varName(ref->getIndex()) == index &&
+            varName(ref->getArray()) == bound) {
+          LOG_S(1) << "Bounds analysis: " << *ref << " cannot overflow";
+          upperSafe.insert(ref);
+        }
+      }
+    }
+  }
+}
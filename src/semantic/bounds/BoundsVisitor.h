@@ -0,0 +1,45 @@
+#pragma once
+
+#include "AST.h"
+#include "ASTVisitor.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*! \class BoundsVisitor
+ *  \brief Collects the array accesses indexed by a bounded induction variable.
+ *
+ * The visitor works one function at a time.  Before the statements of a
+ * function are visited, the variables whose address is taken are recorded
+ * since they may be modified through a pointer.  Range loops are analyzed as
+ * they are visited, and while loops are analyzed from the statement list that
+ * contains them, since the statement preceding the loop establishes the
+ * initial value of the induction variable.
+ *
+ * \sa BoundsAnalysis
+ */
+class BoundsVisitor : public ASTVisitor {
+public:
+  bool visit(ASTFunction *element) override;
+  bool visit(ASTBlockStmt *element) override;
+  bool visit(ASTForRangeStmt *element) override;
+
+  std::set<ASTArrayRefExpr *> getLowerSafe() { return lowerSafe; }
+  std::set<ASTArrayRefExpr *> getUpperSafe() { return upperSafe; }
+  std::map<ASTForRangeStmt *, std::vector<ASTArrayRefExpr *>> getVersioned() {
+    return versioned;
+  }
+
+private:
+  void analyzeWhileLoops(const std::vector<ASTStmt *> &stmts);
+  bool isInvariant(const std::string &var, ASTStmt *body);
+
+  // results accumulated over all functions
+  std::set<ASTArrayRefExpr *> lowerSafe;
+  std::set<ASTArrayRefExpr *> upperSafe;
+  std::map<ASTForRangeStmt *, std::vector<ASTArrayRefExpr *>> versioned;
+
+  // per-function state
+  std::set<std::string> addressed;
+};
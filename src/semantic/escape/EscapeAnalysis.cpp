@@ -0,0 +1,35 @@
+#include "EscapeAnalysis.h"
+#include "EscapeVisitor.h"
+
+std::shared_ptr<EscapeAnalysis> EscapeAnalysis::analyze(ASTProgram *ast) {
+  EscapeVisitor visitor;
+  ast->accept(&visitor);
+  return std::make_shared<EscapeAnalysis>(
+      visitor.getStackSites(), visitor.getTailCalls(),
+      visitor.getContiguousArrays(), visitor.getStridedRefs(),
+      visitor.getColumnarArrays(), visitor.getColumnAccesses());
+}
+
+bool EscapeAnalysis::isStackAllocatable(ASTNode *site) {
+  return stackSites.count(site) != 0;
+}
+
+bool EscapeAnalysis::isTailCall(ASTFunAppExpr *call) {
+  return tailCalls.count(call) != 0;
+}
+
+bool EscapeAnalysis::isContiguous(ASTArrayFixedExpr *array) {
+  return contiguousArrays.count(array) != 0;
+}
+
+bool EscapeAnalysis::isStrided(ASTArrayRefExpr *ref) {
+  return stridedRefs.count(ref) != 0;
+}
+
+bool EscapeAnalysis::isColumnar(ASTExpr *array) {
+  return columnarArrays.count(array) != 0;
+}
+
+bool EscapeAnalysis::isColumnAccess(ASTAccessExpr *access) {
+  return columnAccesses.count(access) != 0;
+}
@@ -0,0 +1,140 @@
+#pragma once
+
+#include "ASTAccessExpr.h"
+#include "ASTArrayFixedExpr.h"
+#include "ASTArrayRefExpr.h"
+#include "ASTFunAppExpr.h"
+#include "ASTProgram.h"
+#include <memory>
+#include <set>
+
+/*! \class EscapeAnalysis
+ *  \brief Identifies allocations that can be placed in a function's frame.
+ *
+ * An allocation site is an alloc expression, the record initializer of an
+ * alloc expression, or a record or array expression whose value is directly
+ * assigned to a local variable.  The site is non-escaping when every other use of that
+ * variable only dereferences it; the pointer is never returned, passed to a
+ * function, stored into memory, copied to another variable, or has the address
+ * of its contents taken.  The storage for such a site can be reserved with a
+ * single stack slot since each execution of the site overwrites the only
+ * reference to the previous allocation.
+ *
+ * The analysis also identifies the calls in tail position, i.e., the
+ * expression of a return statement, of functions whose stack frame is never
+ * exposed through an address-of expression or a record held in the frame.
+ * Such calls cannot observe the caller's frame and may replace it.
+ *
+ * Finally, it identifies the array of arrays expressions, [n of [m of e]],
+ * whose rows all have the same length and can share a single allocation, and
+ * the element accesses a[i][j] whose array is only ever assigned such
+ * expressions, never escapes and never has a row replaced.  Those accesses
+ * can compute the element address from the row length instead of loading the
+ * row.
+ *
+ * Arrays of records held by a local variable that does not escape, and is
+ * only used for its length and for field accesses a[i].f, are identified as
+ * columnar.  Their records are never referenced as a whole, so each field can
+ * be stored in a column of its own.
+ *
+ * \sa EscapeVisitor
+ */
+class EscapeAnalysis {
+  std::set<ASTNode *> stackSites;
+  std::set<ASTFunAppExpr *> tailCalls;
+  std::set<ASTArrayFixedExpr *> contiguousArrays;
+  std::set<ASTArrayRefExpr *> stridedRefs;
+  std::set<ASTExpr *> columnarArrays;
+  std::set<ASTAccessExpr *> columnAccesses;
+
+public:
+  //! Array expressions with more elements than this are always heap allocated
+  static const int MAX_STACK_ARRAY_ELEMENTS = 1024;
+
+  EscapeAnalysis(std::set<ASTNode *> sites, std::set<ASTFunAppExpr *> calls,
+                 std::set<ASTArrayFixedExpr *> contiguous,
+                 std::set<ASTArrayRefExpr *> strided,
+                 std::set<ASTExpr *> columnar,
+                 std::set<ASTAccessExpr *> accesses)
+      : stackSites(std::move(sites)), tailCalls(std::move(calls)),
+        contiguousArrays(std::move(contiguous)),
+        stridedRefs(std::move(strided)), columnarArrays(std::move(columnar)),
+        columnAccesses(std::move(accesses)) {}
+
+  /*! \fn analyze
+   *  \brief Compute the non-escaping allocation sites of a program.
+   * \param ast The program AST
+   * \return The shared pointer to the escape analysis results
+   */
+  static std::shared_ptr<EscapeAnalysis> analyze(ASTProgram *ast);
+
+  /*! \fn isStackAllocatable
+   *  \brief Check whether an allocation site can be placed on the stack.
+   *
+   * \param site An ASTAllocExpr, ASTRecordExpr, ASTArrayDefaultExpr or
+   * ASTArrayFixedExpr node.
+   * \return true if the allocation performed by the site does not escape
+   */
+  bool isStackAllocatable(ASTNode *site);
+
+  /*! \fn isTailCall
+   *  \brief Check whether a call can be emitted as a tail call.
+   *
+   * \param call A function application
+   * \return true if the call is in tail position and the caller's frame does
+   * not escape into it
+   */
+  bool isTailCall(ASTFunAppExpr *call);
+
+  /*! \fn isContiguous
+   *  \brief Check whether an array of arrays can be a single allocation.
+   *
+   * \param array An array expression
+   * \return true if the rows of the array all have the same length
+   */
+  bool isContiguous(ASTArrayFixedExpr *array);
+
+  /*! \fn isStrided
+   *  \brief Check whether an element access can skip loading its row.
+   *
+   * \param ref The outer access of an expression a[i][j]
+   * \return true if a always holds a contiguous array with its original rows
+   */
+  bool isStrided(ASTArrayRefExpr *ref);
+
+  /*! \fn isColumnar
+   *  \brief Check whether an array of records can store fields in columns.
+   *
+   * \param array An ASTArrayDefaultExpr or ASTArrayFixedExpr node
+   * \return true if its records are only ever used through field accesses
+   */
+  bool isColumnar(ASTExpr *array);
+
+  /*! \fn isColumnAccess
+   *  \brief Check whether a field access reads a column of an array.
+   *
+   * \param access A field access a[i].f
+   * \return true if a always holds an array built as columns
+   */
+  bool isColumnAccess(ASTAccessExpr *access);
+
+  //! Returns the set of non-escaping allocation sites
+  std::set<ASTNode *> getStackSites() { return stackSites; }
+
+  //! Returns the set of calls that can be emitted as tail calls
+  std::set<ASTFunAppExpr *> getTailCalls() { return tailCalls; }
+
+  //! Returns the set of arrays of arrays built as a single allocation
+  std::set<ASTArrayFixedExpr *> getContiguousArrays() {
+    return contiguousArrays;
+  }
+
+  //! Returns the set of element accesses that use the row stride
+  std::set<ASTArrayRefExpr *> getStridedRefs() { return stridedRefs; }
+
+  //! Returns the set of arrays of records that can be built as columns
+  std::set<ASTExpr *> getColumnarArrays() { return columnarArrays; }
+
+  //! Returns the set of field accesses that read a column
+  std::set<ASTAccessExpr *> getColumnAccesses() { return columnAccesses; }
+};
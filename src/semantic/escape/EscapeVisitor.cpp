@@ -0,0 +1,342 @@
+#include "EscapeVisitor.h"
+#include "EscapeAnalysis.h"
+#include "loguru.hpp"
+
+namespace {
+
+// Check whether the expression tree mentions the named variable.
+bool mentions(ASTNode *node, const std::string &var) {
+  if (auto v = dynamic_cast<ASTVariableExpr *>(node)) {
+    return v->getName() == var;
+  }
+  for (auto &c : node->getChildren()) {
+    if (mentions(c.get(), var)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Check whether evaluating the expression tree can call a function or read input.
+bool hasEffects(ASTNode *node) {
+  if (dynamic_cast<ASTFunAppExpr *>(node) != nullptr ||
+      dynamic_cast<ASTInputExpr *>(node) != nullptr) {
+    return true;
+  }
+  for (auto &c : node->getChildren()) {
+    if (hasEffects(c.get())) {
+      return true;
+    }
+  }
+  return false;
+}
+
+/*
+ * An array of arrays can be built as one allocation when every row has the
+ * same length.  That holds when the row length is a constant or a variable,
+ * and evaluating the element initializer cannot assign to the variable.
+ */
+bool isContiguous(ASTExpr *expr) {
+  auto outer = dynamic_cast<ASTArrayFixedExpr *>(expr);
+  if (outer == nullptr) {
+    return false;
+  }
+  auto row = dynamic_cast<ASTArrayFixedExpr *>(outer->getInstance());
+  if (row == nullptr) {
+    return false;
+  }
+  return (dynamic_cast<ASTNumberExpr *>(row->getNumber()) != nullptr ||
+          dynamic_cast<ASTVariableExpr *>(row->getNumber()) != nullptr) &&
+         !hasEffects(row->getInstance());
+}
+
+/*
+ * Check whether the expression builds an array whose elements are records.
+ * An empty array has no records to give its layout, so it is not one.
+ */
+bool isRecordArray(ASTExpr *expr) {
+  if (auto arr = dynamic_cast<ASTArrayFixedExpr *>(expr)) {
+    return dynamic_cast<ASTRecordExpr *>(arr->getInstance()) != nullptr;
+  } else if (auto arr = dynamic_cast<ASTArrayDefaultExpr *>(expr)) {
+    if (arr->getFields().empty()) {
+      return false;
+    }
+    for (auto e : arr->getFields()) {
+      if (dynamic_cast<ASTRecordExpr *>(e) == nullptr) {
+        return false;
+      }
+    }
+    return true;
+  }
+  return false;
+}
+
+} // namespace
+
+bool EscapeVisitor::visit(ASTFunction *element) {
+  sites.clear();
+  recordSites.clear();
+  escaping.clear();
+  recordEscaping.clear();
+  safeUses.clear();
+  safeDerefs.clear();
+  addressed.clear();
+  rowRefs.clear();
+  matrices.clear();
+  irregular.clear();
+  recordArrays.clear();
+  fieldAccesses.clear();
+  fieldRefs.clear();
+  scattered.clear();
+  for (auto formal : element->getFormals()) {
+    irregular.insert(formal->getName());
+    scattered.insert(formal->getName());
+  }
+  returnCall = nullptr;
+  frameEscapes = false;
+  allocDepth = 0;
+  return true;
+}
+
+void EscapeVisitor::endVisit(ASTFunction *element) {
+  for (auto &[var, varSites] : sites) {
+    if (escaping.count(var) != 0) {
+      continue;
+    }
+    for (auto s : varSites) {
+      LOG_S(1) << "Escape analysis: " << *s << " in " << element->getName()
+               << " does not escape";
+      stackSites.insert(s);
+    }
+  }
+  for (auto &[var, varSites] : recordSites) {
+    if (escaping.count(var) != 0 || recordEscaping.count(var) != 0) {
+      continue;
+    }
+    for (auto s : varSites) {
+      LOG_S(1) << "Escape analysis: " << *s << " in " << element->getName()
+               << " does not escape";
+      stackSites.insert(s);
+    }
+  }
+  for (auto &var : matrices) {
+    if (escaping.count(var) != 0 || irregular.count(var) != 0) {
+      continue;
+    }
+    for (auto ref : rowRefs[var]) {
+      LOG_S(1) << "Escape analysis: " << *ref << " in " << element->getName()
+               << " is strided";
+      stridedRefs.insert(ref);
+    }
+  }
+  for (auto &[var, varSites] : recordArrays) {
+    if (escaping.count(var) != 0 || scattered.count(var) != 0) {
+      continue;
+    }
+    for (auto s : varSites) {
+      LOG_S(1) << "Escape analysis: " << *s << " in " << element->getName()
+               << " is columnar";
+      columnarArrays.insert(s);
+    }
+    columnAccesses.insert(fieldAccesses[var].begin(), fieldAccesses[var].end());
+  }
+  if (returnCall != nullptr && !frameEscapes) {
+    LOG_S(1) << "Escape analysis: " << *returnCall << " in "
+             << element->getName() << " is a tail call";
+    tailCalls.insert(returnCall);
+  }
+}
+
+/*
+ * Allocation sites whose initializer reads the variable being assigned are
+ * excluded, since reusing a single slot would clobber the previous allocation
+ * while the initializer is still reading it.
+ */
+void EscapeVisitor::recordSite(const std::string &var, ASTExpr *rhs) {
+  if (mentions(rhs, var)) {
+    return;
+  }
+
+  if (auto alloc = dynamic_cast<ASTAllocExpr *>(rhs)) {
+    sites[var].push_back(alloc);
+    if (auto rec = dynamic_cast<ASTRecordExpr *>(alloc->getInitializer())) {
+      recordSites[var].push_back(rec);
+    }
+  } else if (auto rec = dynamic_cast<ASTRecordExpr *>(rhs)) {
+    sites[var].push_back(rec);
+  } else if (auto arr = dynamic_cast<ASTArrayDefaultExpr *>(rhs)) {
+    if (arr->getFields().size() <=
+        (size_t)EscapeAnalysis::MAX_STACK_ARRAY_ELEMENTS) {
+      sites[var].push_back(arr);
+    }
+  } else if (auto arr = dynamic_cast<ASTArrayFixedExpr *>(rhs)) {
+    // Only arrays with a constant length have a fixed frame size, and the
+    // rows of a contiguous array share its heap allocation
+    auto len = dynamic_cast<ASTNumberExpr *>(arr->getNumber());
+    if (len != nullptr && len->getValue() >= 0 && !isContiguous(arr) &&
+        len->getValue() <= EscapeAnalysis::MAX_STACK_ARRAY_ELEMENTS) {
+      sites[var].push_back(arr);
+    }
+  }
+}
+
+void EscapeVisitor::markSafe(ASTExpr *use) {
+  if (dynamic_cast<ASTVariableExpr *>(use) != nullptr) {
+    safeUses.insert(use);
+  }
+}
+
+/*
+ * Record a definition that may leave a variable holding something other than
+ * a contiguous array, either by assigning the variable or one of its rows.
+ * A variable that is defined this way does not hold an array of records.
+ */
+void EscapeVisitor::markIrregular(ASTExpr *def) {
+  if (auto var = dynamic_cast<ASTVariableExpr *>(def)) {
+    scattered.insert(var->getName());
+  }
+  if (auto ref = dynamic_cast<ASTArrayRefExpr *>(def)) {
+    def = ref->getArray();
+  }
+  if (auto var = dynamic_cast<ASTVariableExpr *>(def)) {
+    irregular.insert(var->getName());
+  }
+}
+
+bool EscapeVisitor::visit(ASTAssignStmt *element) {
+  if (auto var = dynamic_cast<ASTVariableExpr *>(element->getLHS())) {
+    safeUses.insert(var);
+    recordSite(var->getName(), element->getRHS());
+    if (isContiguous(element->getRHS())) {
+      matrices.insert(var->getName());
+    } else {
+      irregular.insert(var->getName());
+    }
+    if (isRecordArray(element->getRHS())) {
+      recordArrays[var->getName()].push_back(element->getRHS());
+    } else {
+      scattered.insert(var->getName());
+    }
+  } else if (dynamic_cast<ASTDeRefExpr *>(element->getLHS()) != nullptr) {
+    safeDerefs.insert(element->getLHS());
+  } else {
+    markIrregular(element->getLHS());
+  }
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTReturnStmt *element) {
+  returnCall = dynamic_cast<ASTFunAppExpr *>(element->getArg());
+  return true;
+}
+
+/*
+ * Records built outside of an alloc expression are held in the stack frame.
+ * Everything within the initializer of an alloc expression is heap allocated.
+ */
+bool EscapeVisitor::visit(ASTAllocExpr *element) {
+  allocDepth++;
+  return true;
+}
+
+void EscapeVisitor::endVisit(ASTAllocExpr *element) { allocDepth--; }
+
+bool EscapeVisitor::visit(ASTRecordExpr *element) {
+  if (allocDepth == 0) {
+    frameEscapes = true;
+  }
+  return true;
+}
+
+/*
+ * Taking the address of a dereference, field or array element exposes the
+ * interior of the allocation, so the base of such an expression is never
+ * considered a safe use.
+ */
+bool EscapeVisitor::visit(ASTRefExpr *element) {
+  if (dynamic_cast<ASTVariableExpr *>(element->getVar()) != nullptr) {
+    frameEscapes = true;
+  }
+  addressed.insert(element->getVar());
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTDeRefExpr *element) {
+  if (addressed.count(element) == 0) {
+    markSafe(element->getPtr());
+  }
+  return true;
+}
+
+void EscapeVisitor::endVisit(ASTDeRefExpr *element) {
+  auto var = dynamic_cast<ASTVariableExpr *>(element->getPtr());
+  if (var != nullptr && safeDerefs.count(element) == 0) {
+    recordEscaping.insert(var->getName());
+  }
+}
+
+bool EscapeVisitor::visit(ASTAccessExpr *element) {
+  if (addressed.count(element) == 0) {
+    if (dynamic_cast<ASTDeRefExpr *>(element->getRecord()) != nullptr) {
+      safeDerefs.insert(element->getRecord());
+    }
+    markSafe(element->getRecord());
+  }
+  if (auto ref = dynamic_cast<ASTArrayRefExpr *>(element->getRecord())) {
+    if (auto var = dynamic_cast<ASTVariableExpr *>(ref->getArray())) {
+      fieldRefs.insert(ref);
+      fieldAccesses[var->getName()].push_back(element);
+    }
+  }
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTArrayRefExpr *element) {
+  if (addressed.count(element) == 0) {
+    markSafe(element->getArray());
+  }
+  if (auto row = dynamic_cast<ASTArrayRefExpr *>(element->getArray())) {
+    if (auto var = dynamic_cast<ASTVariableExpr *>(row->getArray())) {
+      rowRefs[var->getName()].push_back(element);
+    }
+  }
+  auto var = dynamic_cast<ASTVariableExpr *>(element->getArray());
+  if (var != nullptr && fieldRefs.count(element) == 0) {
+    scattered.insert(var->getName());
+  }
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTArrayLenExpr *element) {
+  markSafe(element->getArray());
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTForIteratorStmt *element) {
+  markIrregular(element->getElement());
+  markSafe(element->getElement());
+  markSafe(element->getIterable());
+  if (auto var = dynamic_cast<ASTVariableExpr *>(element->getIterable())) {
+    scattered.insert(var->getName());
+  }
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTForRangeStmt *element) {
+  markIrregular(element->getElement());
+  markSafe(element->getElement());
+  return true;
+}
+
+bool EscapeVisitor::visit(ASTArrayFixedExpr *element) {
+  if (isContiguous(element)) {
+    contiguousArrays.insert(element);
+  }
+  return true;
+}
+
+void EscapeVisitor::endVisit(ASTVariableExpr *element) {
+  if (safeUses.count(element) == 0) {
+    escaping.insert(element->getName());
+  }
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include "AST.h"
+#include "ASTVisitor.h"
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+/*! \class EscapeVisitor
+ *  \brief Collects the allocation sites whose pointer never escapes.
+ *
+ * The visitor works one function at a time.  Allocation sites are recorded
+ * against the local variable they are assigned to, and every occurrence of a
+ * variable that is not a definition or the base of a dereference, field
+ * access, array access or array length marks the variable as escaping.  When the function
+ * has been visited, the sites of variables that did not escape are retained.
+ *
+ * Record initializers of alloc expressions are tracked separately, since the
+ * record pointer is stored in the allocated cell; it only stays local when
+ * every dereference of the cell is immediately used for a field access or as
+ * the target of an assignment.
+ *
+ * A call in the return statement is recorded as a tail call, unless the
+ * function takes the address of a local variable or builds a record outside
+ * of an alloc expression, since those values live in the stack frame.
+ *
+ * Array of array expressions whose row length and element initializer cannot
+ * change while the rows are built are recorded as contiguous.  A local
+ * variable that is only ever assigned such arrays, does not escape and never
+ * has one of its rows replaced keeps rows at a fixed stride, so the element
+ * accesses through it are recorded as strided.
+ *
+ * Likewise, a local variable that is only ever assigned arrays of record
+ * expressions, does not escape and is otherwise only used for its length or
+ * for field accesses a[i].f can hold each field in a column of its own.  The
+ * array expressions and field accesses of such variables are recorded as
+ * columnar.
+ *
+ * \sa EscapeAnalysis
+ */
+class EscapeVisitor : public ASTVisitor {
+public:
+  bool visit(ASTFunction *element) override;
+  void endVisit(ASTFunction *element) override;
+  bool visit(ASTAssignStmt *element) override;
+  bool visit(ASTAllocExpr *element) override;
+  void endVisit(ASTAllocExpr *element) override;
+  bool visit(ASTRecordExpr *element) override;
+  bool visit(ASTReturnStmt *element) override;
+  bool visit(ASTRefExpr *element) override;
+  bool visit(ASTDeRefExpr *element) override;
+  void endVisit(ASTDeRefExpr *element) override;
+  bool visit(ASTAccessExpr *element) override;
+  bool visit(ASTArrayRefExpr *element) override;
+  bool visit(ASTArrayLenExpr *element) override;
+  bool visit(ASTForIteratorStmt *element) override;
+  bool visit(ASTForRangeStmt *element) override;
+  bool visit(ASTArrayFixedExpr *element) override;
+  void endVisit(ASTVariableExpr *element) override;
+
+  std::set<ASTNode *> getStackSites() { return stackSites; }
+  std::set<ASTFunAppExpr *> getTailCalls() { return tailCalls; }
+  std::set<ASTArrayFixedExpr *> getContiguousArrays() {
+    return contiguousArrays;
+  }
+  std::set<ASTArrayRefExpr *> getStridedRefs() { return stridedRefs; }
+  std::set<ASTExpr *> getColumnarArrays() { return columnarArrays; }
+  std::set<ASTAccessExpr *> getColumnAccesses() { return columnAccesses; }
+
+private:
+  void recordSite(const std::string &var, ASTExpr *rhs);
+  void markSafe(ASTExpr *use);
+  void markIrregular(ASTExpr *def);
+
+  // results accumulated over all functions
+  std::set<ASTNode *> stackSites;
+  std::set<ASTFunAppExpr *> tailCalls;
+  std::set<ASTArrayFixedExpr *> contiguousArrays;
+  std::set<ASTArrayRefExpr *> stridedRefs;
+  std::set<ASTExpr *> columnarArrays;
+  std::set<ASTAccessExpr *> columnAccesses;
+
+  // per-function state
+  std::map<std::string, std::vector<ASTNode *>> sites;
+  std::map<std::string, std::vector<ASTNode *>> recordSites;
+  std::set<std::string> escaping;
+  std::set<std::string> recordEscaping;
+  std::set<ASTNode *> safeUses;
+  std::set<ASTNode *> safeDerefs;
+  std::set<ASTNode *> addressed;
+  std::map<std::string, std::vector<ASTArrayRefExpr *>> rowRefs;
+  std::set<std::string> matrices;
+  std::set<std::string> irregular;
+  std::map<std::string, std::vector<ASTExpr *>> recordArrays;
+  std::map<std::string, std::vector<ASTAccessExpr *>> fieldAccesses;
+  std::set<ASTNode *> fieldRefs;
+  std::set<std::string> scattered;
+  ASTFunAppExpr *returnCall;
+  bool frameEscapes;
+  int allocDepth;
+};
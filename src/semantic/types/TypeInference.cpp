@@ -7,17 +7,14 @@
 #include "loguru.hpp"
 #include <memory>
 
-/* Local name space for DFS visit variables */
-namespace {
-std::deque<ASTFunction *> sorted;
-std::vector<ASTFunction *> unmarked;
-} // namespace
-
 /* DFS to compute call dependence assuming that the graph
  * does not have cycles.  The DFS updates the unmarked vector
  * which records the functions whose dependences have been computed.
+ * The visit variables belong to the caller, so that programs can be
+ * analyzed concurrently.
  */
-void topoVisit(CallGraph *cg, ASTFunction *f) {
+void topoVisit(CallGraph *cg, ASTFunction *f, std::deque<ASTFunction *> &sorted,
+               std::vector<ASTFunction *> &unmarked) {
   // If f is marked, i.e., not in unmarked, then backtrack DFS
   if (std::find(unmarked.begin(), unmarked.end(), f) == unmarked.end()) {
     return;
@@ -30,7 +27,7 @@ void topoVisit(CallGraph *cg, ASTFunction *f) {
 
   // visit called functions
   for (auto c : cg->getCallees(f)) {
-    topoVisit(cg, c);
+    topoVisit(cg, c, sorted, unmarked);
   }
 
   // add it to sorted
@@ -56,13 +53,13 @@ bool mayIndirectlyCall(CallGraph *cg, ASTFunction *f, ASTFunction *g) {
 // Topologically sort the set of functions based on the call graph.
 std::deque<ASTFunction *> topoSort(CallGraph *cg,
                                    std::vector<ASTFunction *> funcs) {
-  /* Initialize globals for sort DFS */
-  sorted = std::deque<ASTFunction *>();
-  unmarked = funcs;
+  /* Initialize the variables for sort DFS */
+  std::deque<ASTFunction *> sorted;
+  std::vector<ASTFunction *> unmarked = funcs;
 
   while (!unmarked.empty()) {
     auto f = unmarked.back();
-    topoVisit(cg, f);
+    topoVisit(cg, f, sorted, unmarked);
   }
   return sorted;
 }
@@ -198,6 +195,11 @@ std::shared_ptr<TipType> TypeInference::getInferredType(ASTDeclNode *node) {
   return unifier->inferred(var);
 };
 
+std::shared_ptr<TipType> TypeInference::getInferredType(ASTExpr *node) {
+  auto var = std::make_shared<TipVar>(node);
+  return unifier->inferred(var);
+};
+
 void TypeInference::print(std::ostream &s) {
   s << "\nFunctions : {\n";
   auto skip = true;
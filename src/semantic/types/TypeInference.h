@@ -1,6 +1,7 @@
 #pragma once
 
 #include "ASTDeclNode.h"
+#include "ASTExpr.h"
 #include "ASTProgram.h"
 #include "CallGraph.h"
 #include "SymbolTable.h"
@@ -62,6 +63,20 @@ public:
    */
   std::shared_ptr<TipType> getInferredType(ASTDeclNode *node);
 
+  /*! \fn getInferredType
+   *  \brief Returns the type expression inferred for the given expression.
+   *
+   * Every expression other than a variable has its own type variable, so the
+   * type of intermediate values can be accessed after type checking completes.
+   * Variables share the type variable of their declaration; their type is
+   * accessed through the ASTDeclNode found in the symbol table.
+   *
+   * \sa TipType
+   * \param node An AST expression node that is not a variable.
+   * \return A shared pointer to the inferred type for the AST node.
+   */
+  std::shared_ptr<TipType> getInferredType(ASTExpr *node);
+
   //! Print type inference results to output stream
   void print(std::ostream &os);
 };
@@ -0,0 +1,249 @@
+#include "Server.h"
+
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
+
+#include "loguru.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+const char *const SHUTDOWN_REQUEST = "shutdown";
+
+std::string trim(const std::string &line) {
+  auto first = line.find_first_not_of(" \t\r");
+  if (first == std::string::npos) {
+    return "";
+  }
+  auto last = line.find_last_not_of(" \t\r");
+  return line.substr(first, last - first + 1);
+}
+
+// Compile a request and return its answer
+std::string answer(const Server::Handler &handler, const std::string &request) {
+  std::istringstream words(request);
+  std::string source, output, extra;
+  words >> source >> output;
+  if (words >> extra) {
+    return "error " + source + ": malformed request '" + request + "'\n";
+  }
+
+  try {
+    handler(source, output);
+  } catch (std::exception &e) {
+    std::string message = e.what();
+    std::replace(message.begin(), message.end(), '\n', ' ');
+    return "error " + source + ": " + message + "\n";
+  }
+  return "ok " + source + "\n";
+}
+
+/*
+ * The requests of one client.  The workers write the answers as the requests
+ * complete, one answer at a time, and the client waits for its requests
+ * before it is closed.
+ */
+class Client {
+public:
+  Client(llvm::ThreadPool &workers, const Server::Handler &handler,
+         std::function<void(const std::string &)> write)
+      : workers(workers), handler(handler), write(std::move(write)) {}
+
+  void submit(const std::string &request) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      pending++;
+    }
+    workers.async([this, request] {
+      std::string text = answer(handler, request);
+      std::lock_guard<std::mutex> lock(mutex);
+      write(text);
+      if (--pending == 0) {
+        completed.notify_all();
+      }
+    });
+  }
+
+  void wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    completed.wait(lock, [this] { return pending == 0; });
+  }
+
+private:
+  llvm::ThreadPool &workers;
+  const Server::Handler &handler;
+  std::function<void(const std::string &)> write;
+  std::mutex mutex;
+  std::condition_variable completed;
+  int pending = 0;
+};
+
+// Read a line from a socket, returning false at the end of the stream
+bool readLine(int fd, std::string &buffer, std::string &line) {
+  while (true) {
+    auto newline = buffer.find('\n');
+    if (newline != std::string::npos) {
+      line = buffer.substr(0, newline);
+      buffer.erase(0, newline + 1);
+      return true;
+    }
+
+    char chunk[4096];
+    ssize_t n = read(fd, chunk, sizeof(chunk));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      // the last request need not end with a newline
+      line = buffer;
+      buffer.clear();
+      return !line.empty();
+    }
+    buffer.append(chunk, n);
+  }
+}
+
+// Write text to a socket, dropping it if the client has gone away
+void writeAll(int fd, const std::string &text) {
+  size_t written = 0;
+  while (written < text.size()) {
+    ssize_t n = send(fd, text.data() + written, text.size() - written,
+                     MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return;
+    }
+    written += n;
+  }
+}
+
+// A connected client, read by a thread that is joined once it has finished
+struct Connection {
+  std::thread reader;
+  std::atomic<bool> finished{false};
+};
+
+} // namespace
+
+void Server::serve(std::istream &requests, std::ostream &answers,
+                   const Handler &handler, const ServerOptions &options) {
+  llvm::ThreadPool workers(llvm::hardware_concurrency(options.workers));
+  Client client(workers, handler, [&answers](const std::string &text) {
+    answers << text << std::flush;
+  });
+
+  std::string line;
+  while (std::getline(requests, line)) {
+    line = trim(line);
+    if (!line.empty()) {
+      client.submit(line);
+    }
+  }
+  client.wait();
+}
+
+bool Server::listen(const std::string &path, const Handler &handler,
+                    const ServerOptions &options) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  if (path.size() >= sizeof(address.sun_path)) {
+    LOG_S(ERROR) << "tipc: error: socket name is too long: '" << path << "'";
+    return false;
+  }
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+
+  // A socket left behind by an earlier server is replaced, other files are not
+  struct stat status;
+  if (lstat(path.c_str(), &status) == 0 && S_ISSOCK(status.st_mode)) {
+    unlink(path.c_str());
+  }
+
+  int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listener < 0 ||
+      bind(listener, reinterpret_cast<sockaddr *>(&address),
+           sizeof(address)) != 0 ||
+      ::listen(listener, SOMAXCONN) != 0) {
+    LOG_S(ERROR) << "tipc: error: cannot listen on '" << path
+                 << "': " << std::strerror(errno);
+    if (listener >= 0) {
+      close(listener);
+    }
+    return false;
+  }
+  LOG_S(1) << "Listening on " << path;
+
+  llvm::ThreadPool workers(llvm::hardware_concurrency(options.workers));
+  std::atomic<bool> stopping(false);
+  std::list<Connection> connections;
+
+  while (!stopping) {
+    int fd = accept(listener, nullptr, nullptr);
+    if (fd < 0) {
+      if (errno == EINTR && !stopping) {
+        continue;
+      }
+      break;
+    }
+
+    for (auto c = connections.begin(); c != connections.end();) {
+      if (c->finished) {
+        c->reader.join();
+        c = connections.erase(c);
+      } else {
+        ++c;
+      }
+    }
+
+    connections.emplace_back();
+    Connection *connection = &connections.back();
+    connection->reader = std::thread([&, fd, connection] {
+      Client client(workers, handler,
+                    [fd](const std::string &text) { writeAll(fd, text); });
+      std::string buffer, line;
+      while (readLine(fd, buffer, line)) {
+        line = trim(line);
+        if (line == SHUTDOWN_REQUEST) {
+          // wakes the server waiting for the next client
+          stopping = true;
+          shutdown(listener, SHUT_RDWR);
+          break;
+        }
+        if (!line.empty()) {
+          client.submit(line);
+        }
+      }
+      client.wait();
+      close(fd);
+      connection->finished = true;
+    });
+  }
+
+  bool stopped = stopping;
+  if (!stopped) {
+    LOG_S(ERROR) << "tipc: error: cannot accept clients on '" << path
+                 << "': " << std::strerror(errno);
+  }
+
+  for (auto &c : connections) {
+    c.reader.join();
+  }
+  close(listener);
+  unlink(path.c_str());
+  return stopped;
+}
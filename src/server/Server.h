@@ -0,0 +1,63 @@
+#pragma once
+
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <string>
+
+/*! \struct ServerOptions
+ *  \brief Settings for serving compile requests.
+ */
+struct ServerOptions {
+  //! Number of requests compiled at once, 0 for one per core
+  unsigned workers = 0;
+};
+
+/*! \class Server
+ *  \brief Routines to compile the requests of clients in a running tipc.
+ *
+ * A request is a line holding the name of a source file, optionally followed
+ * by the name of the output file.  Requests are compiled concurrently by a
+ * pool of workers, so the state that tipc builds up once, such as the
+ * registered targets and the DFA of the parser, is shared by every request.
+ *
+ * Each request is answered by a line, "ok <source>" when the output has been
+ * written and "error <source>: <message>" otherwise.  Answers are written as
+ * the requests complete, which need not be the order of the requests.
+ */
+class Server {
+public:
+  /*! Compiles a source file to an output file, or to the default output if
+   * the name of the output is empty, and throws an exception describing any
+   * failure.
+   */
+  using Handler =
+      std::function<void(const std::string &source, const std::string &output)>;
+
+  /*! \fn serve
+   *  \brief Compile the requests read from a stream until it ends.
+   *
+   * \param requests the stream of requests, e.g., the standard input
+   * \param answers the stream receiving the answers
+   * \param handler the routine that compiles a request
+   * \param options settings for the server
+   */
+  static void serve(std::istream &requests, std::ostream &answers,
+                    const Handler &handler,
+                    const ServerOptions &options = ServerOptions());
+
+  /*! \fn listen
+   *  \brief Compile the requests of clients connecting to a Unix socket.
+   *
+   * Every connection is a client, whose requests are answered on the same
+   * connection.  The server stops once a client sends the request "shutdown"
+   * and the other clients have disconnected.
+   * \param path the file name of the socket
+   * \param handler the routine that compiles a request
+   * \param options settings for the server
+   * \return true if the server stopped on request, false if the socket could
+   * not be used
+   */
+  static bool listen(const std::string &path, const Handler &handler,
+                     const ServerOptions &options = ServerOptions());
+};
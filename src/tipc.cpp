@@ -1,18 +1,36 @@
+#include "Backend.h"
+#include "BytecodeCompiler.h"
 #include "CodeGenerator.h"
+#include "Compiler.h"
 #include "FrontEnd.h"
 #include "InternalError.h"
+#include "Interpreter.h"
+#include "JIT.h"
 #include "Optimizer.h"
+#include "OutputError.h"
 #include "ParseError.h"
 #include "SemanticAnalysis.h"
 #include "SemanticError.h"
+#include "Server.h"
 #include "loguru.hpp"
+#include "llvm/IR/LLVMContext.h"
 #include "llvm/Support/CommandLine.h"
+#include "llvm/Support/ThreadPool.h"
+#include "llvm/Support/Threading.h"
 
 #include <fstream>
+#include <stdexcept>
+#include <vector>
 
 using namespace llvm;
 using namespace std;
 
+#ifndef TIP_RTLIB_OBJECT
+#define TIP_RTLIB_OBJECT "tip_rtlib.o"
+#endif
+
+enum class EmitKind { bc, obj, exe };
+
 static cl::OptionCategory
     TIPcat("tipc Options",
            "Options for controlling the TIP compilation process.");
@@ -26,15 +44,52 @@ static cl::opt<bool> polyinf("pi",
                              cl::cat(TIPcat));
 static cl::opt<bool> disopt("do", cl::desc("disable bitcode optimization"),
                             cl::cat(TIPcat));
+static cl::opt<char> optLevel(
+    "O", cl::value_desc("level"),
+    cl::desc("use the standard LLVM pipeline for optimization level 0-3, s "
+             "or z, instead of the basic passes"),
+    cl::Prefix, cl::init('\0'), cl::cat(TIPcat));
 static cl::opt<int> debug(
     "verbose",
     cl::desc("enable log messages (Levels 1-3) \n Level 1 - Basic logging for "
              "every phase.\n Level 2 - Level 1 and type constraints being "
              "unified.\n Level 3 - Level 2 and union-find solving steps."),
     cl::cat(TIPcat));
+static cl::opt<bool> gc("gc",
+                        cl::desc("allocate from the garbage collected heap"),
+                        cl::cat(TIPcat));
+static cl::opt<bool>
+    trap("trap", cl::desc("trap on failed runtime checks instead of reporting them"),
+         cl::cat(TIPcat));
+static cl::opt<bool>
+    soa("soa", cl::desc("store arrays of records as one array per field"),
+        cl::cat(TIPcat));
 static cl::opt<bool>
     emitHrAsm("asm", cl::desc("emit human-readable LLVM assembly language"),
               cl::cat(TIPcat));
+static cl::opt<EmitKind> emitKind(
+    "emit", cl::desc("kind of output to emit"),
+    cl::values(clEnumValN(EmitKind::bc, "bc", "LLVM bitcode (default)"),
+               clEnumValN(EmitKind::obj, "obj", "native object file"),
+               clEnumValN(EmitKind::exe, "exe",
+                          "native executable linked with the runtime")),
+    cl::init(EmitKind::bc), cl::cat(TIPcat));
+static cl::opt<std::string>
+    rtlibObject("rtlib", cl::value_desc("object"),
+                cl::desc("runtime library object linked by --emit=exe"),
+                cl::init(TIP_RTLIB_OBJECT), cl::cat(TIPcat));
+static cl::opt<std::string>
+    linker("linker", cl::value_desc("driver"),
+           cl::desc("compiler driver that links --emit=exe (default cc)"),
+           cl::init("cc"), cl::cat(TIPcat));
+static cl::opt<unsigned>
+    jobs("j", cl::value_desc("jobs"),
+         cl::desc("run the basic and optional optimization passes, and "
+                  "compile native code for --emit=obj or --emit=exe, on up "
+                  "to <jobs> threads, or compile up to <jobs> of several "
+                  "source files at once; the pipeline of -O runs on one "
+                  "thread"),
+         cl::Prefix, cl::init(1), cl::cat(TIPcat));
 static cl::opt<std::string>
     cgFile("pcg", cl::value_desc("call graph output file"),
            cl::desc("print call graph to a file in dot syntax"),
@@ -48,7 +103,36 @@ static cl::opt<std::string>
             cl::cat(TIPcat));
 static cl::opt<std::string> sourceFile(cl::Positional,
                                        cl::desc("<tip source file>"),
-                                       cl::Required, cl::cat(TIPcat));
+                                       cl::cat(TIPcat));
+static cl::list<std::string>
+    programArgs(cl::Positional,
+                cl::desc("<more tip source files, or program arguments for "
+                         "--run or --interp>..."),
+                cl::cat(TIPcat));
+static cl::opt<bool>
+    run("run", cl::desc("compile the program in memory and run it"),
+        cl::cat(TIPcat));
+static cl::opt<bool>
+    lazy("lazy",
+         cl::desc("with --run, optimize and compile each function on its "
+                  "first call"),
+         cl::cat(TIPcat));
+static cl::opt<bool> interp(
+    "interp",
+    cl::desc("run the program with the bytecode interpreter, without "
+             "generating code"),
+    cl::cat(TIPcat));
+static cl::opt<bool> server(
+    "server",
+    cl::desc("compile the source files named by requests on standard input, "
+             "one per line and optionally followed by an output file, on up "
+             "to <jobs> threads (default one per core)"),
+    cl::cat(TIPcat));
+static cl::opt<std::string>
+    socketFile("socket", cl::value_desc("socket"),
+               cl::desc("with --server, read requests from clients of a Unix "
+                        "socket until one requests \"shutdown\""),
+               cl::cat(TIPcat));
 static cl::opt<std::string> outputfile("o", cl::value_desc("outputfile"),
                                        cl::desc("write output to <outputfile>"),
                                        cl::cat(TIPcat));
@@ -60,8 +144,167 @@ static cl::list<Optimization> OptimizationList(
 			clEnumVal(ivs, "Induction Variable Elimination"),
 			clEnumVal(lup, "Loop Unroller Pass"),
 			clEnumVal(mfp, "Merge Function Pass"),
-      clEnumVal(lrp, "Loop Rotation Pass")),
+      clEnumVal(lrp, "Loop Rotation Pass"),
+      clEnumVal(tre, "Tail Recursion Elimination"),
+      clEnumVal(inl, "Call Graph Guided Inliner"),
+      clEnumVal(vec, "Loop and SLP Vectorization")),
 		cl::cat(TIPcat));
+static cl::opt<std::string>
+    targetCPU("mcpu", cl::value_desc("cpu"),
+              cl::desc("target CPU for optimization (default native for "
+                       "--run and native code, otherwise generic)"),
+              cl::init("native"), cl::cat(TIPcat));
+static cl::opt<std::string> targetFeatures(
+    "mattr", cl::value_desc("a1,+a2,-a3,..."),
+    cl::desc("target features for optimization (default native for --run "
+             "and native code, otherwise none)"),
+    cl::init("native"), cl::cat(TIPcat));
+static cl::opt<int> inlineThreshold(
+    "inl-threshold", cl::value_desc("threshold"),
+    cl::desc("cost threshold of the inliner enabled by --inl"), cl::init(225),
+    cl::cat(TIPcat));
+
+// The code generation strategies selected on the command line
+static CodeGenOptions selectedCodeGenOptions() {
+  CodeGenOptions options;
+  options.gc = gc;
+  options.trap = trap;
+  options.soa = soa;
+  return options;
+}
+
+/*
+ * Bitcode and assembly may be compiled on another machine, so unless -mcpu
+ * or -mattr is given they are optimized for a generic CPU.  Only the code
+ * that tipc compiles itself, to run it or to emit native code, is tuned for
+ * the host.
+ */
+static bool emitsNativeCode() {
+  return run || (!emitHrAsm && emitKind != EmitKind::bc);
+}
+
+static std::string selectedCPU() {
+  if (targetCPU.getNumOccurrences() == 0 && !emitsNativeCode()) {
+    return "generic";
+  }
+  return targetCPU;
+}
+
+static std::string selectedFeatures() {
+  if (targetFeatures.getNumOccurrences() == 0 && !emitsNativeCode()) {
+    return "";
+  }
+  return targetFeatures;
+}
+
+// The optimizer settings selected on the command line
+static OptimizerOptions selectedOptimizerOptions(unsigned threads) {
+  OptimizerOptions options;
+  options.level = optLevel;
+  options.inlineThreshold = inlineThreshold;
+  options.cpu = selectedCPU();
+  options.features = selectedFeatures();
+  options.jobs = threads;
+  return options;
+}
+
+// The native code settings selected on the command line
+static BackendOptions selectedBackendOptions(unsigned threads) {
+  BackendOptions options;
+  options.cpu = selectedCPU();
+  options.features = selectedFeatures();
+  options.linker = linker;
+  options.jobs = threads;
+  return options;
+}
+
+/*
+ * Write a module to the output selected by --asm or --emit, by default a
+ * file named after the module.  Throws an OutputError if the output could
+ * not be written.
+ */
+static void emitModule(llvm::Module *m, const std::string &output,
+                       const BackendOptions &options) {
+  if (emitHrAsm) {
+    CodeGenerator::emitHumanReadableAssembly(m, output);
+  } else if (emitKind == EmitKind::obj) {
+    Backend::emitObject(m, output, options);
+  } else if (emitKind == EmitKind::exe) {
+    Backend::emitExecutable(m, output, rtlibObject, options);
+  } else {
+    CodeGenerator::emit(m, output);
+  }
+}
+
+/*
+ * Compile a source file to the output selected on the command line, for
+ * --server or for one of several source files.  Files are compiled
+ * concurrently, each on one thread, so failures are thrown as errors whose
+ * messages are reported for the file.
+ */
+static void compileFile(const std::string &source, const std::string &output) {
+  std::ifstream stream(source);
+  if (!stream.good()) {
+    throw std::runtime_error("no such file: '" + source + "'");
+  }
+
+  CompilerOptions options;
+  options.polymorphic = polyinf;
+  options.optimize = !disopt;
+  options.optimizations = OptimizationList;
+  options.codeGen = selectedCodeGenOptions();
+  options.optimizer = selectedOptimizerOptions(1);
+
+  std::unique_ptr<Compilation> compilation;
+  try {
+    compilation = Compiler::compile(stream, source, options);
+  } catch (ParseError &e) {
+    throw std::runtime_error(std::string("parse error: ") + e.what());
+  } catch (SemanticError &e) {
+    throw std::runtime_error(std::string("semantic error: ") + e.what());
+  } catch (InternalError &e) {
+    throw std::runtime_error(std::string("internal error: ") + e.what());
+  }
+
+  try {
+    emitModule(compilation->getModule(), output, selectedBackendOptions(1));
+  } catch (OutputError &e) {
+    throw std::runtime_error(std::string("cannot write the code: ") +
+                             e.what());
+  }
+}
+
+/*
+ * Compile several source files, each to its default output, with up to
+ * <jobs> files compiled at once.  The errors of the files are reported once
+ * every file has been compiled, in the order the files were given, so that
+ * the errors of one file are not interleaved with those of another.
+ */
+static int compileFiles(const std::vector<std::string> &sources) {
+  std::vector<std::string> failures(sources.size());
+  {
+    llvm::ThreadPool workers(llvm::hardware_concurrency(jobs));
+    for (size_t i = 0; i < sources.size(); i++) {
+      workers.async([&sources, &failures, i] {
+        try {
+          compileFile(sources[i], "");
+        } catch (std::exception &e) {
+          failures[i] = e.what();
+        }
+      });
+    }
+    workers.wait();
+  }
+
+  int status = EXIT_SUCCESS;
+  for (size_t i = 0; i < sources.size(); i++) {
+    if (!failures[i].empty()) {
+      LOG_S(ERROR) << "tipc: " << sources[i] << ": " << failures[i];
+      status = EXIT_FAILURE;
+    }
+  }
+  return status;
+}
 
 /*! \brief tipc driver.
  *
@@ -69,7 +312,11 @@ static cl::list<Optimization> OptimizationList(
  * using LLVM CommandLine support.  It runs the phases of the compiler in
  * sequence. If an error is detected, via an exception, it reports the error and
  * exits. If there is no error, then the LLVM bitcode is emitted to a file whose
- * name is the providvvved source file suffixed by ".bc".
+ * name is the providvvved source file suffixed by ".bc", or native code is
+ * emitted as selected by --emit.  With --run or --interp the program is run
+ * within tipc instead.  Several source files are compiled concurrently, each
+ * to its own output.  With --server, tipc keeps running and compiles the
+ * source files named by the requests of its clients.
  */
 int main(int argc, char *argv[]) {
   cl::HideUnrelatedOptions(TIPcat);
@@ -91,6 +338,53 @@ int main(int argc, char *argv[]) {
     }
   }
 
+  if (optLevel != '\0' && std::string("0123sz").find(optLevel) ==
+                              std::string::npos) {
+    LOG_S(ERROR) << "tipc: error: invalid optimization level '-O" << optLevel
+                 << "'";
+    std::exit(EXIT_FAILURE);
+  }
+
+  if (!socketFile.empty() && !server) {
+    LOG_S(ERROR) << "tipc: error: --socket is only accepted by --server";
+    std::exit(EXIT_FAILURE);
+  }
+
+  // the server compiles the files named by its requests until it is stopped
+  if (server) {
+    if (!sourceFile.empty() || run || interp) {
+      LOG_S(ERROR) << "tipc: error: --server compiles the source files named "
+                      "by its requests";
+      std::exit(EXIT_FAILURE);
+    }
+    ServerOptions serverOptions;
+    serverOptions.workers = jobs.getNumOccurrences() > 0 ? jobs : 0;
+    if (socketFile.empty()) {
+      Server::serve(std::cin, std::cout, compileFile, serverOptions);
+    } else if (!Server::listen(socketFile, compileFile, serverOptions)) {
+      std::exit(EXIT_FAILURE);
+    }
+    std::exit(EXIT_SUCCESS);
+  }
+
+  if (sourceFile.empty()) {
+    LOG_S(ERROR) << "tipc: error: no source file";
+    std::exit(EXIT_FAILURE);
+  }
+
+  // without --run or --interp, the other arguments are also source files
+  if (!programArgs.empty() && !run && !interp) {
+    if (!outputfile.empty() || ppretty || psym || ptypes || !cgFile.empty() ||
+        !astFile.empty()) {
+      LOG_S(ERROR) << "tipc: error: -o, --pp, --ps, --pt, --pcg and --pa are "
+                      "only accepted with one source file";
+      std::exit(EXIT_FAILURE);
+    }
+    std::vector<std::string> sources = {sourceFile};
+    sources.insert(sources.end(), programArgs.begin(), programArgs.end());
+    std::exit(compileFiles(sources));
+  }
+
   std::ifstream stream;
   stream.open(sourceFile);
   if (!stream.good()) {
@@ -133,19 +427,6 @@ int main(int argc, char *argv[]) {
         analysisResults->getCallGraph()->print(cgStream);
       }
 
-      auto llvmModule =
-          CodeGenerator::generate(ast.get(), analysisResults.get(), sourceFile);
-
-      if (!disopt) {
-        Optimizer::optimize(llvmModule.get(), OptimizationList);
-      }
-
-      if (emitHrAsm) {
-        CodeGenerator::emitHumanReadableAssembly(llvmModule.get(), outputfile);
-      } else {
-        CodeGenerator::emit(llvmModule.get(), outputfile);
-      }
-
       bool printAST = !astFile.getValue().empty();
       if (printAST) {
         std::ofstream astStream;
@@ -158,10 +439,53 @@ int main(int argc, char *argv[]) {
         }
       }
 
+      // the interpreter runs the checked program without generating code
+      if (interp) {
+        auto bytecode =
+            BytecodeCompiler::compile(ast.get(), analysisResults.get());
+        std::exit(Interpreter::run(*bytecode, programArgs));
+      }
+
+      llvm::LLVMContext context;
+      auto llvmModule =
+          CodeGenerator::generate(ast.get(), analysisResults.get(), sourceFile,
+                                  context, selectedCodeGenOptions());
+
+      OptimizerOptions optimizerOptions = selectedOptimizerOptions(jobs);
+      optimizerOptions.callGraph = analysisResults->getCallGraph();
+
+      // a lazily compiled program is optimized one function at a time
+      bool lazyRun = run && lazy;
+      if (!disopt && !lazyRun) {
+        Optimizer::optimize(llvmModule.get(), OptimizationList,
+                            optimizerOptions);
+      }
+
+      // with --run the program is run in place of writing its code, after the
+      // printed outputs such as --pp and --pcg have been written
+      if (!run) {
+        emitModule(llvmModule.get(), outputfile, selectedBackendOptions(jobs));
+      }
+
+      if (run) {
+        JITOptions jitOptions;
+        jitOptions.lazy = lazy;
+        jitOptions.callGraph = analysisResults->getCallGraph();
+        if (!disopt) {
+          jitOptions.optimize = [&](llvm::Module *m) {
+            Optimizer::optimize(m, OptimizationList, optimizerOptions);
+          };
+        }
+        std::exit(JIT::run(llvmModule.get(), programArgs, jitOptions));
+      }
+
     } catch (SemanticError &e) {
       LOG_S(ERROR) << "tipc: " << e.what();
       LOG_S(ERROR) << "tipc: semantic error";
       std::exit(EXIT_FAILURE);
+    } catch (OutputError &e) {
+      LOG_S(ERROR) << "tipc: error: " << e.what();
+      std::exit(EXIT_FAILURE);
     } catch (InternalError &e) { // LCOV_EXCL_LINE
       /* Internal errors should never happen, but we have logic to catch
        * them just in case.  We do not want to count these lines toward
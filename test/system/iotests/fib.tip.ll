@@ -32,12 +32,16 @@ exit1:                                            ; preds = %header1
 define i64 @_tip_main() {
 entry:
   %tipinput0 = load i64, ptr @_tip_input_array, align 4
-  %calltmp = call i64 @fib(i64 %tipinput0)
+  %calltmp = tail call i64 @fib(i64 %tipinput0)
   ret i64 %calltmp
 }
 
+; Function Attrs: nounwind allockind("alloc,zeroed") allocsize(1,0)
+declare noalias align 8 ptr @calloc(i64, i64) #1
+
 ; Function Attrs: nounwind
-declare noalias ptr @calloc(i64, i64) #1
+declare noalias align 64 ptr @_tip_alloc_array(i64) #2
 
 attributes #0 = { nocallback nofree nosync nounwind willreturn memory(none) }
-attributes #1 = { nounwind }
+attributes #1 = { nounwind allockind("alloc,zeroed") allocsize(1,0) "alloc-family"="malloc" }
+attributes #2 = { nounwind }
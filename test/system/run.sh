@@ -104,6 +104,247 @@ do
   rm $i.bc
 done
 
+# Garbage collected heap, run with bounded memory
+for i in selftests/*.tip siptests/*.tip gctests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  initialize_test
+  ${TIPC} --gc $i
+  ${TIPCLANG} -w $i.bc ${RTLIB}/tip_rtlib.bc -o $base
+
+  (ulimit -v 262144; ./${base} &>/dev/null)
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for --gc : "
+    echo $i
+    ./${base}
+    ((numfailures++))
+  else
+    rm ${base}
+  fi
+  rm $i.bc
+done
+
+# Function passes run on several threads, with and without the optional passes
+for opts in "" "--adce --ivs --lup --lrp --tre --inl --vec" "-O2 --tre --vec"
+do
+  for i in selftests/*.tip siptests/*.tip
+  do
+    base="$(basename $i .tip)"
+
+    initialize_test
+    ${TIPC} -j4 ${opts} $i
+    ${TIPCLANG} -w $i.bc ${RTLIB}/tip_rtlib.bc -o $base
+
+    ./${base} &>/dev/null
+    exit_code=${?}
+    if [ ${exit_code} -ne 0 ]; then
+      echo -n "Test failure for -j4 ${opts} : "
+      echo $i
+      ./${base}
+      ((numfailures++))
+    else
+      rm ${base}
+    fi
+    rm $i.bc
+  done
+done
+
+# Functions optimized on several threads are merged in the same order
+for i in siptests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  initialize_test
+  ${TIPC} -j4 --asm -o ${SCRATCH_DIR}/${base}.first.ll $i
+  ${TIPC} -j4 --asm -o ${SCRATCH_DIR}/${base}.second.ll $i
+
+  if ! diff -q ${SCRATCH_DIR}/${base}.first.ll ${SCRATCH_DIR}/${base}.second.ll >/dev/null
+  then
+    echo -n "Test differences for -j4 --asm : "
+    echo $i
+    ((numfailures++))
+  fi
+done
+
+# Native executables emitted and linked by tipc, on one thread and on several
+for jobs in "-j1" "-j4"
+do
+  for i in selftests/*.tip
+  do
+    base="$(basename $i .tip)"
+
+    initialize_test
+    ${TIPC} --emit=exe ${jobs} -o ${SCRATCH_DIR}/${base} $i
+
+    ${SCRATCH_DIR}/${base} &>/dev/null
+    exit_code=${?}
+    if [ ${exit_code} -ne 0 ]; then
+      echo -n "Test failure for --emit=exe ${jobs} : "
+      echo $i
+      ((numfailures++))
+    fi
+  done
+done
+
+# The default executables of sources with the same name are written next to
+# each source, so that compiling them together does not race on one output
+initialize_test
+mkdir -p ${SCRATCH_DIR}/a ${SCRATCH_DIR}/b
+cp selftests/fibs.tip ${SCRATCH_DIR}/a/prog.tip
+cp selftests/fun.tip ${SCRATCH_DIR}/b/prog.tip
+${TIPC} --emit=exe -j2 ${SCRATCH_DIR}/a/prog.tip ${SCRATCH_DIR}/b/prog.tip
+if [ ${?} -ne 0 ] || ! ${SCRATCH_DIR}/a/prog &>/dev/null ||
+  ! ${SCRATCH_DIR}/b/prog &>/dev/null; then
+  echo "Test failure for the default executables of several source files"
+  ((numfailures++))
+fi
+rm -rf ${SCRATCH_DIR}/a ${SCRATCH_DIR}/b
+
+# Objects of partitions compiled on several threads are combined into one
+for i in selftests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  initialize_test
+  ${TIPC} --emit=obj -j4 -o ${SCRATCH_DIR}/${base}.o $i
+  ${TIPCLANG} -w ${SCRATCH_DIR}/${base}.o ${RTLIB}/tip_rtlib.bc -o $base
+
+  ./${base} &>/dev/null
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for --emit=obj -j4 : "
+    echo $i
+    ((numfailures++))
+  else
+    rm ${base}
+  fi
+done
+
+# Programs compiled by one server, named on its standard input
+initialize_test
+for i in selftests/*.tip siptests/*.tip
+do
+  echo "$i ${SCRATCH_DIR}/$(basename $i .tip).bc"
+done | ${TIPC} --server -j4 > ${SCRATCH_DIR}/server.answers
+grep -v "^ok " ${SCRATCH_DIR}/server.answers > ${SCRATCH_DIR}/server.errors
+if [[ -s ${SCRATCH_DIR}/server.errors ]]; then
+  echo -n "Test failure for --server : "
+  cat ${SCRATCH_DIR}/server.errors
+  ((numfailures++))
+fi
+for i in selftests/*.tip siptests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  ${TIPCLANG} -w ${SCRATCH_DIR}/${base}.bc ${RTLIB}/tip_rtlib.bc -o $base
+
+  ./${base} &>/dev/null
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for --server : "
+    echo $i
+    ((numfailures++))
+  else
+    rm ${base}
+  fi
+done
+
+# A server answers requests for files with errors, and for outputs that
+# cannot be written
+initialize_test
+printf "iotests/parseerror.tip\niotests/semanticerror.tip\nnosuchfile.tip\n" \
+  > ${SCRATCH_DIR}/server.requests
+echo "selftests/fibs.tip ${SCRATCH_DIR}/nosuchdir/fibs.bc" \
+  >> ${SCRATCH_DIR}/server.requests
+echo "selftests/fibs.tip ${SCRATCH_DIR}/nosuchdir/fibs.ll" |
+  ${TIPC} --server --asm >> ${SCRATCH_DIR}/server.answers
+${TIPC} --server < ${SCRATCH_DIR}/server.requests \
+  >> ${SCRATCH_DIR}/server.answers
+if [ $(grep -c "^error " ${SCRATCH_DIR}/server.answers) -ne 5 ]; then
+  echo -n "Test failure for --server errors : "
+  cat ${SCRATCH_DIR}/server.answers
+  ((numfailures++))
+fi
+
+# Several programs compiled by one tipc, each to its own output
+initialize_test
+cp selftests/*.tip siptests/*.tip ${SCRATCH_DIR}
+${TIPC} -j4 ${SCRATCH_DIR}/*.tip
+for i in selftests/*.tip siptests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  ${TIPCLANG} -w ${SCRATCH_DIR}/${base}.tip.bc ${RTLIB}/tip_rtlib.bc -o $base
+
+  ./${base} &>/dev/null
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for several source files : "
+    echo $i
+    ((numfailures++))
+  else
+    rm ${base}
+  fi
+done
+
+# The errors of each of several source files are reported, including an
+# output that cannot be written since a directory has its name
+initialize_test
+cp selftests/fibs.tip selftests/fun.tip iotests/parseerror.tip \
+  iotests/semanticerror.tip ${SCRATCH_DIR}
+mkdir ${SCRATCH_DIR}/fun.tip.bc
+${TIPC} -j2 ${SCRATCH_DIR}/fibs.tip ${SCRATCH_DIR}/parseerror.tip \
+  ${SCRATCH_DIR}/semanticerror.tip ${SCRATCH_DIR}/fun.tip \
+  2> ${SCRATCH_DIR}/batch.errors
+exit_code=${?}
+rmdir ${SCRATCH_DIR}/fun.tip.bc
+if [ ${exit_code} -eq 0 ] || [ ! -f ${SCRATCH_DIR}/fibs.tip.bc ] ||
+  ! grep -q "parseerror.tip: parse error" ${SCRATCH_DIR}/batch.errors ||
+  ! grep -q "semanticerror.tip: semantic error" ${SCRATCH_DIR}/batch.errors ||
+  ! grep -q "fun.tip: cannot write" ${SCRATCH_DIR}/batch.errors; then
+  echo -n "Test failure for several source files with errors : "
+  cat ${SCRATCH_DIR}/batch.errors
+  ((numfailures++))
+fi
+
+# Arrays of records stored as columns
+for i in siptests/*.tip
+do
+  base="$(basename $i .tip)"
+
+  initialize_test
+  ${TIPC} --soa $i
+  ${TIPCLANG} -w $i.bc ${RTLIB}/tip_rtlib.bc -o $base
+
+  ./${base} &>/dev/null
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for --soa : "
+    echo $i
+    ./${base}
+    ((numfailures++))
+  else
+    rm ${base}
+  fi
+  rm $i.bc
+done
+
+# Programs run by the bytecode interpreter
+for i in selftests/*.tip siptests/*.tip
+do
+  initialize_test
+  ${TIPC} --interp $i &>/dev/null
+  exit_code=${?}
+  if [ ${exit_code} -ne 0 ]; then
+    echo -n "Test failure for --interp : "
+    echo $i
+    ${TIPC} --interp $i
+    ((numfailures++))
+  fi
+done
+
 # IO related test cases
 for i in iotests/*.expected
 do
@@ -133,6 +374,32 @@ do
   rm $executable
 done
 
+# The same programs run in memory by tipc, compiled up front and lazily, and
+# by the bytecode interpreter
+for mode in "--run" "--run --lazy" "--interp"
+do
+  for i in iotests/*.expected
+  do
+    initialize_test
+
+    expected="$(basename $i .tip)"
+    executable="$(echo $expected | cut -f1 -d-)"
+    input="$(echo $expected | cut -f2 -d- | cut -f1 -d.)"
+
+    ${TIPC} ${mode} iotests/$executable.tip $input >${SCRATCH_DIR}/$executable.output 2>&1
+
+    diff ${SCRATCH_DIR}/$executable.output $i > ${SCRATCH_DIR}/$executable.diff
+
+    if [[ -s ${SCRATCH_DIR}/$executable.diff ]]
+    then
+      echo -n "Test differences for ${mode} : "
+      echo $i
+      cat ${SCRATCH_DIR}/$executable.diff
+      ((numfailures++))
+    fi
+  done
+done
+
 # Tests to cover driver logic for error and argument handling
 for i in iotests/*error.tip
 do
@@ -146,9 +413,22 @@ do
     echo " expected error"
     ((numfailures++))
     rm iotests/*error.tip.bc
-  fi 
+  fi
 done
 
+# Failed runtime checks trap without reporting the error
+initialize_test
+${TIPC} --trap iotests/bounds.tip
+${TIPCLANG} -w iotests/bounds.tip.bc ${RTLIB}/tip_rtlib.bc -o bounds
+./bounds 6 >${SCRATCH_DIR}/bounds.output 2>/dev/null
+exit_code=${?}
+if [ ${exit_code} -eq 0 ] || grep -q "Execution error" ${SCRATCH_DIR}/bounds.output; then
+  echo "Test failure for --trap : iotests/bounds.tip expected a trap"
+  ((numfailures++))
+fi
+rm iotests/bounds.tip.bc
+rm bounds
+
 # System tests for polymorphic type inference
 for i in polytests/*.tip
 do
@@ -212,7 +492,7 @@ output=${SCRATCH_DIR}/fib.tip.ll
 expected=iotests/fib.tip.ll
 diffed=${SCRATCH_DIR}/fib.diff
 ${TIPC} --asm $input -o $output
-diff <(sed -n '4,$p' $output) <(sed -n '4,$p' $expected) > $diffed
+diff <(sed '1,/^target triple/d' $output) <(sed '1,/^target triple/d' $expected) > $diffed
 if [ -s $diffed ]; then
   echo -n "Test differences for: $input" 
   cat $diffed
@@ -0,0 +1,133 @@
+#include "ASTHelper.h"
+#include "BytecodeCompiler.h"
+#include "SemanticAnalysis.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+std::unique_ptr<BytecodeProgram> compile(std::stringstream &program) {
+  auto ast = ASTHelper::build_ast(program);
+  auto analysisResults = SemanticAnalysis::analyze(ast.get(), false);
+  return BytecodeCompiler::compile(ast.get(), analysisResults.get());
+}
+
+// Count the instructions of a function with the given operation
+int countOps(const BytecodeFunction &fn, Opcode op) {
+  int count = 0;
+  for (auto &inst : fn.code) {
+    if (inst.op == op) {
+      count++;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+TEST_CASE("BytecodeCompiler: functions keep their table order",
+          "[BytecodeCompiler]") {
+  std::stringstream program;
+  program << R"(
+      inc(x) {
+        return x + 1;
+      }
+      main(n) {
+        return inc(n);
+      }
+    )";
+
+  auto bytecode = compile(program);
+
+  REQUIRE(bytecode->functions.size() == 2);
+  REQUIRE(bytecode->functions[0].name == "inc");
+  REQUIRE(bytecode->functions[0].numParams == 1);
+  REQUIRE(bytecode->mainIndex == 1);
+  REQUIRE(countOps(bytecode->functions[1], Opcode::CallFunction) == 1);
+}
+
+TEST_CASE("BytecodeCompiler: program without main reports it",
+          "[BytecodeCompiler]") {
+  std::stringstream program;
+  program << R"(
+      foo() {
+        return 1;
+      }
+    )";
+
+  auto bytecode = compile(program);
+
+  REQUIRE(bytecode->functions.size() == 2);
+  REQUIRE(bytecode->mainIndex == 1);
+  REQUIRE(bytecode->functions[1].code.front().op == Opcode::MainUndefined);
+}
+
+TEST_CASE("BytecodeCompiler: comparisons in conditions jump on their operands",
+          "[BytecodeCompiler]") {
+  std::stringstream program;
+  program << R"(
+      main(n) {
+        var i, s;
+        s = 0;
+        i = 0;
+        while (i < n and not (i == 7)) {
+          s = s + i;
+          i++;
+        }
+        return s;
+      }
+    )";
+
+  auto bytecode = compile(program);
+  auto &main = bytecode->functions[bytecode->mainIndex];
+
+  REQUIRE(countOps(main, Opcode::JumpGe) == 1);
+  REQUIRE(countOps(main, Opcode::JumpEq) == 1);
+  REQUIRE(countOps(main, Opcode::Lt) == 0);
+  REQUIRE(countOps(main, Opcode::Move) == 0);
+}
+
+TEST_CASE("BytecodeCompiler: variables whose address is taken are cells",
+          "[BytecodeCompiler]") {
+  std::stringstream program;
+  program << R"(
+      foo(x) {
+        var p, y;
+        p = &x;
+        *p = 2;
+        y = 3;
+        return x + y;
+      }
+    )";
+
+  auto bytecode = compile(program);
+  auto &foo = bytecode->functions[0];
+
+  REQUIRE(foo.code.front().op == Opcode::Alloc);
+  REQUIRE(foo.code.front().a == 0);
+  REQUIRE(countOps(foo, Opcode::Alloc) == 1);
+  REQUIRE(countOps(foo, Opcode::Load) == 1);
+}
+
+TEST_CASE("BytecodeCompiler: records that do not escape reuse their storage",
+          "[BytecodeCompiler]") {
+  std::stringstream program;
+  program << R"(
+      sum(n) {
+        var r, s, i;
+        s = 0;
+        for (i : 0 .. n) {
+          r = {f: i, g: 1};
+          s = s + r.f + r.g;
+        }
+        return s;
+      }
+    )";
+
+  auto bytecode = compile(program);
+  auto &sum = bytecode->functions[0];
+
+  REQUIRE(countOps(sum, Opcode::FrameAlloc) == 1);
+  REQUIRE(countOps(sum, Opcode::NewRecord) == 0);
+  REQUIRE(countOps(sum, Opcode::Release) == 1);
+}
@@ -0,0 +1,93 @@
+#include "Compiler.h"
+#include "ParseError.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <sstream>
+#include <thread>
+
+namespace {
+
+std::unique_ptr<Compilation> compile(const std::string &source,
+                                     const std::string &name) {
+  std::stringstream stream(source);
+  CompilerOptions options;
+  options.optimize = false;
+  return Compiler::compile(stream, name, options);
+}
+
+// Number of fields of the global record type of a module
+unsigned recordFields(llvm::Module *m) {
+  auto *record =
+      llvm::StructType::getTypeByName(m->getContext(), "globalRecord");
+  return record == nullptr ? 0 : record->getNumElements();
+}
+
+} // namespace
+
+TEST_CASE("Compiler: program compiles to a module", "[Compiler]") {
+  std::string program = R"(
+      main(x) {
+        return x + 1;
+      }
+    )";
+
+  auto compilation = compile(program, "program.tip");
+
+  auto *m = compilation->getModule();
+  REQUIRE(m->getName() == "program.tip");
+  REQUIRE(m->getFunction("_tip_main") != nullptr);
+  REQUIRE(&m->getContext() == &compilation->getContext());
+}
+
+TEST_CASE("Compiler: compilations do not share state", "[Compiler]") {
+  std::string threeFields = R"(
+      main() {
+        var r;
+        r = {a: 1, b: 2, c: 3};
+        return r.a;
+      }
+    )";
+  std::string oneField = R"(
+      main() {
+        var r;
+        r = {a: 1};
+        return r.a;
+      }
+    )";
+
+  auto first = compile(threeFields, "first.tip");
+  auto second = compile(oneField, "second.tip");
+
+  REQUIRE(recordFields(first->getModule()) == 3);
+  REQUIRE(recordFields(second->getModule()) == 1);
+  REQUIRE(&first->getContext() != &second->getContext());
+}
+
+TEST_CASE("Compiler: programs compile concurrently", "[Compiler]") {
+  const int numThreads = 8;
+  std::vector<std::unique_ptr<Compilation>> compilations(numThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numThreads; i++) {
+    threads.emplace_back([&compilations, i] {
+      std::string source = "f" + std::to_string(i) + "(x) { return x * " +
+                           std::to_string(i) + "; }\n" +
+                           "main(x) { return f" + std::to_string(i) +
+                           "(x); }\n";
+      compilations[i] = compile(source, "program" + std::to_string(i));
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  for (int i = 0; i < numThreads; i++) {
+    auto *m = compilations[i]->getModule();
+    REQUIRE(m->getFunction("f" + std::to_string(i)) != nullptr);
+    REQUIRE(m->getFunction("_tip_main") != nullptr);
+  }
+}
+
+TEST_CASE("Compiler: syntax errors are reported", "[Compiler]") {
+  REQUIRE_THROWS_AS(compile("main() { return 1 }", "bad.tip"), ParseError);
+}
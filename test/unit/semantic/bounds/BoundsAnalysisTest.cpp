@@ -0,0 +1,229 @@
+#include "ASTHelper.h"
+#include "AST.h"
+#include "BoundsAnalysis.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+// Collect the array accesses of the program in source order
+void collectRefs(ASTNode *node, std::vector<ASTArrayRefExpr *> &refs) {
+  if (auto ref = dynamic_cast<ASTArrayRefExpr *>(node)) {
+    refs.push_back(ref);
+  }
+  for (auto &c : node->getChildren()) {
+    collectRefs(c.get(), refs);
+  }
+}
+
+std::vector<ASTArrayRefExpr *> refsOf(ASTProgram *ast) {
+  std::vector<ASTArrayRefExpr *> refs;
+  collectRefs(ast, refs);
+  return refs;
+}
+
+// Returns the first range loop of the program
+ASTForRangeStmt *firstRangeLoop(ASTNode *node) {
+  if (auto loop = dynamic_cast<ASTForRangeStmt *>(node)) {
+    return loop;
+  }
+  for (auto &c : node->getChildren()) {
+    if (auto loop = firstRangeLoop(c.get())) {
+      return loop;
+    }
+  }
+  return nullptr;
+}
+
+} // namespace
+
+TEST_CASE("BoundsAnalysis: range loop over the array length is in bounds",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a) {
+        var s, i;
+        s = 0;
+        for (i : 0 .. #a) {
+          s = s + a[i];
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 1);
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[0]));
+  REQUIRE_FALSE(bounds->needsUpperCheck(refs[0]));
+  REQUIRE(bounds->getVersionedChecks(firstRangeLoop(ast.get())).empty());
+}
+
+TEST_CASE("BoundsAnalysis: modified index or array keeps the checks",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a, b) {
+        var s, i, p;
+        s = 0;
+        for (i : 0 .. #a) {
+          s = s + a[i];
+          i = i + 1;
+        }
+        for (i : 0 .. #b) {
+          s = s + b[i];
+          b = a;
+        }
+        p = &a;
+        for (i : 0 .. #a) {
+          s = s + a[i];
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 3);
+  REQUIRE(bounds->needsLowerCheck(refs[0]));
+  REQUIRE(bounds->needsUpperCheck(refs[0]));
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[1]));
+  REQUIRE(bounds->needsUpperCheck(refs[1]));
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[2]));
+  REQUIRE(bounds->needsUpperCheck(refs[2]));
+}
+
+TEST_CASE("BoundsAnalysis: unknown lower bound or step keeps the checks",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a, n) {
+        var s, i;
+        s = 0;
+        for (i : n .. #a) {
+          s = s + a[i];
+        }
+        for (i : 0 .. #a by n) {
+          s = s + a[i];
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+
+  for (auto ref : refsOf(ast.get())) {
+    REQUIRE(bounds->needsLowerCheck(ref));
+    REQUIRE(bounds->needsUpperCheck(ref));
+  }
+}
+
+TEST_CASE("BoundsAnalysis: overflow checks of an unknown bound are versioned",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a, b, n) {
+        var s, i;
+        s = 0;
+        for (i : 0 .. n) {
+          s = s + a[i] * b[i];
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 2);
+  for (auto ref : refs) {
+    REQUIRE_FALSE(bounds->needsLowerCheck(ref));
+    REQUIRE(bounds->needsUpperCheck(ref));
+  }
+  REQUIRE(bounds->getVersionedChecks(firstRangeLoop(ast.get())).size() == 2);
+}
+
+TEST_CASE("BoundsAnalysis: outer loops are not versioned", "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a, n) {
+        var s, i, j;
+        s = 0;
+        for (i : 0 .. n) {
+          for (j : 0 .. #a) {
+            s = s + a[i] + a[j];
+          }
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 2);
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[0]));
+  REQUIRE(bounds->needsUpperCheck(refs[0]));
+  REQUIRE_FALSE(bounds->needsUpperCheck(refs[1]));
+  REQUIRE(bounds->getVersionedChecks(firstRangeLoop(ast.get())).empty());
+}
+
+TEST_CASE("BoundsAnalysis: while loop guarded by the array length",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a) {
+        var s, i;
+        s = 0;
+        i = 0;
+        while (i < #a) {
+          s = s + a[i];
+          i = i + 1;
+          s = s + a[i];
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 2);
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[0]));
+  REQUIRE_FALSE(bounds->needsUpperCheck(refs[0]));
+  REQUIRE_FALSE(bounds->needsLowerCheck(refs[1]));
+  REQUIRE(bounds->needsUpperCheck(refs[1]));
+}
+
+TEST_CASE("BoundsAnalysis: decreasing while index keeps the checks",
+          "[BoundsAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(a) {
+        var s, i;
+        s = 0;
+        i = 0;
+        while (#a > i) {
+          s = s + a[i];
+          i--;
+        }
+        return s;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto bounds = BoundsAnalysis::analyze(ast.get());
+  auto refs = refsOf(ast.get());
+
+  REQUIRE(refs.size() == 1);
+  REQUIRE(bounds->needsLowerCheck(refs[0]));
+  REQUIRE(bounds->needsUpperCheck(refs[0]));
+}
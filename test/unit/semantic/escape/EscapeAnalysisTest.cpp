@@ -0,0 +1,324 @@
+#include "ASTHelper.h"
+#include "AST.h"
+#include "EscapeAnalysis.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+namespace {
+
+// Count the non-escaping sites of the given node type
+template <typename T> int countSites(EscapeAnalysis *escape) {
+  int count = 0;
+  for (auto s : escape->getStackSites()) {
+    if (dynamic_cast<T *>(s) != nullptr) {
+      count++;
+    }
+  }
+  return count;
+}
+
+} // namespace
+
+TEST_CASE("EscapeAnalysis: dereferenced cell does not escape",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(x) {
+        var p;
+        p = alloc x;
+        *p = *p + 1;
+        return *p;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getStackSites().size() == 1);
+  REQUIRE(countSites<ASTAllocExpr>(escape.get()) == 1);
+}
+
+TEST_CASE("EscapeAnalysis: returned, passed and copied cells escape",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      id(p) {
+        return p;
+      }
+      foo(x) {
+        var p, q, r, s;
+        p = alloc x;
+        q = alloc x;
+        r = alloc x;
+        s = r;
+        x = id(q);
+        return p;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getStackSites().empty());
+}
+
+TEST_CASE("EscapeAnalysis: taking an interior address escapes",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(x) {
+        var p, a, r;
+        p = alloc x;
+        a = [x, x];
+        r = &*p;
+        r = &a[0];
+        return *p + a[1];
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getStackSites().empty());
+}
+
+TEST_CASE("EscapeAnalysis: stored pointer escapes", "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(x) {
+        var p, q;
+        p = alloc x;
+        q = alloc 0;
+        *q = p;
+        return *q;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // q only holds a value, while p is stored into q
+  REQUIRE(escape->getStackSites().size() == 1);
+}
+
+TEST_CASE("EscapeAnalysis: records reached through field accesses",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(x) {
+        var p, q;
+        p = alloc {f: x, g: 0};
+        (*p).g = (*p).f;
+        q = alloc {f: x};
+        x = *q;
+        return (*p).g + (*q).f;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // both cells stay local, but the record held by q is read out of its cell
+  REQUIRE(countSites<ASTAllocExpr>(escape.get()) == 2);
+  REQUIRE(countSites<ASTRecordExpr>(escape.get()) == 1);
+}
+
+TEST_CASE("EscapeAnalysis: arrays used through indexing and length",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(n) {
+        var a, b, c, d, s, e;
+        a = [1, 2, 3];
+        b = [4 of 0];
+        c = [n of 0];
+        d = [2000 of 0];
+        s = 0;
+        for (e : a) {
+          s = s + e;
+        }
+        return s + a[0] + #b + b[1] + c[0] + d[0];
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // variable-length and oversized arrays are kept on the heap
+  REQUIRE(countSites<ASTArrayDefaultExpr>(escape.get()) == 1);
+  REQUIRE(countSites<ASTArrayFixedExpr>(escape.get()) == 1);
+  REQUIRE(escape->getStackSites().size() == 2);
+}
+
+TEST_CASE("EscapeAnalysis: record values used through field accesses",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      id(r) {
+        return r;
+      }
+      foo(n) {
+        var r, s, t;
+        r = {f: n, g: 0};
+        s = {f: n};
+        t = id(s);
+        return r.f + r.g + t.f;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // s is passed to a function, so only the record held by r stays local
+  REQUIRE(countSites<ASTRecordExpr>(escape.get()) == 1);
+  REQUIRE(escape->getStackSites().size() == 1);
+}
+
+TEST_CASE("EscapeAnalysis: self-referencing initializer is not promoted",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo(n) {
+        var a;
+        a = [1, 2];
+        a = [a[1], a[0]];
+        return a[0];
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getStackSites().size() == 1);
+}
+
+TEST_CASE("EscapeAnalysis: calls in return statements are tail calls",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      done(n, r) {
+        return r;
+      }
+      sum(n, acc) {
+        var p;
+        p = alloc acc;
+        return (n == 0 ? done : sum)(n - 1, *p + n);
+      }
+      twice(n) {
+        return 2 * sum(n, 0);
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getTailCalls().size() == 1);
+}
+
+TEST_CASE("EscapeAnalysis: exposed frames prevent tail calls",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      get(p) {
+        return *p;
+      }
+      field(r) {
+        return r.f;
+      }
+      addr(x) {
+        return get(&x);
+      }
+      record(x) {
+        return field({f: x});
+      }
+      heap(x) {
+        return get(alloc x);
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // only the call in heap passes a pointer that is not into its frame
+  REQUIRE(escape->getTailCalls().size() == 1);
+}
+
+TEST_CASE("EscapeAnalysis: arrays of arrays with rows of the same length",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      id(a) {
+        return a;
+      }
+      zero() {
+        return 0;
+      }
+      foo(n, m) {
+        var a, b, c, d, x;
+        a = [n of [m of 0]];
+        b = [n of [m of 0]];
+        c = [n of [m of zero()]];
+        d = [4 of [3 of 1]];
+        b[0] = [1, 2];
+        x = id(d);
+        return a[0][1] + a[1][0] + b[0][0] + c[0][0] + d[0][0];
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // c calls a function for each element, and its rows are built one by one
+  REQUIRE(escape->getContiguousArrays().size() == 3);
+  // b has a row replaced and d is passed to a function
+  REQUIRE(escape->getStridedRefs().size() == 2);
+  REQUIRE(escape->getStackSites().empty());
+}
+
+TEST_CASE("EscapeAnalysis: arrays of records used through their fields",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      get(r) {
+        return r.f;
+      }
+      foo(n) {
+        var a, b, c, e, s;
+        a = [n of {f: 0, g: 1}];
+        b = [{f: 1, g: 2}, {f: 3, g: 4}];
+        c = [n of {f: 0, g: 1}];
+        a[0].f = b[1].g;
+        s = get(c[0]);
+        for (e : b) {
+          s = s + e.f;
+        }
+        return s + a[1].g + #a;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  // the records of b and c are used as values
+  REQUIRE(escape->getColumnarArrays().size() == 1);
+  REQUIRE(escape->getColumnAccesses().size() == 2);
+}
+
+TEST_CASE("EscapeAnalysis: an empty array is not an array of records",
+          "[EscapeAnalysis]") {
+  std::stringstream program;
+  program << R"(
+      foo() {
+        var a, b;
+        a = [];
+        b = [];
+        b = [{f: 1}];
+        return #a + b[0].f;
+      }
+    )";
+
+  auto ast = ASTHelper::build_ast(program);
+  auto escape = EscapeAnalysis::analyze(ast.get());
+
+  REQUIRE(escape->getColumnarArrays().empty());
+}
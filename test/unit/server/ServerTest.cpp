@@ -0,0 +1,135 @@
+#include "Server.h"
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Records the requests it is given and fails those of "bad.tip"
+class Recorder {
+public:
+  Server::Handler handler() {
+    return [this](const std::string &source, const std::string &output) {
+      if (source == "bad.tip") {
+        throw std::runtime_error("parse error: missing ';'");
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      outputs[source] = output;
+    };
+  }
+
+  std::map<std::string, std::string> outputs;
+
+private:
+  std::mutex mutex;
+};
+
+std::vector<std::string> sortedLines(const std::string &text) {
+  std::vector<std::string> lines;
+  std::istringstream stream(text);
+  std::string line;
+  while (std::getline(stream, line)) {
+    lines.push_back(line);
+  }
+  std::sort(lines.begin(), lines.end());
+  return lines;
+}
+
+// Connect to a server, retrying while it starts to listen
+int connectTo(const std::string &path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strncpy(address.sun_path, path.c_str(), sizeof(address.sun_path) - 1);
+  for (int attempt = 0; attempt < 100; attempt++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connect(fd, reinterpret_cast<sockaddr *>(&address),
+                sizeof(address)) == 0) {
+      return fd;
+    }
+    close(fd);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  }
+  return -1;
+}
+
+} // namespace
+
+TEST_CASE("Server: requests are answered", "[Server]") {
+  std::stringstream requests;
+  requests << "a.tip\n"
+           << "  b.tip   b.bc  \n"
+           << "\n"
+           << "bad.tip\n";
+  std::stringstream answers;
+  Recorder recorder;
+
+  ServerOptions options;
+  options.workers = 2;
+  Server::serve(requests, answers, recorder.handler(), options);
+
+  std::vector<std::string> expected = {
+      "error bad.tip: parse error: missing ';'", "ok a.tip", "ok b.tip"};
+  REQUIRE(sortedLines(answers.str()) == expected);
+  REQUIRE(recorder.outputs["a.tip"] == "");
+  REQUIRE(recorder.outputs["b.tip"] == "b.bc");
+}
+
+TEST_CASE("Server: malformed requests are reported", "[Server]") {
+  std::stringstream requests;
+  requests << "a.tip a.bc extra\n";
+  std::stringstream answers;
+  Recorder recorder;
+
+  Server::serve(requests, answers, recorder.handler());
+
+  REQUIRE(answers.str() ==
+          "error a.tip: malformed request 'a.tip a.bc extra'\n");
+  REQUIRE(recorder.outputs.empty());
+}
+
+TEST_CASE("Server: clients of a socket are answered", "[Server]") {
+  char directory[] = "/tmp/tipc_server_XXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+  std::string path = std::string(directory) + "/tipc.sock";
+  Recorder recorder;
+
+  bool stopped = false;
+  std::thread server([&] {
+    stopped = Server::listen(path, recorder.handler());
+  });
+
+  int fd = connectTo(path);
+  REQUIRE(fd >= 0);
+  std::string requests = "a.tip a.o\nbad.tip\nshutdown\n";
+  REQUIRE(write(fd, requests.data(), requests.size()) ==
+          static_cast<ssize_t>(requests.size()));
+
+  std::string answers;
+  char chunk[256];
+  ssize_t n;
+  while ((n = read(fd, chunk, sizeof(chunk))) > 0) {
+    answers.append(chunk, n);
+  }
+  close(fd);
+  server.join();
+  rmdir(directory);
+
+  std::vector<std::string> expected = {
+      "error bad.tip: parse error: missing ';'", "ok a.tip"};
+  REQUIRE(sortedLines(answers) == expected);
+  REQUIRE(recorder.outputs["a.tip"] == "a.o");
+  REQUIRE(stopped);
+}